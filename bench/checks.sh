@@ -0,0 +1,152 @@
+#!/bin/sh
+#
+#	HAwk check pipeline - runs entirely on localhost
+#
+#	Points a scratch HAwk at bench/mock_mysqld answering every query
+#	CHECK_LATENCY ms late, with the read_only, SQL, disk and load checks
+#	on. The read_only and SQL checks each make a query of their own,
+#	so run one after another a round would take three times the
+#	latency; run alongside the wsrep probe it takes one. Reports the
+#	mean wsrep probe and round times from /metrics and fails if a round
+#	takes half as long again as the probe. Then fails one check at a
+#	time and compares the agent-check answer with the one its on_fail
+#	setting calls for.
+#
+#	CHECK_SECONDS	length of the timing run (default 5)
+#	CHECK_LATENCY	ms the mock takes over each query (default 200)
+#	BENCH_PORT	first of the local ports to use (default 18000)
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+SECS=${CHECK_SECONDS:-5}
+LATENCY=${CHECK_LATENCY:-200}
+BASE=${BENCH_PORT:-18000}
+HTTP_PORT=$BASE
+AGENT_PORT=$((BASE + 1))
+MYSQL_PORT=$((BASE + 2))
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hawk-checks.XXXXXX")
+MOCK=
+FAILED=0
+
+cleanup()
+{
+	[ -f "$WORK/hawk.pid" ] && kill "$(cat "$WORK/hawk.pid")" 2>/dev/null
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+alive()
+{
+	[ -e /proc/"$1" ] && ! grep -qs '^State:.*Z' /proc/"$1"/status
+}
+
+start()
+{
+	rm -f "$WORK/log/hawkd.log"
+	cat > "$WORK/conf/hawkd.ini" <<CONF
+[mysql]
+host =		127.0.0.1
+port =		$MYSQL_PORT
+user =		bench
+pass =		bench
+
+[hawk]
+port =		$HTTP_PORT
+agent_port =	$AGENT_PORT
+daemon_user =	$(id -un)
+probe_interval = 250
+pid_path =	$WORK/hawk.pid
+latency_stats =	1
+
+[check_read_only]
+enabled =	1
+
+[check_sql]
+enabled =	1
+query =		SELECT @@wsrep_sst_method
+expect =	${1:-rsync}
+
+[check_disk]
+enabled =	1
+path =		$WORK
+min_free =	${2:-0}
+
+[check_load]
+enabled =	1
+max =		${3:-1000}
+CONF
+	HAWK_HOME=$WORK ./hawk || { FAILED=1; return 1; }
+}
+
+stop()
+{
+	pid=$(cat "$WORK/hawk.pid")
+	kill -TERM "$pid"
+	while alive "$pid"; do :; done
+	rm -f "$WORK/hawk.pid"
+}
+
+mean()
+{
+	awk -v phase="$1" -F'[{}" ]+' '
+		$1 == "hawk_phase_seconds_sum" && $3 == phase { sum = $4 }
+		$1 == "hawk_phase_seconds_count" && $3 == phase { n = $4 }
+		END { if (n > 0) printf "%.0f", sum / n * 1000000; else print 0 }' "$WORK/metrics"
+}
+
+# Whatever was expected, against what the agent check answers after a
+# few rounds
+verdict()
+{
+	label=$1
+	expect=$2
+	shift 2
+	start "$@" || return
+	sleep 2
+	answer=$(./bench/slowread -p "$AGENT_PORT" -a -n 1 -D 2>/dev/null | sed 's/ *#.*//')
+	stop
+	printf "  %-32s %-16s" "$label" "$answer"
+	if [ "$answer" = "$expect" ]; then
+		echo "ok"
+	else
+		echo "expected $expect"
+		FAILED=1
+	fi
+	grep "Check .* failing" "$WORK/log/hawkd.log" | sed 's/^.*INFO - /    /'
+}
+
+mkdir -p "$WORK/conf" "$WORK/log"
+./bench/mock_mysqld -p "$MYSQL_PORT" -l "$LATENCY" 2>>"$WORK/mock.log" &
+MOCK=$!
+sleep 0.2
+
+echo "== round time, queries ${LATENCY} ms late"
+if start; then
+	sleep "$SECS"
+	./bench/slowread -p "$HTTP_PORT" -P /metrics -n 1 -D 2>/dev/null > "$WORK/metrics" || FAILED=1
+	stop
+	probe=$(mean probe_total)
+	round=$(mean check_round)
+	echo "  wsrep probe mean_us=$probe"
+	echo "  check round mean_us=$round"
+	if [ "$probe" -eq 0 ] || [ "$round" -gt $((probe * 3 / 2)) ]; then
+		echo "  checks did not run alongside the probe"
+		FAILED=1
+	fi
+	if grep -qE "ERROR|failing" "$WORK/log/hawkd.log"; then
+		grep -E "ERROR|failing" "$WORK/log/hawkd.log" | sed 's/^/  /'
+		FAILED=1
+	fi
+fi
+
+echo
+echo "== one failing check at a time"
+verdict "all passing" "up ready 100%"
+verdict "sql: unexpected value" "down" xtrabackup
+verdict "disk: below min_free" "down" rsync 101
+verdict "load: above max (on_fail 50)" "up ready 50%" rsync 0 0
+
+exit $FAILED
@@ -0,0 +1,125 @@
+#!/bin/sh
+#
+#	HAwk donor handling - runs entirely on localhost
+#
+#	Points a scratch HAwk with [donor] on at bench/mock_mysqld, once
+#	per case, with the node state, cluster size, SST method and
+#	wsrep_desync set by a mock script. Compares the agent-check answer
+#	with the one the default [donor] settings call for, and shows what
+#	HAwk logged about it.
+#
+#	DONOR_CLIENT	mysql:client to probe with (default native)
+#	BENCH_PORT	first of the local ports to use (default 18200)
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+CLIENT=${DONOR_CLIENT:-native}
+BASE=${BENCH_PORT:-18200}
+HTTP_PORT=$BASE
+AGENT_PORT=$((BASE + 1))
+MYSQL_PORT=$((BASE + 2))
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hawk-donor.XXXXXX")
+MOCK=
+FAILED=0
+
+cleanup()
+{
+	[ -f "$WORK/hawk.pid" ] && kill "$(cat "$WORK/hawk.pid")" 2>/dev/null
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+alive()
+{
+	[ -e /proc/"$1" ] && ! grep -qs '^State:.*Z' /proc/"$1"/status
+}
+
+start()
+{
+	rm -f "$WORK/log/hawkd.log"
+	cat > "$WORK/conf/hawkd.ini" <<CONF
+[mysql]
+host =		127.0.0.1
+port =		$MYSQL_PORT
+user =		bench
+pass =		bench
+client =	$CLIENT
+
+[hawk]
+port =		$HTTP_PORT
+agent_port =	$AGENT_PORT
+daemon_user =	$(id -un)
+probe_interval = 200
+pid_path =	$WORK/hawk.pid
+
+[policy]
+fall =		1
+rise =		1
+health =	$1
+
+[donor]
+enabled =	$2
+CONF
+	HAWK_HOME=$WORK ./hawk || { FAILED=1; return 1; }
+}
+
+stop()
+{
+	pid=$(cat "$WORK/hawk.pid")
+	kill -TERM "$pid"
+	while alive "$pid"; do :; done
+	rm -f "$WORK/hawk.pid"
+	kill "$MOCK"
+	wait "$MOCK" 2>/dev/null
+	MOCK=
+}
+
+# case <label> <expected answer> <script> [health rule] [donor enabled]
+case_()
+{
+	label=$1
+	expect=$2
+	printf '%s\n' "$3" | tr ';' '\n' > "$WORK/script"
+	rule=${4:-state == 4}
+	enabled=${5:-1}
+	./bench/mock_mysqld -p "$MYSQL_PORT" -f "$WORK/script" 2>>"$WORK/mock.log" &
+	MOCK=$!
+	sleep 0.2
+	start "$rule" "$enabled" || return
+	sleep 1
+	answer=$(./bench/slowread -p "$AGENT_PORT" -a -n 1 -D 2>/dev/null | sed 's/ *#.*//')
+	stop
+	printf "  %-36s %-16s" "$label" "$answer"
+	if [ "$answer" = "$expect" ]; then
+		echo "ok"
+	else
+		echo "expected $expect"
+		FAILED=1
+	fi
+	grep -E "Keeping node|Taking node|donor" "$WORK/log/hawkd.log" | tail -n 1 | sed 's/^.*[A-Z] - /    /'
+}
+
+mkdir -p "$WORK/conf" "$WORK/log"
+
+DONOR="0 wsrep_local_state 2;0 wsrep_local_state_comment Donor/Desynced"
+
+echo "== donor of a three node cluster"
+case_ "rsync SST" "down" "$DONOR;0 wsrep_sst_method rsync"
+case_ "xtrabackup-v2 SST" "up ready 50%" "$DONOR;0 wsrep_sst_method xtrabackup-v2"
+case_ "mariabackup SST" "up ready 50%" "$DONOR;0 wsrep_sst_method mariabackup"
+case_ "desynced by hand" "down" "$DONOR;0 wsrep_sst_method mariabackup;0 wsrep_desync ON"
+case_ "mariabackup, donor handling off" "down" "$DONOR;0 wsrep_sst_method mariabackup" "" 0
+case_ "non-primary component" "down" "$DONOR;0 wsrep_sst_method mariabackup;0 wsrep_cluster_status non-Primary"
+
+echo
+echo "== last synced node"
+case_ "rsync donor of a two node cluster" "up ready 100%" "$DONOR;0 wsrep_sst_method rsync;0 wsrep_cluster_size 2"
+case_ "desynced, two node cluster" "down" "$DONOR;0 wsrep_desync ON;0 wsrep_cluster_size 2"
+case_ "desynced, one node cluster" "up ready 100%" "$DONOR;0 wsrep_desync ON;0 wsrep_cluster_size 1"
+case_ "one node failing health rule" "up ready 100%" "0 wsrep_cluster_size 1;0 wsrep_local_recv_queue 500" "recv_queue < 100"
+case_ "three nodes failing health rule" "down" "0 wsrep_local_recv_queue 500" "recv_queue < 100"
+
+exit $FAILED
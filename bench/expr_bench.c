@@ -0,0 +1,121 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*	Health expression evaluator benchmark
+	Reports nanoseconds per expr_eval() for a few representative rules.
+	First checks the arithmetic edges a typo in policy:health can reach,
+	which must give a defined answer instead of trapping; the exit status
+	is non-zero if any of them is wrong */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../src/expr.h"
+#include "../src/status.h"
+
+#define ITERATIONS	20000000
+
+static const char *rules[] =
+{
+	"state == 4",
+	"state == 4 || (state == 2 && !desync)",
+	"recv_queue < 100 && !desync && primary && ready",
+	"(state == 4 || state == 2) && cluster_size >= 3 && flow_paused * 10 < send_queue + 250"
+};
+
+static const struct
+{
+	const char *rule;
+	int64_t want;
+}
+edges[] =
+{
+	{"7 / 0", 0},
+	{"7 % 0", 0},
+	{"(0 - 9223372036854775807 - 1) / (0 - 1)", INT64_MIN},
+	{"(0 - 9223372036854775807 - 1) % (0 - 1)", 0},
+	{"-(0 - 9223372036854775807 - 1)", INT64_MIN},
+	{"9223372036854775807 + 1", INT64_MIN},
+	{"0 - 9223372036854775807 - 2", INT64_MAX},
+	{"9223372036854775807 * 2", -2},
+	{"-7 / 2", -3},
+	{"-7 % 2", -1}
+};
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	struct hawk_status st[4];
+	struct expr e;
+	char err[96];
+	long iterations = argc > 1 ? atol(argv[1]) : ITERATIONS;
+	volatile int64_t sink = 0;
+	double start = 0;
+
+	//Rotate through a few inputs so both sides of each branch run
+	for (int i = 0; i < 4; i++)
+	{
+		status_clear(&st[i]);
+		st[i].var[VAR_STATE] = 1 + i;
+		st[i].var[VAR_RECV_QUEUE] = 40 * i;
+		st[i].var[VAR_CLUSTER_SIZE] = 3;
+		st[i].var[VAR_PRIMARY] = 1;
+		st[i].var[VAR_READY] = i & 1;
+		st[i].var[VAR_DESYNC] = i == 1;
+	}
+
+	for (size_t r = 0; r < sizeof(edges) / sizeof(edges[0]); r++)
+	{
+		if (expr_compile(&e, edges[r].rule, status_var_names, STATUS_VARS, err, sizeof(err)) != 0)
+		{
+			fprintf(stderr, "%s: %s\n", edges[r].rule, err);
+			return 1;
+		}
+		if (expr_eval(&e, st[0].var) != edges[r].want)
+		{
+			fprintf(stderr, "%s: got %lld, want %lld\n", edges[r].rule,
+				(long long)expr_eval(&e, st[0].var), (long long)edges[r].want);
+			return 1;
+		}
+	}
+
+	printf("%-90s %6s %10s\n", "rule", "bytes", "ns/eval");
+	for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); r++)
+	{
+		if (expr_compile(&e, rules[r], status_var_names, STATUS_VARS, err, sizeof(err)) != 0)
+		{
+			fprintf(stderr, "%s: %s\n", rules[r], err);
+			return 1;
+		}
+		start = now_ns();
+		for (long i = 0; i < iterations; i++)
+		{
+			sink += expr_eval(&e, st[i & 3].var);
+		}
+		printf("%-90s %6d %10.2f\n", rules[r], e.len, (now_ns() - start) / iterations);
+	}
+	return 0;
+}
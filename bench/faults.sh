@@ -0,0 +1,151 @@
+#!/bin/sh
+#
+#	HAwk fault-injection harness - runs entirely on localhost
+#
+#	Points a scratch HAwk instance at mock_mysqld and, for each fault the
+#	mock can inject, drives the HTTP listener at a steady open-loop rate
+#	while the fault is active. Every run reports the answer HAwk should
+#	give, how many answers were right or wrong and the tail latency of
+#	the checks, so a probe that hangs the daemon or keeps a stale "synced"
+#	answer alive shows up as wrong answers or a blown p99. Exits non-zero
+#	if any answer was wrong.
+#
+#	A server that hangs or trickles rows fails each probe only when
+#	hawk:probe_timeout runs out, and the node stays up until policy:fall
+#	probes in a row have failed. Those two faults are checked in two
+#	steps: the last answer (200) while the probes time out, then 503 once
+#	the node is marked down. The scratch config sets probe_timeout to
+#	1000 ms so that takes about 3 seconds; with the shipped 5000 ms it is
+#	15, and past hawk:max_stale checks would get 504 instead.
+#
+#	FAULT_SECONDS	duration of each run (default 5)
+#	FAULT_RATE	checks per second (default 200)
+#	FAULT_SETTLE	seconds to wait after injecting a fault (default 2)
+#	BENCH_PORT	first of the local ports to use (default 17100)
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+SECS=${FAULT_SECONDS:-5}
+RATE=${FAULT_RATE:-200}
+SETTLE=${FAULT_SETTLE:-2}
+BASE=${BENCH_PORT:-17100}
+HTTP_PORT=$BASE
+MYSQL_PORT=$((BASE + 2))
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hawk-faults.XXXXXX")
+MOCK=
+FAILED=0
+
+cleanup()
+{
+	[ -f "$WORK/hawk.pid" ] && kill "$(cat "$WORK/hawk.pid")" 2>/dev/null
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+stop_mock()
+{
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null && wait "$MOCK" 2>/dev/null
+	MOCK=
+}
+
+start_mock()
+{
+	stop_mock
+	./bench/mock_mysqld -p "$MYSQL_PORT" "$@" 2>>"$WORK/mock.log" &
+	MOCK=$!
+	sleep 0.2
+}
+
+# check <expected answer> <seconds>
+check()
+{
+	errors=$(grep -c "ERROR" "$WORK/log/hawkd.log")
+	./bench/loadgen -p "$HTTP_PORT" -c 256 -t 3000 -r "$RATE" -d "$2" -e "$1" > "$WORK/loadgen.out"
+	cat "$WORK/loadgen.out"
+	grep -q "wrong=0$" "$WORK/loadgen.out" || FAILED=1
+	echo "  hawk errors logged=$(( $(grep -c "ERROR" "$WORK/log/hawkd.log") - errors ))"
+}
+
+# fault <name> <expected answer> [mock options]
+fault()
+{
+	name=$1
+	want=$2
+	shift 2
+	echo
+	echo "== $name (expect $want)"
+	if [ "$1" = "stopped" ]; then
+		stop_mock
+	else
+		start_mock "$@"
+	fi
+	sleep "$SETTLE"
+	check "$want" "$SECS"
+}
+
+# timeout_fault <name> [mock options]: probes that time out rather than
+# fail at once
+timeout_fault()
+{
+	name=$1
+	shift
+	echo
+	echo "== $name (expect 200 while probes time out)"
+	# Starts from a node that is up
+	start_mock
+	for i in $(seq 50); do
+		grep "Node marked" "$WORK/log/hawkd.log" | tail -1 | grep -qv "marked down" && break
+		sleep 0.2
+	done
+	downs=$(grep -c "Node marked down" "$WORK/log/hawkd.log")
+	start_mock "$@"
+	check 200 1
+	for i in $(seq 50); do
+		[ "$(grep -c "Node marked down" "$WORK/log/hawkd.log")" -gt "$downs" ] && break
+		sleep 0.2
+	done
+	echo "== $name (expect 503 once marked down)"
+	check 503 "$SECS"
+}
+
+mkdir -p "$WORK/conf" "$WORK/log"
+cat > "$WORK/conf/hawkd.ini" <<CONF
+[mysql]
+host =		127.0.0.1
+user =		bench
+pass =		bench
+
+[hawk]
+port =		$HTTP_PORT
+daemon_user =	$(id -un)
+probe_interval = 100
+probe_timeout =	1000
+pid_path =	$WORK/hawk.pid
+
+[policy]
+fall =		3
+rise =		2
+CONF
+
+start_mock
+
+# The client library falls back to MYSQL_TCP_PORT when no port is given
+MYSQL_TCP_PORT=$MYSQL_PORT HAWK_HOME=$WORK ./hawk || exit 1
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	grep -q "First probe completed" "$WORK/log/hawkd.log" 2>/dev/null && break
+	sleep 0.2
+done
+
+fault "baseline" 200
+timeout_fault "hung server" -F hang
+timeout_fault "slow rows" -F slowrows -D 2000
+fault "reset mid-resultset" 503 -F rst
+fault "authentication failure" 503 -F authfail
+fault "connection refused" 503 -F refuse
+fault "server stopped" 503 stopped
+fault "recovered" 200
+
+exit $FAILED
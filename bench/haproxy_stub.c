@@ -0,0 +1,279 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*	haproxy_stub - stand-in for an HAProxy stats socket
+
+	Accepts runtime API sessions on a unix socket and/or a TCP port and
+	records every command it receives, one per line on stdout:
+		<ms since start> <session> <command>
+	Understands "prompt" (interactive mode: each answer is followed by
+	"\n> " and the session stays open), "quit", and ';'-separated
+	commands. Everything else is accepted silently, like a successful
+	"set server", unless it contains the -E text, which gets an error
+	answer. -F n drops the first n sessions straight after accepting
+	them, to exercise the client's retries.
+
+	Usage: haproxy_stub [-S unix socket] [-p port] [-F sessions to drop]
+	                    [-E error text]				*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static long long start_ms = 0;
+static int drop_sessions = 0;
+static const char *error_text = NULL;
+static int sessions = 0;
+static pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void record(int session, const char *cmd)
+{
+	pthread_mutex_lock(&out_lock);
+	printf("%lld %d %s\n", now_ms() - start_ms, session, cmd);
+	fflush(stdout);
+	pthread_mutex_unlock(&out_lock);
+}
+
+//Runs one line of commands; returns -1 when the session should end
+static int run_line(int fd, int session, char *line, int *prompt)
+{
+	char answer[256];
+	char *cmd = NULL;
+	char *save = NULL;
+	size_t len = 0;
+
+	answer[0] = '\0';
+	for (cmd = strtok_r(line, ";", &save); cmd; cmd = strtok_r(NULL, ";", &save))
+	{
+		while (*cmd == ' ')
+		{
+			cmd++;
+		}
+		if (*cmd == '\0')
+		{
+			continue;
+		}
+		record(session, cmd);
+		if (strcmp(cmd, "quit") == 0)
+		{
+			return -1;
+		}
+		if (strcmp(cmd, "prompt") == 0)
+		{
+			*prompt = !*prompt;
+		}
+		else if (error_text && strstr(cmd, error_text) && len < sizeof(answer))
+		{
+			len += snprintf(answer + len, sizeof(answer) - len, "No such server.\n");
+		}
+	}
+	if (len < sizeof(answer))
+	{
+		len += snprintf(answer + len, sizeof(answer) - len, "%s", *prompt ? "\n> " : "\n");
+	}
+	if (write(fd, answer, strlen(answer)) < 0)
+	{
+		return -1;
+	}
+	//Without prompt mode HAProxy closes after one line
+	return *prompt ? 0 : -1;
+}
+
+static void* session_main(void *arg)
+{
+	int fd = (int)(intptr_t)arg;
+	char buf[4096];
+	char *eol = NULL;
+	size_t len = 0;
+	ssize_t got = 0;
+	int prompt = 0;
+	int session = 0;
+
+	pthread_mutex_lock(&out_lock);
+	session = ++sessions;
+	pthread_mutex_unlock(&out_lock);
+	if (session <= drop_sessions)
+	{
+		record(session, "(dropped)");
+		close(fd);
+		return NULL;
+	}
+
+	while ((got = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0)
+	{
+		len += got;
+		buf[len] = '\0';
+		while ((eol = strchr(buf, '\n')) != NULL)
+		{
+			*eol = '\0';
+			if (eol > buf && eol[-1] == '\r')
+			{
+				eol[-1] = '\0';
+			}
+			if (run_line(fd, session, buf, &prompt) != 0)
+			{
+				close(fd);
+				return NULL;
+			}
+			len -= eol + 1 - buf;
+			memmove(buf, eol + 1, len + 1);
+		}
+		if (len == sizeof(buf) - 1)
+		{
+			break;
+		}
+	}
+	close(fd);
+	return NULL;
+}
+
+static void* acceptor_main(void *arg)
+{
+	int listenfd = (int)(intptr_t)arg;
+
+	while (1)
+	{
+		pthread_t thread;
+		int fd = accept(listenfd, NULL, NULL);
+
+		if (fd < 0)
+		{
+			continue;
+		}
+		if (pthread_create(&thread, NULL, session_main, (void *)(intptr_t)fd) != 0)
+		{
+			close(fd);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+	return NULL;
+}
+
+static int listen_tcp(int port)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0)
+	{
+		perror("haproxy_stub: tcp");
+		exit(1);
+	}
+	return fd;
+}
+
+static int listen_unix(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0)
+	{
+		perror("haproxy_stub: unix");
+		exit(1);
+	}
+	return fd;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t thread;
+	char *socket_path = NULL;
+	int port = 0;
+	int opt = 0;
+
+	signal(SIGPIPE, SIG_IGN);
+	start_ms = now_ms();
+	while ((opt = getopt(argc, argv, "S:p:F:E:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'S':
+				socket_path = optarg;
+				break;
+			case 'p':
+				port = atoi(optarg);
+				break;
+			case 'F':
+				drop_sessions = atoi(optarg);
+				break;
+			case 'E':
+				error_text = optarg;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-S socket] [-p port] [-F sessions to drop] [-E error text]\n", argv[0]);
+				return 2;
+		}
+	}
+	if (socket_path == NULL && port <= 0)
+	{
+		fprintf(stderr, "haproxy_stub: nothing to listen on, give -S and/or -p\n");
+		return 2;
+	}
+
+	if (socket_path)
+	{
+		pthread_create(&thread, NULL, acceptor_main, (void *)(intptr_t)listen_unix(socket_path));
+	}
+	if (port > 0)
+	{
+		pthread_create(&thread, NULL, acceptor_main, (void *)(intptr_t)listen_tcp(port));
+	}
+	if (socket_path)
+	{
+		fprintf(stderr, "haproxy_stub: listening on %s\n", socket_path);
+	}
+	if (port > 0)
+	{
+		fprintf(stderr, "haproxy_stub: listening on 127.0.0.1:%d\n", port);
+	}
+	while (1)
+	{
+		pause();
+	}
+	return 0;
+}
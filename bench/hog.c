@@ -0,0 +1,135 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*	hog - CPU and memory pressure for the starvation benchmark
+
+	Forks -c workers that spin on arithmetic and -m workers that each
+	keep dirtying -M megabytes, dropping and refaulting them as they go,
+	for -d seconds, much like "stress-ng --cpu N --vm N --vm-bytes M".
+	The point is to compete with HAwk for the run queue and for page
+	frames, the way a busy mysqld on the same host does.
+
+	Usage: hog [-c cpu workers] [-m memory workers] [-M megabytes each]
+	           [-d seconds] */
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+static void cpu_worker(void)
+{
+	volatile double x = 1.0;
+
+	for (;;)
+	{
+		for (int i = 0; i < 1000000; i++)
+		{
+			x = x * 1.0000001 + 0.5;
+		}
+		if (x > 1e300)
+		{
+			x = 1.0;
+		}
+	}
+}
+
+static void vm_worker(size_t bytes)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	char *mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	unsigned char v = 0;
+
+	if (mem == MAP_FAILED)
+	{
+		perror("hog: mmap");
+		_exit(1);
+	}
+	for (;;)
+	{
+		v++;
+		for (size_t i = 0; i < bytes; i += page)
+		{
+			mem[i] = v;
+		}
+		//Hand half back so the kernel keeps having to find frames
+		madvise(mem, bytes / 2, MADV_DONTNEED);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int cpus = 1;
+	int vms = 1;
+	size_t megabytes = 256;
+	int seconds = 10;
+	int opt = 0;
+	int n = 0;
+	pid_t pids[512];
+
+	while ((opt = getopt(argc, argv, "c:m:M:d:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'c': cpus = atoi(optarg); break;
+			case 'm': vms = atoi(optarg); break;
+			case 'M': megabytes = strtoul(optarg, NULL, 10); break;
+			case 'd': seconds = atoi(optarg); break;
+			default:
+				fprintf(stderr, "Usage: %s [-c cpu workers] [-m memory workers] [-M megabytes each] [-d seconds]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (cpus < 0 || vms < 0 || cpus + vms > (int)(sizeof(pids) / sizeof(pids[0])))
+	{
+		fprintf(stderr, "hog: at most %zu workers\n", sizeof(pids) / sizeof(pids[0]));
+		return 1;
+	}
+
+	for (int i = 0; i < cpus + vms; i++)
+	{
+		pid_t pid = fork();
+
+		if (pid == 0)
+		{
+			if (i < cpus)
+				cpu_worker();
+			else
+				vm_worker(megabytes << 20);
+		}
+		if (pid > 0)
+		{
+			pids[n++] = pid;
+		}
+	}
+	printf("hog: %d cpu and %d memory workers (%zu MB each) for %ds\n", cpus, vms, megabytes, seconds);
+	fflush(stdout);
+	sleep(seconds);
+	for (int i = 0; i < n; i++)
+	{
+		kill(pids[i], SIGKILL);
+	}
+	while (wait(NULL) > 0)
+		;
+	return 0;
+}
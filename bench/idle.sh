@@ -0,0 +1,118 @@
+#!/bin/sh
+#
+#	HAwk idle check - runs entirely on localhost
+#
+#	Starts a scratch HAwk with a probe interval longer than the run and
+#	counts context switches per thread while nothing happens. Every
+#	thread is expected to stay asleep. Then measures how long a SIGHUP
+#	takes to be acted on and how long SIGTERM takes to end the process.
+#	Exits non-zero if any thread woke up while idle, or if either signal
+#	has not been acted on within 2 seconds.
+#
+#	IDLE_SECONDS	length of the idle window (default 5)
+#	BENCH_PORT	first of the local ports to use (default 17300)
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+SECS=${IDLE_SECONDS:-5}
+BASE=${BENCH_PORT:-17300}
+HTTP_PORT=$BASE
+MYSQL_PORT=$((BASE + 2))
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hawk-idle.XXXXXX")
+MOCK=
+
+cleanup()
+{
+	[ -f "$WORK/hawk.pid" ] && kill "$(cat "$WORK/hawk.pid")" 2>/dev/null
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+# Context switches of every thread: "<tid> <name> <count>"
+switches()
+{
+	for task in /proc/"$1"/task/*; do
+		printf '%s %s %s\n' "${task##*/}" "$(cat "$task/comm")" \
+			"$(awk '/ctxt_switches/ { n += $2 } END { print n }' "$task/status")"
+	done
+}
+
+# Running and not yet a zombie waiting to be reaped
+alive()
+{
+	[ -e /proc/"$1" ] && ! grep -qs '^State:.*Z' /proc/"$1"/status
+}
+
+now_ms()
+{
+	date +%s%3N
+}
+
+mkdir -p "$WORK/conf" "$WORK/log"
+cat > "$WORK/conf/hawkd.ini" <<CONF
+[mysql]
+host =		127.0.0.1
+user =		bench
+pass =		bench
+
+[hawk]
+port =		$HTTP_PORT
+daemon_user =	$(id -un)
+probe_interval = 600000
+pid_path =	$WORK/hawk.pid
+CONF
+
+./bench/mock_mysqld -p "$MYSQL_PORT" 2>>"$WORK/mock.log" &
+MOCK=$!
+sleep 0.2
+MYSQL_TCP_PORT=$MYSQL_PORT HAWK_HOME=$WORK ./hawk || exit 1
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	grep -q "First probe completed" "$WORK/log/hawkd.log" 2>/dev/null && break
+	sleep 0.2
+done
+PID=$(cat "$WORK/hawk.pid")
+
+# Answer one check so every code path has run once, then leave it alone
+./bench/loadgen -p "$HTTP_PORT" -c 1 -d 0.2 > /dev/null
+sleep 1
+
+switches "$PID" > "$WORK/before"
+sleep "$SECS"
+switches "$PID" > "$WORK/after"
+
+echo "== context switches per thread over ${SECS}s idle"
+join "$WORK/before" "$WORK/after" | awk '
+	{ d = $5 - $3; printf "  %-8s %-16s %d\n", $1, $2, d; total += d }
+	END { print "  total " total; exit total != 0 }'
+idle=$?
+
+echo "== signal latency"
+lines=$(grep -c "Reloading" "$WORK/log/hawkd.log")
+start=$(now_ms)
+kill -HUP "$PID"
+while [ "$(grep -c "Reloading" "$WORK/log/hawkd.log")" -eq "$lines" ]; do
+	[ $(( $(now_ms) - start )) -gt 2000 ] && break
+done
+if [ "$(grep -c "Reloading" "$WORK/log/hawkd.log")" -eq "$lines" ]; then
+	echo "  SIGHUP not acted on after 2 s"
+	idle=1
+else
+	echo "  SIGHUP acted on after $(( $(now_ms) - start )) ms"
+fi
+start=$(now_ms)
+kill -TERM "$PID"
+while alive "$PID"; do
+	[ $(( $(now_ms) - start )) -gt 2000 ] && break
+done
+if alive "$PID"; then
+	echo "  SIGTERM did not end HAwk within 2 s"
+	kill -KILL "$PID"
+	exit 1
+fi
+echo "  SIGTERM to exit in $(( $(now_ms) - start )) ms"
+rm -f "$WORK/hawk.pid"
+
+exit $idle
@@ -0,0 +1,109 @@
+#!/bin/sh
+#
+#	HAwk listener options comparison - runs entirely on localhost
+#
+#	Serves health checks from a scratch HAwk with each set of [listen]
+#	options in turn and drives it with bench/loadgen, once with a single
+#	checker, where latency is mostly connection setup, and once with
+#	many. Reports latency from connect() to the end of the answer,
+#	throughput and the system calls HAwk made per check, counted by the
+#	bench/syscount.so preload. Fast Open runs use loadgen -f; the server
+#	side needs bit 2 set in net.ipv4.tcp_fastopen, which is reported but
+#	not changed.
+#
+#	LISTEN_SECONDS	length of each run (default 3)
+#	LISTEN_CONNS	concurrent checkers in the busy runs (default 64)
+#	BENCH_PORT	first of the local ports to use (default 17700)
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+SECS=${LISTEN_SECONDS:-3}
+CONNS=${LISTEN_CONNS:-64}
+BASE=${BENCH_PORT:-17700}
+HTTP_PORT=$BASE
+MYSQL_PORT=$((BASE + 2))
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hawk-listen.XXXXXX")
+MOCK=
+FAILED=0
+
+cleanup()
+{
+	[ -f "$WORK/hawk.pid" ] && kill "$(cat "$WORK/hawk.pid")" 2>/dev/null
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+alive()
+{
+	[ -e /proc/"$1" ] && ! grep -qs '^State:.*Z' /proc/"$1"/status
+}
+
+# run <label> <nodelay> <defer_accept> <fastopen> [loadgen flags]
+run()
+{
+	label=$1
+	nodelay=$2
+	defer=$3
+	tfo=$4
+	shift 4
+	rm -f "$WORK"/count.* "$WORK/log/hawkd.log"
+	cat > "$WORK/conf/hawkd.ini" <<CONF
+[mysql]
+host =		127.0.0.1
+user =		bench
+pass =		bench
+
+[hawk]
+port =		$HTTP_PORT
+daemon_user =	$(id -un)
+probe_interval = 1000
+pid_path =	$WORK/hawk.pid
+
+[listen]
+nodelay =	$nodelay
+defer_accept =	$defer
+fastopen =	$tfo
+CONF
+	LD_PRELOAD=$PWD/bench/syscount.so SYSCOUNT_FILE=$WORK/count \
+		MYSQL_TCP_PORT=$MYSQL_PORT HAWK_HOME=$WORK ./hawk || { FAILED=1; return; }
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		grep -q "First probe completed" "$WORK/log/hawkd.log" 2>/dev/null && break
+		sleep 0.2
+	done
+	pid=$(cat "$WORK/hawk.pid")
+
+	echo
+	echo "== $label"
+	grep "listener on port" "$WORK/log/hawkd.log" | sed 's/^.*INFO - /  /'
+	# A first check fetches the Fast Open cookie
+	./bench/loadgen -p "$HTTP_PORT" -c 1 -d 0.1 "$@" > /dev/null
+	./bench/loadgen -p "$HTTP_PORT" -c 1 -d "$SECS" -e 200 "$@" > "$WORK/one" || FAILED=1
+	./bench/loadgen -p "$HTTP_PORT" -c "$CONNS" -d "$SECS" -e 200 "$@" > "$WORK/many" || FAILED=1
+	kill -TERM "$pid"
+	while alive "$pid"; do :; done
+	rm -f "$WORK/hawk.pid"
+
+	printf '  1 checker:   %s\n' "$(sed -n 's/^ *\(latency_us.*\)/\1/p' "$WORK/one")"
+	printf '  %d checkers: %s\n' "$CONNS" "$(sed -n 's/^ *answers=[0-9]* \(rate=[^ ]*\).*/\1/p' "$WORK/many") $(sed -n 's/^ *\(latency_us.*\)/\1/p' "$WORK/many")"
+	grep -h "wrong=[1-9]" "$WORK/one" "$WORK/many" && FAILED=1
+	answers=$(cat "$WORK/one" "$WORK/many" | sed -n 's/.*answers=\([0-9]*\).*/\1/p' | awk '{ n += $1 } END { print n }')
+	[ -f "$WORK/count.$pid" ] || { echo "  no counts from syscount.so"; FAILED=1; return; }
+	awk -v n="$answers" '{ total += $2 } END { printf "  syscalls:    %.2f per check\n", total / n }' "$WORK/count.$pid"
+}
+
+mkdir -p "$WORK/conf" "$WORK/log"
+./bench/mock_mysqld -p "$MYSQL_PORT" 2>>"$WORK/mock.log" &
+MOCK=$!
+sleep 0.2
+
+echo "net.ipv4.tcp_fastopen = $(cat /proc/sys/net/ipv4/tcp_fastopen)"
+run "no options" 0 0 0
+run "nodelay" 1 0 0
+run "nodelay, defer_accept" 1 5 0
+run "nodelay, fastopen" 1 0 256 -f
+run "nodelay, defer_accept, fastopen" 1 5 256 -f
+
+exit $FAILED
@@ -0,0 +1,435 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*	loadgen - closed-loop load generator for HAwk's listeners
+
+	Keeps -c connections busy for -d seconds. Each one connects, sends an
+	HTTP request (or, with -a, just waits for the agent-check line), reads
+	the answer until the server closes and starts over. Latency is
+	measured from connect() to the end of the answer.
+
+	With -r the load is open loop instead: checks are started on a fixed
+	schedule of that many per second, using at most -c connections, and
+	latency is measured from the scheduled start so a stalled server is
+	not hidden by checks that were never sent.
+
+	With -e every answer is compared with the expected HTTP status code or
+	agent-check word and counted as correct or wrong.
+
+	With -f connections use TCP Fast Open, sending the request with the
+	SYN once the server has handed out a cookie.
+
+	Usage: loadgen [-h host] [-p port] [-c connections] [-d seconds]
+	               [-t timeout ms] [-r checks per second] [-e expect] [-a]
+	               [-f] */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#define MAX_CONNS	4096
+
+enum slot_state
+{
+	SLOT_IDLE,
+	SLOT_CONNECTING,
+	SLOT_READING
+};
+
+struct slot
+{
+	int fd;
+	enum slot_state state;
+	long long started;
+	char buf[512];
+	size_t len;
+};
+
+struct results
+{
+	uint32_t *lat;			//microseconds
+	size_t n;
+	size_t cap;
+	unsigned long ok_200;
+	unsigned long ok_503;
+	unsigned long up;
+	unsigned long down;
+	unsigned long other;
+	unsigned long errors;
+	unsigned long timeouts;
+	unsigned long resets;
+	unsigned long correct;
+	unsigned long wrong;
+};
+
+static struct sockaddr_in target;
+static int agent = 0;
+static int fastopen = 0;
+static const char *expect = NULL;
+static int epfd = -1;
+static struct results res;
+static const char request[] = "GET / HTTP/1.1\r\nHost: hawk\r\nConnection: close\r\n\r\n";
+
+static long long now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void record(long long us)
+{
+	if (res.n == res.cap)
+	{
+		res.cap = res.cap ? res.cap * 2 : 65536;
+		res.lat = realloc(res.lat, res.cap * sizeof(*res.lat));
+	}
+	res.lat[res.n++] = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+static void classify(struct slot *s)
+{
+	const char *answer = s->buf;
+
+	s->buf[s->len < sizeof(s->buf) ? s->len : sizeof(s->buf) - 1] = 0;
+	if (expect)
+	{
+		if (strncmp(answer, "HTTP/1.", 7) == 0 && s->len >= 12)
+		{
+			answer += 9;
+		}
+		if (strncmp(answer, expect, strlen(expect)) == 0)
+			res.correct++;
+		else
+			res.wrong++;
+	}
+	if (strncmp(s->buf, "HTTP/1.", 7) == 0 && s->len >= 12)
+	{
+		if (strncmp(s->buf + 9, "200", 3) == 0)
+			res.ok_200++;
+		else if (strncmp(s->buf + 9, "503", 3) == 0)
+			res.ok_503++;
+		else
+			res.other++;
+	}
+	else if (strncmp(s->buf, "up", 2) == 0)
+		res.up++;
+	else if (strncmp(s->buf, "down", 4) == 0)
+		res.down++;
+	else
+		res.other++;
+}
+
+static void finish(struct slot *s)
+{
+	epoll_ctl(epfd, EPOLL_CTL_DEL, s->fd, NULL);
+	close(s->fd);
+	s->fd = -1;
+	s->state = SLOT_IDLE;
+}
+
+static void start(struct slot *s, long long at)
+{
+	struct epoll_event ev;
+
+	int rc = 0;
+
+	s->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	s->len = 0;
+	s->started = at;
+	if (fastopen)
+	{
+		setsockopt(s->fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &fastopen, sizeof(fastopen));
+	}
+	rc = connect(s->fd, (struct sockaddr *)&target, sizeof(target));
+	if (rc != 0 && errno != EINPROGRESS)
+	{
+		res.errors++;
+		close(s->fd);
+		s->fd = -1;
+		s->state = SLOT_IDLE;
+		return;
+	}
+	//With a Fast Open cookie connect() returns at once and the request
+	//goes out with the SYN
+	if (rc == 0 && fastopen && !agent)
+	{
+		if (send(s->fd, request, sizeof(request) - 1, MSG_NOSIGNAL) < 0 && errno != EINPROGRESS)
+		{
+			res.errors++;
+			close(s->fd);
+			s->fd = -1;
+			s->state = SLOT_IDLE;
+			return;
+		}
+		s->state = SLOT_READING;
+		ev.events = EPOLLIN;
+		ev.data.ptr = s;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev);
+		return;
+	}
+	s->state = SLOT_CONNECTING;
+	ev.events = EPOLLOUT | EPOLLIN;
+	ev.data.ptr = s;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev);
+}
+
+static void handle(struct slot *s, uint32_t events)
+{
+	struct epoll_event ev;
+	ssize_t n = 0;
+	int err = 0;
+	socklen_t len = sizeof(err);
+
+	if (s->state == SLOT_CONNECTING)
+	{
+		getsockopt(s->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+		if (err != 0)
+		{
+			res.errors++;
+			finish(s);
+			return;
+		}
+		if (!agent && send(s->fd, request, sizeof(request) - 1, MSG_NOSIGNAL) < 0)
+		{
+			res.errors++;
+			finish(s);
+			return;
+		}
+		s->state = SLOT_READING;
+		ev.events = EPOLLIN;
+		ev.data.ptr = s;
+		epoll_ctl(epfd, EPOLL_CTL_MOD, s->fd, &ev);
+		if (!(events & EPOLLIN))
+		{
+			return;
+		}
+	}
+
+	while (1)
+	{
+		char scratch[512];
+		char *dst = s->len < sizeof(s->buf) - 1 ? s->buf + s->len : scratch;
+		size_t room = s->len < sizeof(s->buf) - 1 ? sizeof(s->buf) - 1 - s->len : sizeof(scratch);
+
+		n = recv(s->fd, dst, room, 0);
+		if (n > 0)
+		{
+			if (dst != scratch)
+			{
+				s->len += n;
+			}
+			continue;
+		}
+		if (n < 0 && errno == EAGAIN)
+		{
+			return;
+		}
+		break;
+	}
+
+	//A reset after the full answer still counts as an answer
+	if (n < 0 && errno == ECONNRESET)
+	{
+		res.resets++;
+	}
+	if (s->len > 0)
+	{
+		record(now_us() - s->started);
+		classify(s);
+	}
+	else
+	{
+		res.errors++;
+	}
+	finish(s);
+}
+
+static int compare(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static uint32_t percentile(double p)
+{
+	size_t i = 0;
+
+	if (res.n == 0)
+	{
+		return 0;
+	}
+	i = (size_t)(p * (res.n - 1) + 0.5);
+	return res.lat[i];
+}
+
+int main(int argc, char **argv)
+{
+	static struct slot slots[MAX_CONNS];
+	struct epoll_event events[256];
+	const char *host = "127.0.0.1";
+	int port = 7000;
+	int conns = 16;
+	double seconds = 5;
+	long long timeout = 2000000;
+	double rate = 0;
+	long long interval = 0;
+	long long next = 0;
+	unsigned long late = 0;
+	long long start_us = 0;
+	long long end_us = 0;
+	long long now = 0;
+	int opt = 0;
+
+	while ((opt = getopt(argc, argv, "h:p:c:d:t:r:e:af")) != -1)
+	{
+		switch (opt)
+		{
+			case 'h':
+				host = optarg;
+				break;
+			case 'p':
+				port = atoi(optarg);
+				break;
+			case 'c':
+				conns = atoi(optarg);
+				break;
+			case 'd':
+				seconds = atof(optarg);
+				break;
+			case 't':
+				timeout = atoll(optarg) * 1000;
+				break;
+			case 'r':
+				rate = atof(optarg);
+				break;
+			case 'e':
+				expect = optarg;
+				break;
+			case 'a':
+				agent = 1;
+				break;
+			case 'f':
+				fastopen = 1;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-h host] [-p port] [-c connections] [-d seconds] [-t timeout ms] [-r rate] [-e expect] [-a] [-f]\n", argv[0]);
+				return 2;
+		}
+	}
+	if (conns < 1 || conns > MAX_CONNS)
+	{
+		fprintf(stderr, "loadgen: connections must be 1..%d\n", MAX_CONNS);
+		return 2;
+	}
+
+	memset(&target, 0, sizeof(target));
+	target.sin_family = AF_INET;
+	target.sin_port = htons(port);
+	inet_pton(AF_INET, host, &target.sin_addr);
+	epfd = epoll_create1(0);
+
+	start_us = now_us();
+	end_us = start_us + (long long)(seconds * 1e6);
+	interval = rate > 0 ? (long long)(1e6 / rate) : 0;
+	next = start_us;
+	for (int i = 0; i < conns; i++)
+	{
+		slots[i].fd = -1;
+		slots[i].state = SLOT_IDLE;
+	}
+
+	while ((now = now_us()) < end_us)
+	{
+		int n = epoll_wait(epfd, events, 256, interval ? 1 : 10);
+
+		for (int i = 0; i < n; i++)
+		{
+			handle(events[i].data.ptr, events[i].events);
+		}
+		now = now_us();
+		for (int i = 0; i < conns; i++)
+		{
+			if (slots[i].state != SLOT_IDLE && now - slots[i].started > timeout)
+			{
+				res.timeouts++;
+				finish(&slots[i]);
+			}
+			if (slots[i].state == SLOT_IDLE && now < end_us && !interval)
+			{
+				start(&slots[i], now);
+			}
+		}
+
+		//Open loop: start everything that is due, on the schedule's clock
+		for (int i = 0; interval && i < conns && next <= now && next < end_us; i++)
+		{
+			if (slots[i].state == SLOT_IDLE)
+			{
+				start(&slots[i], next);
+				next += interval;
+			}
+		}
+		if (interval && next + timeout < now)
+		{
+			//No free connection for a whole timeout: drop the backlog
+			late += (now - next) / interval;
+			next = now;
+		}
+	}
+	for (int i = 0; i < conns; i++)
+	{
+		if (slots[i].state != SLOT_IDLE)
+		{
+			finish(&slots[i]);
+		}
+	}
+
+	qsort(res.lat, res.n, sizeof(*res.lat), compare);
+	seconds = (now - start_us) / 1e6;
+	printf("loadgen: %s %s:%d connections=%d duration=%.1fs", agent ? "agent" : "http", host, port, conns, seconds);
+	if (rate > 0)
+		printf(" rate=%.0f/s", rate);
+	printf("\n");
+	printf("  answers=%zu rate=%.0f/s errors=%lu timeouts=%lu resets=%lu", res.n, res.n / seconds, res.errors, res.timeouts, res.resets);
+	if (interval)
+		printf(" late=%lu", late);
+	printf("\n");
+	if (expect)
+		printf("  expect=%s correct=%lu wrong=%lu\n", expect, res.correct, res.wrong);
+	if (agent)
+		printf("  up=%lu down=%lu other=%lu\n", res.up, res.down, res.other);
+	else
+		printf("  200=%lu 503=%lu other=%lu\n", res.ok_200, res.ok_503, res.other);
+	printf("  latency_us p50=%u p99=%u p999=%u max=%u\n", percentile(0.50), percentile(0.99), percentile(0.999), res.n ? res.lat[res.n - 1] : 0);
+	free(res.lat);
+	return res.n == 0;
+}
@@ -0,0 +1,1276 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*	mock_mysqld - just enough of a MySQL/Galera server to probe
+
+	Speaks the protocol subset HAwk uses: handshake v10, any credentials
+	accepted unless -u gives the only valid ones, COM_QUERY answered with
+	a text resultset for
+		SHOW [GLOBAL|SESSION] STATUS|VARIABLES [LIKE 'pattern']
+		SHOW REPLICA STATUS, SHOW SLAVE STATUS
+		SELECT @@name[, @@name ...]
+		SELECT 1
+		SELECT ... heartbeat ...	(any query naming it)
+	COM_PING, COM_INIT_DB and COM_QUIT are understood as well.
+
+	Usage: mock_mysqld [-p port] [-S unix socket] [-l query latency ms]
+	                   [-F fault] [-D row delay ms] [-f script] [-r]
+	                   [-u user:password] [-A native|sha2|switch]
+	                   [-R replica|slave]
+
+	With -u the scramble is checked for the auth plugin chosen by -A:
+		native		mysql_native_password
+		sha2		caching_sha2_password. The first login needs the
+				full exchange, which is only accepted over the
+				Unix socket; later ones hit the cache
+		switch		offer mysql_native_password, then switch the
+				client to caching_sha2_password
+
+	Faults (-F or @fault) model an overloaded or broken server:
+		none		behave
+		hang		accept, then never send the handshake
+		slowrows	wait the row delay before every resultset row
+		rst		reset the connection in the middle of a resultset
+		authfail	reject every login with error 1045
+		refuse		reset every connection as soon as it is accepted
+
+	Without -R, SHOW REPLICA STATUS is an empty set, as on a server that
+	is not a replica. -R replica answers it with a running replica, 0
+	seconds behind. -R slave acts as an older server: SHOW REPLICA STATUS
+	is a syntax error and SHOW SLAVE STATUS uses Slave_ and Master_
+	column names. Queries naming a heartbeat table fail with error 1146
+	until @heartbeat is set; then they return it as the lag in ms.
+
+	A script changes variables over time, one step per line:
+		<ms since start> <name> <value>
+	name is a status or system variable, a SHOW REPLICA STATUS column
+	(Seconds_Behind_Source, Replica_IO_Running, ...; NULL for NULL), or
+	@latency for the delay in ms before each query answer,
+	@connect_latency for the delay before the handshake, @fault,
+	@row_delay or @heartbeat. -r replays the script in a loop. */
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../src/sha.h"
+
+#define MAX_VARS	128
+#define MAX_STEPS	1024
+#define MAX_PACKET	65536
+
+#define COM_QUIT	0x01
+#define COM_INIT_DB	0x02
+#define COM_QUERY	0x03
+#define COM_PING	0x0e
+
+enum fault
+{
+	FAULT_NONE,
+	FAULT_HANG,
+	FAULT_SLOWROWS,
+	FAULT_RST,
+	FAULT_AUTHFAIL,
+	FAULT_REFUSE
+};
+
+static const char *const fault_names[] = { "none", "hang", "slowrows", "rst", "authfail", "refuse" };
+
+enum auth
+{
+	AUTH_NATIVE,
+	AUTH_SHA2,
+	AUTH_SWITCH
+};
+
+enum replica
+{
+	REPLICA_NONE,
+	REPLICA_NEW,			//SHOW REPLICA STATUS, Source/Replica names
+	REPLICA_OLD			//SHOW SLAVE STATUS only, Master/Slave names
+};
+
+#define CAPABILITIES	(0x00000001 | 0x00000004 | 0x00000008 | 0x00000200 | 0x00002000 | \
+			 0x00008000 | 0x00020000 | 0x00080000 | 0x00200000)
+
+/*	Variables				*/
+struct table
+{
+	int count;
+	char name[MAX_VARS][64];
+	char value[MAX_VARS][64];
+};
+
+struct step
+{
+	long at;
+	char name[64];
+	char value[64];
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct table status_table;
+static struct table variable_table;
+static struct table replica_table;
+static enum replica replica = REPLICA_NONE;
+static int heartbeat = -1;
+static int query_latency = 0;
+static int connect_latency = 0;
+static int row_delay = 1000;
+static enum fault fault = FAULT_NONE;
+static struct step steps[MAX_STEPS];
+static int nsteps = 0;
+static int repeat = 0;
+static uint32_t next_id = 1;
+static const char *auth_user = NULL;
+static const char *auth_pass = NULL;
+static enum auth auth = AUTH_NATIVE;
+static int sha2_cached = 0;
+
+static void table_set(struct table *t, const char *name, const char *value)
+{
+	int i = 0;
+
+	for (i = 0; i < t->count && strcasecmp(t->name[i], name) != 0; i++);
+	if (i == MAX_VARS)
+	{
+		return;
+	}
+	if (i == t->count)
+	{
+		t->count++;
+	}
+	snprintf(t->name[i], sizeof(t->name[i]), "%s", name);
+	snprintf(t->value[i], sizeof(t->value[i]), "%s", value);
+}
+
+static int table_find(struct table *t, const char *name)
+{
+	for (int i = 0; i < t->count; i++)
+	{
+		if (strcasecmp(t->name[i], name) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void defaults(void)
+{
+	table_set(&status_table, "wsrep_local_state", "4");
+	table_set(&status_table, "wsrep_local_state_comment", "Synced");
+	table_set(&status_table, "wsrep_cluster_size", "3");
+	table_set(&status_table, "wsrep_cluster_status", "Primary");
+	table_set(&status_table, "wsrep_ready", "ON");
+	table_set(&status_table, "wsrep_connected", "ON");
+	table_set(&status_table, "wsrep_local_recv_queue", "0");
+	table_set(&status_table, "wsrep_local_send_queue", "0");
+	table_set(&status_table, "wsrep_desync_count", "0");
+	table_set(&status_table, "wsrep_flow_control_paused", "0.000000");
+	table_set(&variable_table, "read_only", "OFF");
+	table_set(&variable_table, "super_read_only", "OFF");
+	table_set(&variable_table, "wsrep_desync", "OFF");
+	table_set(&variable_table, "wsrep_sst_method", "rsync");
+	table_set(&variable_table, "datadir", "/var/lib/mysql/");
+	table_set(&replica_table, "Replica_IO_State", "Waiting for source to send event");
+	table_set(&replica_table, "Source_Host", "10.0.0.1");
+	table_set(&replica_table, "Source_Port", "3306");
+	table_set(&replica_table, "Source_Log_File", "binlog.000042");
+	table_set(&replica_table, "Read_Source_Log_Pos", "4711");
+	table_set(&replica_table, "Relay_Log_File", "relay.000007");
+	table_set(&replica_table, "Replica_IO_Running", "Yes");
+	table_set(&replica_table, "Replica_SQL_Running", "Yes");
+	table_set(&replica_table, "Last_Errno", "0");
+	table_set(&replica_table, "Last_Error", "");
+	table_set(&replica_table, "Exec_Source_Log_Pos", "4711");
+	table_set(&replica_table, "Seconds_Behind_Source", "0");
+	table_set(&replica_table, "Last_IO_Errno", "0");
+	table_set(&replica_table, "Last_SQL_Errno", "0");
+	table_set(&replica_table, "Replica_SQL_Running_State", "Replica has read all relay log; waiting for more updates");
+}
+
+static int parse_fault(const char *name)
+{
+	for (size_t i = 0; i < sizeof(fault_names) / sizeof(fault_names[0]); i++)
+	{
+		if (strcmp(name, fault_names[i]) == 0)
+		{
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+static enum fault current_fault(void)
+{
+	enum fault f;
+
+	pthread_mutex_lock(&lock);
+	f = fault;
+	pthread_mutex_unlock(&lock);
+	return f;
+}
+
+//Reset instead of an orderly close
+static void reset(int fd)
+{
+	struct linger lg = { 1, 0 };
+
+	setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+}
+
+//Caller holds lock
+static void apply(const char *name, const char *value)
+{
+	if (strcmp(name, "@fault") == 0)
+	{
+		fault = parse_fault(value) < 0 ? FAULT_NONE : parse_fault(value);
+	}
+	else if (strcmp(name, "@row_delay") == 0)
+	{
+		row_delay = atoi(value);
+	}
+	else if (strcmp(name, "@latency") == 0)
+	{
+		query_latency = atoi(value);
+	}
+	else if (strcmp(name, "@connect_latency") == 0)
+	{
+		connect_latency = atoi(value);
+	}
+	else if (strcmp(name, "@heartbeat") == 0)
+	{
+		heartbeat = atoi(value);
+	}
+	else if (table_find(&replica_table, name) >= 0)
+	{
+		table_set(&replica_table, name, value);
+	}
+	else if (table_find(&variable_table, name) >= 0)
+	{
+		table_set(&variable_table, name, value);
+	}
+	else
+	{
+		table_set(&status_table, name, value);
+	}
+}
+
+/*	Script					*/
+static int load_script(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[256];
+
+	if (f == NULL)
+	{
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f) && nsteps < MAX_STEPS)
+	{
+		struct step *s = &steps[nsteps];
+
+		if (line[0] == '#' || sscanf(line, "%ld %63s %63s", &s->at, s->name, s->value) != 3)
+		{
+			continue;
+		}
+		nsteps++;
+	}
+	fclose(f);
+	return 0;
+}
+
+static long now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void* script_main(void *arg)
+{
+	long start = now_ms();
+	long span = nsteps ? steps[nsteps - 1].at + 1 : 0;
+
+	(void)arg;
+	do
+	{
+		for (int i = 0; i < nsteps; i++)
+		{
+			long wait = start + steps[i].at - now_ms();
+
+			if (wait > 0)
+			{
+				usleep(wait * 1000);
+			}
+			pthread_mutex_lock(&lock);
+			apply(steps[i].name, steps[i].value);
+			pthread_mutex_unlock(&lock);
+			fprintf(stderr, "mock_mysqld: +%ldms %s = %s\n", now_ms() - start, steps[i].name, steps[i].value);
+		}
+		start += span;
+	}
+	while (repeat);
+	return NULL;
+}
+
+/*	Packets					*/
+struct packet
+{
+	uint8_t buf[MAX_PACKET];
+	size_t len;
+	uint8_t seq;
+};
+
+static int write_all(int fd, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len > 0)
+	{
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int read_all(int fd, void *data, size_t len)
+{
+	uint8_t *p = data;
+
+	while (len > 0)
+	{
+		ssize_t n = recv(fd, p, len, 0);
+
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int read_packet(int fd, struct packet *pk)
+{
+	uint8_t hdr[4];
+
+	if (read_all(fd, hdr, 4) != 0)
+	{
+		return -1;
+	}
+	pk->len = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16);
+	pk->seq = hdr[3];
+	if (pk->len >= MAX_PACKET || read_all(fd, pk->buf, pk->len) != 0)
+	{
+		return -1;
+	}
+	pk->buf[pk->len] = 0;
+	return 0;
+}
+
+static void put(struct packet *pk, const void *data, size_t len)
+{
+	if (pk->len + len <= MAX_PACKET - 4)
+	{
+		memcpy(pk->buf + 4 + pk->len, data, len);
+		pk->len += len;
+	}
+}
+
+static void put_byte(struct packet *pk, uint8_t b)
+{
+	put(pk, &b, 1);
+}
+
+static void put_int(struct packet *pk, uint64_t v, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+	{
+		put_byte(pk, (v >> (8 * i)) & 0xff);
+	}
+}
+
+static void put_lenenc_str(struct packet *pk, const char *s)
+{
+	size_t n = strlen(s);
+
+	if (n < 251)
+	{
+		put_byte(pk, n);
+	}
+	else
+	{
+		put_byte(pk, 0xfc);
+		put_int(pk, n, 2);
+	}
+	put(pk, s, n);
+}
+
+static void begin(struct packet *pk)
+{
+	pk->len = 0;
+}
+
+static int send_packet(int fd, struct packet *pk)
+{
+	pk->buf[0] = pk->len & 0xff;
+	pk->buf[1] = (pk->len >> 8) & 0xff;
+	pk->buf[2] = (pk->len >> 16) & 0xff;
+	pk->buf[3] = pk->seq++;
+	return write_all(fd, pk->buf, pk->len + 4);
+}
+
+static int send_ok(int fd, struct packet *pk)
+{
+	begin(pk);
+	put_byte(pk, 0x00);
+	put_byte(pk, 0);
+	put_byte(pk, 0);
+	put_int(pk, 0x0002, 2);
+	put_int(pk, 0, 2);
+	return send_packet(fd, pk);
+}
+
+static int send_eof(int fd, struct packet *pk)
+{
+	begin(pk);
+	put_byte(pk, 0xfe);
+	put_int(pk, 0, 2);
+	put_int(pk, 0x0002, 2);
+	return send_packet(fd, pk);
+}
+
+static int send_err(int fd, struct packet *pk, int code, const char *state, const char *msg)
+{
+	begin(pk);
+	put_byte(pk, 0xff);
+	put_int(pk, code, 2);
+	put_byte(pk, '#');
+	put(pk, state, 5);
+	put(pk, msg, strlen(msg));
+	return send_packet(fd, pk);
+}
+
+static int send_column(int fd, struct packet *pk, const char *name)
+{
+	begin(pk);
+	put_lenenc_str(pk, "def");
+	put_lenenc_str(pk, "");
+	put_lenenc_str(pk, "");
+	put_lenenc_str(pk, "");
+	put_lenenc_str(pk, name);
+	put_lenenc_str(pk, name);
+	put_byte(pk, 0x0c);
+	put_int(pk, 33, 2);		//utf8_general_ci
+	put_int(pk, 1024, 4);
+	put_byte(pk, 0xfd);		//VAR_STRING
+	put_int(pk, 0, 2);
+	put_byte(pk, 0);
+	put_int(pk, 0, 2);
+	return send_packet(fd, pk);
+}
+
+/*	Handshake				*/
+static void new_nonce(uint8_t *nonce)
+{
+	for (int i = 0; i < 20; i++)
+	{
+		nonce[i] = 0x21 + rand() % 90;
+	}
+}
+
+//The scramble a client holding the right password sends for nonce
+static size_t expected(const char *plugin, const uint8_t *nonce, uint8_t *out)
+{
+	uint8_t stage1[SHA256_LEN];
+	uint8_t stage2[SHA256_LEN];
+	uint8_t mix[SHA256_LEN];
+	struct sha1 s1;
+	struct sha256 s2;
+
+	if (auth_pass[0] == '\0')
+	{
+		return 0;
+	}
+	if (strcmp(plugin, "mysql_native_password") == 0)
+	{
+		sha1_init(&s1);
+		sha1_update(&s1, auth_pass, strlen(auth_pass));
+		sha1_final(&s1, stage1);
+		sha1_init(&s1);
+		sha1_update(&s1, stage1, SHA1_LEN);
+		sha1_final(&s1, stage2);
+		sha1_init(&s1);
+		sha1_update(&s1, nonce, 20);
+		sha1_update(&s1, stage2, SHA1_LEN);
+		sha1_final(&s1, mix);
+		for (int i = 0; i < SHA1_LEN; i++)
+		{
+			out[i] = stage1[i] ^ mix[i];
+		}
+		return SHA1_LEN;
+	}
+	sha256_init(&s2);
+	sha256_update(&s2, auth_pass, strlen(auth_pass));
+	sha256_final(&s2, stage1);
+	sha256_init(&s2);
+	sha256_update(&s2, stage1, SHA256_LEN);
+	sha256_final(&s2, stage2);
+	sha256_init(&s2);
+	sha256_update(&s2, stage2, SHA256_LEN);
+	sha256_update(&s2, nonce, 20);
+	sha256_final(&s2, mix);
+	for (int i = 0; i < SHA256_LEN; i++)
+	{
+		out[i] = stage1[i] ^ mix[i];
+	}
+	return SHA256_LEN;
+}
+
+static int deny(int fd, struct packet *pk, const char *why)
+{
+	char msg[128];
+
+	snprintf(msg, sizeof(msg), "Access denied for user (mock_mysqld: %s)", why);
+	send_err(fd, pk, 1045, "28000", msg);
+	return -1;
+}
+
+//Checks the scramble in data, then finishes the login for plugin
+static int verify(int fd, struct packet *pk, const char *plugin, const uint8_t *nonce, const uint8_t *data, size_t len, int local)
+{
+	uint8_t want[SHA256_LEN];
+	size_t n = expected(plugin, nonce, want);
+	int cached = 0;
+
+	if (len != n || memcmp(data, want, n) != 0)
+	{
+		return deny(fd, pk, "wrong password");
+	}
+	if (strcmp(plugin, "caching_sha2_password") != 0 || n == 0)
+	{
+		return send_ok(fd, pk);
+	}
+	pthread_mutex_lock(&lock);
+	cached = sha2_cached;
+	pthread_mutex_unlock(&lock);
+	begin(pk);
+	put_byte(pk, 0x01);
+	put_byte(pk, cached ? 3 : 4);
+	if (send_packet(fd, pk) != 0)
+	{
+		return -1;
+	}
+	if (cached)
+	{
+		return send_ok(fd, pk);
+	}
+	//Full authentication: the password itself, which only a secure
+	//transport may carry
+	if (read_packet(fd, pk) != 0)
+	{
+		return -1;
+	}
+	pk->seq++;
+	if (!local)
+	{
+		return deny(fd, pk, "full caching_sha2_password login over TCP");
+	}
+	if (pk->len != strlen(auth_pass) + 1 || memcmp(pk->buf, auth_pass, pk->len) != 0)
+	{
+		return deny(fd, pk, "wrong password");
+	}
+	pthread_mutex_lock(&lock);
+	sha2_cached = 1;
+	pthread_mutex_unlock(&lock);
+	return send_ok(fd, pk);
+}
+
+static int handshake(int fd, struct packet *pk, uint32_t id, int local)
+{
+	const char *plugin = auth == AUTH_SHA2 ? "caching_sha2_password" : "mysql_native_password";
+	uint8_t scramble[20];
+	const uint8_t *data = NULL;
+	size_t at = 0;
+	size_t len = 0;
+
+	new_nonce(scramble);
+	pk->seq = 0;
+	begin(pk);
+	put_byte(pk, 10);
+	put(pk, "8.0.36-mock-galera", 19);
+	put_int(pk, id, 4);
+	put(pk, scramble, 8);
+	put_byte(pk, 0);
+	put_int(pk, CAPABILITIES & 0xffff, 2);
+	put_byte(pk, 33);
+	put_int(pk, 0x0002, 2);
+	put_int(pk, CAPABILITIES >> 16, 2);
+	put_byte(pk, 21);
+	for (int i = 0; i < 10; i++)
+	{
+		put_byte(pk, 0);
+	}
+	put(pk, scramble + 8, 12);
+	put_byte(pk, 0);
+	put(pk, plugin, strlen(plugin) + 1);
+	if (send_packet(fd, pk) != 0 || read_packet(fd, pk) != 0)
+	{
+		return -1;
+	}
+
+	//Any credentials will do, unless logins are failing
+	pk->seq++;
+	if (current_fault() == FAULT_AUTHFAIL)
+	{
+		send_err(fd, pk, 1045, "28000", "Access denied for user (mock_mysqld)");
+		return -1;
+	}
+	if (auth_user == NULL)
+	{
+		return send_ok(fd, pk);
+	}
+
+	//Handshake response 41: capabilities, max packet, charset, filler,
+	//user, scramble (length-prefixed), then maybe a schema
+	if (pk->len < 32)
+	{
+		return deny(fd, pk, "short handshake response");
+	}
+	at = 32;
+	if (strcmp((char *)pk->buf + at, auth_user) != 0)
+	{
+		return deny(fd, pk, "unknown user");
+	}
+	at += strlen((char *)pk->buf + at) + 1;
+	len = at < pk->len ? pk->buf[at++] : 0;
+	if (at + len > pk->len)
+	{
+		return deny(fd, pk, "malformed scramble");
+	}
+	data = pk->buf + at;
+	if (auth != AUTH_SWITCH)
+	{
+		return verify(fd, pk, plugin, scramble, data, len, local);
+	}
+
+	new_nonce(scramble);
+	plugin = "caching_sha2_password";
+	begin(pk);
+	put_byte(pk, 0xfe);
+	put(pk, plugin, strlen(plugin) + 1);
+	put(pk, scramble, 20);
+	put_byte(pk, 0);
+	if (send_packet(fd, pk) != 0 || read_packet(fd, pk) != 0)
+	{
+		return -1;
+	}
+	pk->seq++;
+	return verify(fd, pk, plugin, scramble, pk->buf, pk->len, local);
+}
+
+/*	Queries					*/
+static void skip_word(const char **q, const char *word)
+{
+	size_t n = strlen(word);
+
+	while (isspace((unsigned char)**q))
+	{
+		(*q)++;
+	}
+	if (strncasecmp(*q, word, n) == 0 && !isalnum((unsigned char)(*q)[n]))
+	{
+		*q += n;
+		while (isspace((unsigned char)**q))
+		{
+			(*q)++;
+		}
+	}
+}
+
+//SQL LIKE with % and _ mapped onto fnmatch
+static int like(const char *pattern, const char *name)
+{
+	char glob[128];
+	size_t j = 0;
+
+	for (size_t i = 0; pattern[i] && j < sizeof(glob) - 2; i++)
+	{
+		if (pattern[i] == '%')
+			glob[j++] = '*';
+		else if (pattern[i] == '_')
+			glob[j++] = '?';
+		else if (pattern[i] == '\\' && pattern[i + 1])
+		{
+			glob[j++] = '\\';
+			glob[j++] = pattern[++i];
+		}
+		else
+			glob[j++] = pattern[i];
+	}
+	glob[j] = 0;
+	return fnmatch(glob, name, FNM_CASEFOLD) == 0;
+}
+
+static int send_table(int fd, struct packet *pk, struct table *t, const char *pattern)
+{
+	struct table copy;
+	enum fault f;
+	int delay = 0;
+
+	pthread_mutex_lock(&lock);
+	copy = *t;
+	f = fault;
+	delay = row_delay;
+	pthread_mutex_unlock(&lock);
+
+	begin(pk);
+	put_byte(pk, 2);
+	if (send_packet(fd, pk) || send_column(fd, pk, "Variable_name") || send_column(fd, pk, "Value") || send_eof(fd, pk))
+	{
+		return -1;
+	}
+	if (f == FAULT_RST)
+	{
+		reset(fd);
+		return -1;
+	}
+	for (int i = 0; i < copy.count; i++)
+	{
+		if (pattern && !like(pattern, copy.name[i]))
+		{
+			continue;
+		}
+		if (f == FAULT_SLOWROWS && delay > 0)
+		{
+			usleep(delay * 1000);
+		}
+		begin(pk);
+		put_lenenc_str(pk, copy.name[i]);
+		put_lenenc_str(pk, copy.value[i]);
+		if (send_packet(fd, pk))
+		{
+			return -1;
+		}
+	}
+	return send_eof(fd, pk);
+}
+
+//One row of n columns
+static int send_values(int fd, struct packet *pk, int n, char (*columns)[96], char (*values)[64])
+{
+	begin(pk);
+	put_byte(pk, n);
+	if (send_packet(fd, pk))
+	{
+		return -1;
+	}
+	for (int i = 0; i < n; i++)
+	{
+		if (send_column(fd, pk, columns[i]))
+		{
+			return -1;
+		}
+	}
+	if (send_eof(fd, pk))
+	{
+		return -1;
+	}
+	begin(pk);
+	for (int i = 0; i < n; i++)
+	{
+		put_lenenc_str(pk, values[i]);
+	}
+	if (send_packet(fd, pk))
+	{
+		return -1;
+	}
+	return send_eof(fd, pk);
+}
+
+static int send_value(int fd, struct packet *pk, const char *column, const char *value)
+{
+	char c[1][96];
+	char v[1][64];
+
+	snprintf(c[0], sizeof(c[0]), "%s", column);
+	snprintf(v[0], sizeof(v[0]), "%s", value);
+	return send_values(fd, pk, 1, c, v);
+}
+
+//Column name as servers before the rename spell it
+static void old_name(const char *name, char *out, size_t len)
+{
+	size_t n = 0;
+
+	while (*name && n + 7 < len)
+	{
+		if (strncmp(name, "Replica", 7) == 0)
+		{
+			n += snprintf(out + n, len - n, "Slave");
+			name += 7;
+		}
+		else if (strncmp(name, "Source", 6) == 0)
+		{
+			n += snprintf(out + n, len - n, "Master");
+			name += 6;
+		}
+		else
+		{
+			out[n++] = *name++;
+		}
+	}
+	out[n] = '\0';
+}
+
+//One row when acting as a replica, none otherwise
+static int send_replica(int fd, struct packet *pk, int old)
+{
+	struct table copy;
+	char name[80];
+	int running = 0;
+
+	pthread_mutex_lock(&lock);
+	copy = replica_table;
+	running = replica != REPLICA_NONE;
+	pthread_mutex_unlock(&lock);
+
+	begin(pk);
+	put_byte(pk, copy.count);
+	if (send_packet(fd, pk))
+	{
+		return -1;
+	}
+	for (int i = 0; i < copy.count; i++)
+	{
+		old_name(copy.name[i], name, sizeof(name));
+		if (send_column(fd, pk, old ? name : copy.name[i]))
+		{
+			return -1;
+		}
+	}
+	if (send_eof(fd, pk))
+	{
+		return -1;
+	}
+	if (running)
+	{
+		begin(pk);
+		for (int i = 0; i < copy.count; i++)
+		{
+			if (strcmp(copy.value[i], "NULL") == 0)
+				put_byte(pk, 0xfb);
+			else
+				put_lenenc_str(pk, copy.value[i]);
+		}
+		if (send_packet(fd, pk))
+		{
+			return -1;
+		}
+	}
+	return send_eof(fd, pk);
+}
+
+static int answer_query(int fd, struct packet *pk, const char *q)
+{
+	char pattern[128];
+	const char *p = q;
+	const char *quote = NULL;
+	int i = 0;
+
+	skip_word(&p, "SHOW");
+	if (p != q)
+	{
+		struct table *t = NULL;
+
+		skip_word(&p, "GLOBAL");
+		skip_word(&p, "SESSION");
+		if (strncasecmp(p, "REPLICA STATUS", 14) == 0)
+		{
+			if (replica == REPLICA_OLD)
+			{
+				return send_err(fd, pk, 1064, "42000", "mock_mysqld: You have an error in your SQL syntax near 'REPLICA STATUS'");
+			}
+			return send_replica(fd, pk, 0);
+		}
+		if (strncasecmp(p, "SLAVE STATUS", 12) == 0)
+		{
+			return send_replica(fd, pk, 1);
+		}
+		if (strncasecmp(p, "STATUS", 6) == 0)
+			t = &status_table;
+		else if (strncasecmp(p, "VARIABLES", 9) == 0)
+			t = &variable_table;
+		if (t == NULL)
+		{
+			return send_err(fd, pk, 1064, "42000", "mock_mysqld: unsupported SHOW");
+		}
+		quote = strchr(p, '\'');
+		if (quote && sscanf(quote + 1, "%127[^']", pattern) == 1)
+		{
+			return send_table(fd, pk, t, pattern);
+		}
+		return send_table(fd, pk, t, NULL);
+	}
+
+	skip_word(&p, "SELECT");
+	if (p != q && strcasestr(p, "heartbeat"))
+	{
+		char value[32];
+		int lag = 0;
+
+		pthread_mutex_lock(&lock);
+		lag = heartbeat;
+		pthread_mutex_unlock(&lock);
+		if (lag < 0)
+		{
+			return send_err(fd, pk, 1146, "42S02", "mock_mysqld: Table 'heartbeat' doesn't exist");
+		}
+		snprintf(value, sizeof(value), "%d", lag);
+		return send_value(fd, pk, "lag_ms", value);
+	}
+	if (p != q)
+	{
+		char columns[8][96];
+		char values[8][64];
+		const char *name = NULL;
+		int n = 0;
+
+		if (strncmp(p, "@@", 2) != 0)
+		{
+			sscanf(p, "%63s", values[0]);
+			return send_value(fd, pk, values[0], values[0]);
+		}
+		//SELECT @@a, @@global.b is one row with a column for each
+		while (n < 8 && strncmp(p, "@@", 2) == 0)
+		{
+			columns[n][0] = '\0';
+			sscanf(p, "%95[^, \t;]", columns[n]);
+			name = columns[n] + 2;
+			if (strncasecmp(name, "global.", 7) == 0)
+			{
+				name += 7;
+			}
+			pthread_mutex_lock(&lock);
+			i = table_find(&variable_table, name);
+			if (i >= 0)
+			{
+				snprintf(values[n], sizeof(values[n]), "%s", variable_table.value[i]);
+			}
+			pthread_mutex_unlock(&lock);
+			if (i < 0)
+			{
+				return send_err(fd, pk, 1193, "HY000", "mock_mysqld: unknown system variable");
+			}
+			n++;
+			p += strcspn(p, ",");
+			if (*p != ',')
+			{
+				break;
+			}
+			p++;
+			while (isspace((unsigned char)*p))
+			{
+				p++;
+			}
+		}
+		return send_values(fd, pk, n, columns, values);
+	}
+	return send_err(fd, pk, 1064, "42000", "mock_mysqld: unsupported query");
+}
+
+/*	Connections				*/
+static void* client_main(void *arg)
+{
+	int fd = (int)(intptr_t)arg;
+	struct packet *pk = malloc(sizeof(*pk));
+	struct sockaddr_storage local;
+	socklen_t locallen = sizeof(local);
+	int delay = 0;
+	uint32_t id = 0;
+
+	if (pk == NULL)
+	{
+		close(fd);
+		return NULL;
+	}
+	pthread_mutex_lock(&lock);
+	delay = connect_latency;
+	id = next_id++;
+	pthread_mutex_unlock(&lock);
+	if (delay > 0)
+	{
+		usleep(delay * 1000);
+	}
+
+	switch (current_fault())
+	{
+		case FAULT_REFUSE:
+			reset(fd);
+			goto done;
+		case FAULT_HANG:
+			//Hold the connection open without a word until the client gives up
+			while (recv(fd, pk->buf, sizeof(pk->buf), 0) > 0);
+			goto done;
+		default:
+			break;
+	}
+
+	getsockname(fd, (struct sockaddr *)&local, &locallen);
+	if (handshake(fd, pk, id, local.ss_family == AF_UNIX) != 0)
+	{
+		goto done;
+	}
+	while (read_packet(fd, pk) == 0)
+	{
+		int command = pk->len ? pk->buf[0] : -1;
+
+		pk->seq++;
+		if (command == COM_QUIT)
+		{
+			break;
+		}
+		if (command == COM_PING || command == COM_INIT_DB)
+		{
+			if (send_ok(fd, pk))
+				break;
+			continue;
+		}
+		if (command != COM_QUERY)
+		{
+			if (send_err(fd, pk, 1047, "08S01", "mock_mysqld: unknown command"))
+				break;
+			continue;
+		}
+
+		pthread_mutex_lock(&lock);
+		delay = query_latency;
+		pthread_mutex_unlock(&lock);
+		if (delay > 0)
+		{
+			usleep(delay * 1000);
+		}
+		if (answer_query(fd, pk, (char *)pk->buf + 1) != 0)
+		{
+			break;
+		}
+	}
+done:
+	free(pk);
+	close(fd);
+	return NULL;
+}
+
+static int listen_tcp(int port)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 1024) != 0)
+	{
+		perror("mock_mysqld: tcp");
+		exit(1);
+	}
+	return fd;
+}
+
+static int listen_unix(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 1024) != 0)
+	{
+		perror("mock_mysqld: unix");
+		exit(1);
+	}
+	return fd;
+}
+
+static void* acceptor_main(void *arg)
+{
+	int listenfd = (int)(intptr_t)arg;
+	int one = 1;
+
+	while (1)
+	{
+		pthread_t thread;
+		int fd = accept(listenfd, NULL, NULL);
+
+		if (fd < 0)
+		{
+			continue;
+		}
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if (pthread_create(&thread, NULL, client_main, (void *)(intptr_t)fd) != 0)
+		{
+			close(fd);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t thread;
+	char *socket_path = NULL;
+	char *script = NULL;
+	int port = 13306;
+	int opt = 0;
+
+	signal(SIGPIPE, SIG_IGN);
+	srand(getpid());
+	defaults();
+	while ((opt = getopt(argc, argv, "p:S:l:F:D:f:ru:A:R:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'p':
+				port = atoi(optarg);
+				break;
+			case 'S':
+				socket_path = optarg;
+				break;
+			case 'l':
+				query_latency = atoi(optarg);
+				break;
+			case 'F':
+				if (parse_fault(optarg) < 0)
+				{
+					fprintf(stderr, "mock_mysqld: unknown fault %s\n", optarg);
+					return 2;
+				}
+				fault = parse_fault(optarg);
+				break;
+			case 'D':
+				row_delay = atoi(optarg);
+				break;
+			case 'f':
+				script = optarg;
+				break;
+			case 'r':
+				repeat = 1;
+				break;
+			case 'u':
+				auth_user = optarg;
+				auth_pass = strchr(optarg, ':');
+				if (auth_pass == NULL)
+				{
+					fprintf(stderr, "mock_mysqld: -u takes user:password\n");
+					return 2;
+				}
+				*(char *)auth_pass++ = '\0';
+				break;
+			case 'A':
+				if (strcmp(optarg, "native") == 0)
+					auth = AUTH_NATIVE;
+				else if (strcmp(optarg, "sha2") == 0)
+					auth = AUTH_SHA2;
+				else if (strcmp(optarg, "switch") == 0)
+					auth = AUTH_SWITCH;
+				else
+				{
+					fprintf(stderr, "mock_mysqld: unknown auth %s\n", optarg);
+					return 2;
+				}
+				break;
+			case 'R':
+				if (strcmp(optarg, "replica") == 0)
+					replica = REPLICA_NEW;
+				else if (strcmp(optarg, "slave") == 0)
+					replica = REPLICA_OLD;
+				else
+				{
+					fprintf(stderr, "mock_mysqld: -R takes replica or slave\n");
+					return 2;
+				}
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-p port] [-S socket] [-l latency ms] [-F fault] [-D row delay ms] [-f script] [-r] [-u user:password] [-A native|sha2|switch] [-R replica|slave]\n", argv[0]);
+				return 2;
+		}
+	}
+	if (script && load_script(script) != 0)
+	{
+		perror(script);
+		return 1;
+	}
+
+	if (socket_path)
+	{
+		pthread_create(&thread, NULL, acceptor_main, (void *)(intptr_t)listen_unix(socket_path));
+	}
+	if (port > 0)
+	{
+		pthread_create(&thread, NULL, acceptor_main, (void *)(intptr_t)listen_tcp(port));
+	}
+	fprintf(stderr, "mock_mysqld: listening on 127.0.0.1:%d%s%s, fault %s\n", port, socket_path ? " and " : "", socket_path ? socket_path : "", fault_names[fault]);
+	if (nsteps)
+	{
+		script_main(NULL);
+	}
+	while (1)
+	{
+		pause();
+	}
+	return 0;
+}
@@ -0,0 +1,232 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*	State policy simulation
+	Drives policy_step through hysteresis, flapping, suppression and
+	reuse on a simulated clock, so every run is the same. Each scenario
+	checks the transitions against the ones the settings call for and
+	reports ok or what went wrong; the exit status is non-zero if any
+	scenario failed.	*/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "../src/policy.h"
+
+#define INTERVAL	1000		//ms between simulated probes
+
+static int failed = 0;
+
+//The settings of the sample hawkd.ini
+static struct policy_conf defaults(void)
+{
+	struct policy_conf c;
+
+	memset(&c, 0, sizeof(c));
+	c.rise = 2;
+	c.fall = 3;
+	c.half_life = 30000;
+	c.suppress = 3000;
+	c.reuse = 750;
+	c.max_penalty = 12000;
+	c.penalty[0] = 1000;
+	c.penalty[1] = 1000;
+	c.penalty[2] = 500;
+	c.penalty[3] = 1000;
+	c.penalty[4] = 0;
+	return c;
+}
+
+static void check(const char *scenario, int ok, const char *what, long long now)
+{
+	if (!ok)
+	{
+		printf("  %-28s FAILED at %lld ms: %s\n", scenario, now, what);
+		failed++;
+	}
+}
+
+static void pass(const char *scenario, int before)
+{
+	if (failed == before)
+	{
+		printf("  %-28s ok\n", scenario);
+	}
+}
+
+//fall unhealthy probes take it down, rise healthy ones bring it back;
+//fewer do nothing
+static void hysteresis(void)
+{
+	const char *name = "hysteresis";
+	struct policy_conf c = defaults();
+	struct policy p;
+	long long now = 0;
+	int before = failed;
+	int ev = 0;
+
+	c.half_life = 0;
+	policy_init(&p, &c, 0, 0);
+	ev = policy_step(&p, 1, 4, now);
+	check(name, ev == POLICY_EV_UP && p.up, "first probe did not decide the output", now);
+
+	//One short of fall, then recovery: no transition at all
+	for (int i = 0; i < c.fall - 1; i++)
+	{
+		now += INTERVAL;
+		ev = policy_step(&p, 0, 0, now);
+		check(name, ev == 0 && p.up, "went down before fall probes", now);
+	}
+	now += INTERVAL;
+	ev = policy_step(&p, 1, 4, now);
+	check(name, ev == 0 && p.up, "a healthy probe changed the output", now);
+
+	for (int i = 1; i <= c.fall; i++)
+	{
+		now += INTERVAL;
+		ev = policy_step(&p, 0, 0, now);
+		check(name, (i < c.fall) == (p.up != 0), "not down after exactly fall probes", now);
+		check(name, i < c.fall || ev == POLICY_EV_DOWN, "no down event", now);
+	}
+	for (int i = 1; i <= c.rise; i++)
+	{
+		now += INTERVAL;
+		ev = policy_step(&p, 1, 4, now);
+		check(name, (i < c.rise) == (p.up == 0), "not up after exactly rise probes", now);
+		check(name, i < c.rise || ev == POLICY_EV_UP, "no up event", now);
+	}
+	pass(name, before);
+}
+
+//Joined/Synced flapping until suppressed, then steady Synced until the
+//penalty has decayed below reuse. Returns the ms spent suppressed, -1
+//if it never was, or was never released within an hour
+static long long flap_then_settle(const char *name, struct policy_conf *c, int *peak_ok)
+{
+	struct policy p;
+	long long now = 0;
+	long long suppressed_at = -1;
+	double penalty = 0;
+	int ev = 0;
+
+	policy_init(&p, c, 1, 1);
+	*peak_ok = 1;
+	for (int i = 0; suppressed_at < 0 && i < 100; i++)
+	{
+		now += INTERVAL;
+		ev = policy_step(&p, i % 2, i % 2 ? 4 : 3, now);
+		if (c->max_penalty > 0 && p.penalty > c->max_penalty)
+		{
+			*peak_ok = 0;
+		}
+		if (ev & POLICY_EV_SUPPRESS)
+		{
+			suppressed_at = now;
+			check(name, p.penalty >= c->suppress, "suppressed below the threshold", now);
+			check(name, !p.up, "up while suppressed", now);
+		}
+	}
+	if (suppressed_at < 0)
+	{
+		return -1;
+	}
+	penalty = p.penalty;
+
+	//Healthy and steady from here; held down until reuse
+	while (now - suppressed_at < 3600 * 1000)
+	{
+		now += INTERVAL;
+		ev = policy_step(&p, 1, 4, now);
+		if (ev & POLICY_EV_REUSE)
+		{
+			//Released at the first probe after the decay crosses reuse
+			long long due = suppressed_at + (long long)ceil(c->half_life * log2(penalty / p.conf.reuse));
+
+			check(name, now >= due && now < due + INTERVAL, "released away from the decay curve", now);
+			//Healthy all along, so rise is long met and it comes
+			//straight back
+			check(name, ev == (POLICY_EV_REUSE | POLICY_EV_UP) && p.up, "not up on release", now);
+			return now - suppressed_at;
+		}
+		check(name, !p.up, "up while suppressed", now);
+	}
+	return -1;
+}
+
+static void suppress_reuse(void)
+{
+	const char *name = "flap suppress/reuse";
+	struct policy_conf c = defaults();
+	int before = failed;
+	int peak_ok = 0;
+	long long held = flap_then_settle(name, &c, &peak_ok);
+
+	check(name, held > 0, "never suppressed or never released", 0);
+	check(name, peak_ok, "penalty above max_penalty", 0);
+	pass(name, before);
+	if (held > 0)
+	{
+		printf("    held down %.1f s\n", held / 1000.0);
+	}
+}
+
+//Donor/Synced flapping costs less per cycle than Joined/Synced
+static void cap(void)
+{
+	const char *name = "max_penalty cap";
+	struct policy_conf c = defaults();
+	struct policy p;
+	long long now = 0;
+	int before = failed;
+
+	c.max_penalty = 2000;
+	c.suppress = 0;
+	policy_init(&p, &c, 1, 1);
+	for (int i = 0; i < 50; i++)
+	{
+		now += INTERVAL;
+		policy_step(&p, 1, i % 2 ? 4 : 3, now);
+		check(name, p.penalty <= c.max_penalty, "penalty above max_penalty", now);
+		check(name, p.up, "suppressed with suppress = 0", now);
+	}
+	pass(name, before);
+}
+
+//suppress set, reuse left at 0: must still be released
+static void reuse_unset(void)
+{
+	const char *name = "reuse left at 0";
+	struct policy_conf c = defaults();
+	int before = failed;
+	int peak_ok = 0;
+
+	c.reuse = 0;
+	check(name, flap_then_settle(name, &c, &peak_ok) > 0, "held down for good", 0);
+	pass(name, before);
+}
+
+int main(void)
+{
+	printf("== state policy, simulated clock, one probe every %d ms\n", INTERVAL);
+	hysteresis();
+	suppress_reuse();
+	cap();
+	reuse_unset();
+	return failed > 0;
+}
@@ -0,0 +1,80 @@
+#!/bin/sh
+#
+#	HAwk MySQL client comparison - runs entirely on localhost
+#
+#	Starts bench/mock_mysqld with a password required, once per login
+#	plugin, and has bench/probe_bench probe it over TCP and its Unix
+#	socket with libmysqlclient and with HAwk's built-in client. Reports
+#	latency and heap allocations per probe. A wrong password has to be
+#	refused. Exits non-zero if any probe fails, a wrong password gets
+#	in, or the built-in client allocates.
+#
+#	PROBE_COUNT	probes per client and transport (default 2000)
+#	BENCH_PORT	first of the local ports to use (default 17800)
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+COUNT=${PROBE_COUNT:-2000}
+BASE=${BENCH_PORT:-17800}
+MYSQL_PORT=$((BASE + 2))
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hawk-probe.XXXXXX")
+SOCK=$WORK/mysqld.sock
+MOCK=
+FAILED=0
+
+cleanup()
+{
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+mock()
+{
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null && wait "$MOCK" 2>/dev/null
+	./bench/mock_mysqld -p "$MYSQL_PORT" -S "$SOCK" -u bench:s3cret -A "$1" 2>>"$WORK/mock.log" &
+	MOCK=$!
+	sleep 0.2
+}
+
+probe()
+{
+	./bench/probe_bench -p "$MYSQL_PORT" -u bench -P s3cret -n "$COUNT" "$@" || FAILED=1
+}
+
+refused()
+{
+	./bench/probe_bench -p "$MYSQL_PORT" -u bench -P wrong -n 10 -x "$@" > "$WORK/refused" || {
+		echo "  wrong password accepted:"
+		cat "$WORK/refused"
+		FAILED=1
+	}
+}
+
+echo "== mysql_native_password"
+mock native
+probe
+probe -S "$SOCK"
+refused -c native
+refused -S "$SOCK" -c native
+
+# A caching_sha2_password login without a cached entry sends the password
+# itself, which the built-in client only does over the socket. Once it
+# has, TCP logins take the fast path
+echo
+echo "== caching_sha2_password"
+mock sha2
+probe -S "$SOCK"
+probe
+refused -S "$SOCK" -c native
+
+echo
+echo "== mysql_native_password switched to caching_sha2_password"
+mock switch
+probe -S "$SOCK" -c native
+probe -c native
+refused -S "$SOCK" -c native
+
+exit $FAILED
@@ -0,0 +1,317 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*	probe_bench - the built-in MySQL client against libmysqlclient
+
+	Runs -n probes through each client: connect, log in, SHOW GLOBAL
+	STATUS LIKE 'wsrep_%', read the rows into a status struct and close,
+	the same as HAwk's poller. Reports latency per probe, split into
+	connect (with login) and query (with the rows), and the heap
+	allocations made per probe, counted by wrapping malloc and friends.
+	Every probe has to come back with wsrep_local_state set; the exit
+	status is non-zero if any probe failed or the built-in client
+	allocated. With -x every probe is expected to fail instead, for
+	checking that wrong credentials are refused. Built with
+	MYSQL=-DHAWK_NO_LIBMYSQL, only the built-in client runs.
+
+	Usage: probe_bench [-h host] [-p port] [-S socket] [-u user]
+	                   [-P password] [-n probes] [-c native|library|both]
+	                   [-x] */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifndef HAWK_NO_LIBMYSQL
+#include <mysql/mysql.h>
+#endif
+#include "../src/status.h"
+#include "../src/wire.h"
+
+#define QUERY	"SHOW GLOBAL STATUS LIKE 'wsrep_%'"
+
+static unsigned long allocations = 0;
+static long long connected = 0;		//when the last probe had logged in
+static char error[256];
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	allocations++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	allocations++;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static long long now_ms(void)
+{
+	return now_us() / 1000;
+}
+
+#ifndef HAWK_NO_LIBMYSQL
+static int library_probe(const char *host, int port, const char *sock, const char *user, const char *pass, struct hawk_status *st)
+{
+	MYSQL *m = mysql_init(NULL);
+	MYSQL_RES *res = NULL;
+	MYSQL_ROW row;
+
+	status_clear(st);
+	if (m == NULL)
+	{
+		snprintf(error, sizeof(error), "mysql_init failed");
+		return -1;
+	}
+	if (mysql_real_connect(m, sock ? "localhost" : host, user, pass, NULL, port, sock, 0) == NULL)
+	{
+		snprintf(error, sizeof(error), "%s", mysql_error(m));
+		mysql_close(m);
+		return -1;
+	}
+	connected = now_us();
+	if (mysql_query(m, QUERY) != 0 || (res = mysql_store_result(m)) == NULL)
+	{
+		snprintf(error, sizeof(error), "%s", mysql_error(m));
+		mysql_close(m);
+		return -1;
+	}
+	while ((row = mysql_fetch_row(res)))
+	{
+		if (row[0] && row[1])
+		{
+			status_set(st, row[0], row[1]);
+		}
+	}
+	st->ok = 1;
+	mysql_free_result(res);
+	mysql_close(m);
+	return 0;
+}
+#endif
+
+static int native_probe(struct wire *w, const struct wire_target *t, const char *user, const char *pass, struct hawk_status *st)
+{
+	struct wire_field f[2];
+	char name[64];
+	char value[64];
+	int rc = 0;
+
+	status_clear(st);
+	if (wire_connect(w, t, user, pass, now_ms() + 5000) != 0)
+	{
+		snprintf(error, sizeof(error), "%s", w->error);
+		wire_close(w);
+		return -1;
+	}
+	connected = now_us();
+	if (wire_query(w, QUERY, now_ms() + 5000) < 0)
+	{
+		snprintf(error, sizeof(error), "%s", w->error);
+		wire_close(w);
+		return -1;
+	}
+	while ((rc = wire_row(w, f, 2, now_ms() + 5000)) == 1)
+	{
+		if (f[0].data && f[1].data && f[0].len < sizeof(name) && f[1].len < sizeof(value))
+		{
+			memcpy(name, f[0].data, f[0].len);
+			name[f[0].len] = '\0';
+			memcpy(value, f[1].data, f[1].len);
+			value[f[1].len] = '\0';
+			status_set(st, name, value);
+		}
+	}
+	if (rc < 0)
+	{
+		snprintf(error, sizeof(error), "%s", w->error);
+		wire_close(w);
+		return -1;
+	}
+	st->ok = 1;
+	wire_close(w);
+	return 0;
+}
+
+static int compare(const void *a, const void *b)
+{
+	long long x = *(const long long *)a;
+	long long y = *(const long long *)b;
+	return (x > y) - (x < y);
+}
+
+//Runs the probes and prints a line; returns the number that failed
+static int run(const char *label, int native, int n, const char *host, int port, const char *sock,
+	const char *user, const char *pass, int expect_fail)
+{
+	static struct wire w;
+	struct wire_target t;
+	struct hawk_status st;
+	long long *lat = __libc_calloc(n, sizeof(*lat));
+	long long *conn = __libc_calloc(n, sizeof(*conn));
+	long long *query = __libc_calloc(n, sizeof(*query));
+	unsigned long before = 0;
+	unsigned long allocs = 0;
+	long long began = 0;
+	int failed = 0;
+	int ok = 0;
+	int rc = 0;
+
+	if (native && wire_target(&t, host, port, sock, error, sizeof(error)) != 0)
+	{
+		fprintf(stderr, "probe_bench: %s\n", error);
+		return n;
+	}
+	error[0] = '\0';
+	//The library sets itself up on first use; keep that out of the counts
+#ifndef HAWK_NO_LIBMYSQL
+	if (!native)
+	{
+		library_probe(host, port, sock, user, pass, &st);
+	}
+#endif
+	for (int i = 0; i < n; i++)
+	{
+		before = allocations;
+		began = now_us();
+#ifdef HAWK_NO_LIBMYSQL
+		rc = native_probe(&w, &t, user, pass, &st);
+#else
+		rc = native ? native_probe(&w, &t, user, pass, &st) : library_probe(host, port, sock, user, pass, &st);
+#endif
+		lat[i] = now_us() - began;
+		allocs += allocations - before;
+		if (rc != 0 || !st.ok || st.var[VAR_STATE] < 0)
+		{
+			failed++;
+			continue;
+		}
+		conn[ok] = connected - began;
+		query[ok++] = began + lat[i] - connected;
+	}
+	qsort(lat, n, sizeof(*lat), compare);
+	qsort(conn, ok, sizeof(*conn), compare);
+	qsort(query, ok, sizeof(*query), compare);
+	printf("  %-8s %-7s probes=%d failed=%d latency_us p50=%lld p99=%lld max=%lld connect_us p50=%lld p99=%lld query_us p50=%lld p99=%lld allocs/probe=%.1f\n",
+		label, native ? "native" : "library", n, failed, lat[n / 2], lat[(int)(0.99 * (n - 1))], lat[n - 1],
+		ok ? conn[ok / 2] : 0, ok ? conn[(int)(0.99 * (ok - 1))] : 0, ok ? query[ok / 2] : 0, ok ? query[(int)(0.99 * (ok - 1))] : 0,
+		(double)allocs / n);
+	if (failed && error[0])
+	{
+		printf("           last error: %s\n", error);
+	}
+	free(lat);
+	free(conn);
+	free(query);
+	if (expect_fail)
+	{
+		return n - failed;
+	}
+	return failed + (native && allocs > 0);
+}
+
+int main(int argc, char **argv)
+{
+	const char *host = "127.0.0.1";
+	const char *sock = NULL;
+	const char *user = "bench";
+	const char *pass = "bench";
+	const char *clients = "both";
+	int port = 13306;
+	int n = 1000;
+	int expect_fail = 0;
+	int bad = 0;
+	int opt = 0;
+
+	while ((opt = getopt(argc, argv, "h:p:S:u:P:n:c:x")) != -1)
+	{
+		switch (opt)
+		{
+			case 'h':
+				host = optarg;
+				break;
+			case 'p':
+				port = atoi(optarg);
+				break;
+			case 'S':
+				sock = optarg;
+				break;
+			case 'u':
+				user = optarg;
+				break;
+			case 'P':
+				pass = optarg;
+				break;
+			case 'n':
+				n = atoi(optarg);
+				break;
+			case 'c':
+				clients = optarg;
+				break;
+			case 'x':
+				expect_fail = 1;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-h host] [-p port] [-S socket] [-u user] [-P password] [-n probes] [-c native|library|both] [-x]\n", argv[0]);
+				return 2;
+		}
+	}
+	if (n < 1)
+	{
+		n = 1;
+	}
+#ifdef HAWK_NO_LIBMYSQL
+	if (strcmp(clients, "native") != 0)
+	{
+		printf("  %-8s library skipped, built without libmysqlclient\n", sock ? "socket" : "tcp");
+	}
+#else
+	mysql_library_init(0, NULL, NULL);
+	if (strcmp(clients, "native") != 0)
+	{
+		bad += run(sock ? "socket" : "tcp", 0, n, host, port, sock, user, pass, expect_fail);
+	}
+#endif
+	if (strcmp(clients, "library") != 0)
+	{
+		bad += run(sock ? "socket" : "tcp", 1, n, host, port, sock, user, pass, expect_fail);
+	}
+	return bad != 0;
+}
@@ -0,0 +1,69 @@
+#!/bin/sh
+#
+#	HAwk runtime API push check - runs entirely on localhost
+#
+#	Points a scratch HAwk at mock_mysqld and at two haproxy_stub stats
+#	sockets (unix and TCP, the first dropping its first session), takes
+#	the node Synced -> Donor -> Synced and prints the commands each stub
+#	recorded next to the transitions HAwk logged.
+#
+#	BENCH_PORT	first of the local ports to use (default 17200)
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+BASE=${BENCH_PORT:-17200}
+HTTP_PORT=$BASE
+STUB_PORT=$((BASE + 1))
+MYSQL_PORT=$((BASE + 2))
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hawk-push.XXXXXX")
+PIDS=
+
+cleanup()
+{
+	[ -f "$WORK/hawk.pid" ] && kill "$(cat "$WORK/hawk.pid")" 2>/dev/null
+	[ -n "$PIDS" ] && kill $PIDS 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+mkdir -p "$WORK/conf" "$WORK/log"
+cat > "$WORK/conf/hawkd.ini" <<CONF
+[mysql]
+host =		127.0.0.1
+user =		bench
+pass =		bench
+
+[hawk]
+port =		$HTTP_PORT
+daemon_user =	$(id -un)
+probe_interval = 100
+pid_path =	$WORK/hawk.pid
+
+[haproxy]
+sockets =	unix:$WORK/stats.sock, 127.0.0.1:$STUB_PORT
+servers =	galera/db1, galera_ro/db1
+CONF
+
+printf '0 wsrep_local_state 4\n1500 wsrep_local_state 2\n3000 wsrep_local_state 4\n' > "$WORK/donor.script"
+./bench/mock_mysqld -p "$MYSQL_PORT" -f "$WORK/donor.script" 2>>"$WORK/mock.log" &
+PIDS="$PIDS $!"
+./bench/haproxy_stub -S "$WORK/stats.sock" -F 1 > "$WORK/unix.log" 2>>"$WORK/stub.log" &
+PIDS="$PIDS $!"
+./bench/haproxy_stub -p "$STUB_PORT" > "$WORK/tcp.log" 2>>"$WORK/stub.log" &
+PIDS="$PIDS $!"
+sleep 0.2
+
+# The client library falls back to MYSQL_TCP_PORT when no port is given
+MYSQL_TCP_PORT=$MYSQL_PORT HAWK_HOME=$WORK ./hawk || exit 1
+sleep 4.5
+
+echo "== HAwk"
+grep "Node marked\|Pushed\|HAProxy" "$WORK/log/hawkd.log"
+echo
+echo "== unix stats socket (ms, session, command)"
+cat "$WORK/unix.log"
+echo
+echo "== TCP stats socket (ms, session, command)"
+cat "$WORK/tcp.log"
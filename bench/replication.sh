@@ -0,0 +1,122 @@
+#!/bin/sh
+#
+#	HAwk replication mode - runs entirely on localhost
+#
+#	Points a scratch HAwk in replication mode at bench/mock_mysqld
+#	acting as a replica (-R), once per case, with the lag, thread
+#	state or heartbeat set by a one-line mock script. Compares the
+#	agent-check answer with the weight the lag calls for under the
+#	default [replication] settings, and shows the lag HAwk logged.
+#
+#	REPLICATION_CLIENT	mysql:client to probe with (default native)
+#	BENCH_PORT	first of the local ports to use (default 18100)
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+CLIENT=${REPLICATION_CLIENT:-native}
+BASE=${BENCH_PORT:-18100}
+HTTP_PORT=$BASE
+AGENT_PORT=$((BASE + 1))
+MYSQL_PORT=$((BASE + 2))
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hawk-replication.XXXXXX")
+MOCK=
+FAILED=0
+
+cleanup()
+{
+	[ -f "$WORK/hawk.pid" ] && kill "$(cat "$WORK/hawk.pid")" 2>/dev/null
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+alive()
+{
+	[ -e /proc/"$1" ] && ! grep -qs '^State:.*Z' /proc/"$1"/status
+}
+
+start()
+{
+	rm -f "$WORK/log/hawkd.log"
+	cat > "$WORK/conf/hawkd.ini" <<CONF
+[mysql]
+host =		127.0.0.1
+port =		$MYSQL_PORT
+user =		bench
+pass =		bench
+client =	$CLIENT
+
+[hawk]
+mode =		replication
+port =		$HTTP_PORT
+agent_port =	$AGENT_PORT
+daemon_user =	$(id -un)
+probe_interval = 200
+pid_path =	$WORK/hawk.pid
+
+[policy]
+fall =		1
+rise =		1
+
+[replication]
+heartbeat_table = $1
+CONF
+	HAWK_HOME=$WORK ./hawk || { FAILED=1; return 1; }
+}
+
+stop()
+{
+	pid=$(cat "$WORK/hawk.pid")
+	kill -TERM "$pid"
+	while alive "$pid"; do :; done
+	rm -f "$WORK/hawk.pid"
+	kill "$MOCK"
+	wait "$MOCK" 2>/dev/null
+	MOCK=
+}
+
+# case <label> <expected answer> <heartbeat table> <script> [mock flags]
+case_()
+{
+	label=$1
+	expect=$2
+	table=$3
+	printf '%s\n' "$4" | tr ';' '\n' > "$WORK/script"
+	shift 4
+	./bench/mock_mysqld -p "$MYSQL_PORT" -f "$WORK/script" "$@" 2>>"$WORK/mock.log" &
+	MOCK=$!
+	sleep 0.2
+	start "$table" || return
+	sleep 1
+	answer=$(./bench/slowread -p "$AGENT_PORT" -a -n 1 -D 2>/dev/null | sed 's/ *#.*//')
+	stop
+	printf "  %-32s %-16s" "$label" "$answer"
+	if [ "$answer" = "$expect" ]; then
+		echo "ok"
+	else
+		echo "expected $expect"
+		FAILED=1
+	fi
+	grep "Node marked" "$WORK/log/hawkd.log" | tail -n 1 | sed 's/^.*INFO - /    /'
+}
+
+mkdir -p "$WORK/conf" "$WORK/log"
+
+echo "== Seconds_Behind_Source"
+case_ "caught up" "up ready 100%" "" "0 Seconds_Behind_Source 0" -R replica
+case_ "12 s behind" "up ready 65%" "" "0 Seconds_Behind_Source 12" -R replica
+case_ "40 s behind (max_lag 30 s)" "down" "" "0 Seconds_Behind_Source 40" -R replica
+case_ "SQL thread stopped" "down" "" "0 Replica_SQL_Running No;0 Seconds_Behind_Source NULL" -R replica
+case_ "IO thread stopped" "down" "" "0 Replica_IO_Running No" -R replica
+case_ "not a replica" "down" "" "0 Seconds_Behind_Source 0"
+case_ "older server, 5 s behind" "up ready 85%" "" "0 Seconds_Behind_Source 5" -R slave
+
+echo
+echo "== heartbeat table"
+case_ "250 ms behind" "up ready 100%" percona.heartbeat "0 @heartbeat 250" -R replica
+case_ "12 s behind" "up ready 65%" percona.heartbeat "0 @heartbeat 12000" -R replica
+case_ "table missing" "down" percona.heartbeat "0 Seconds_Behind_Source 0" -R replica
+
+exit $FAILED
@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+#	HAwk benchmark - runs entirely on localhost
+#
+#	Starts mock_mysqld, points a scratch HAwk instance at it and drives the
+#	HTTP and agent-check listeners with loadgen under a few scenarios.
+#
+#	BENCH_SECONDS	duration of each run (default 5)
+#	BENCH_CONNS	concurrent checkers for the loaded runs (default 64)
+#	BENCH_PORT	first of the local ports to use (default 17000)
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+SECS=${BENCH_SECONDS:-5}
+CONNS=${BENCH_CONNS:-64}
+BASE=${BENCH_PORT:-17000}
+HTTP_PORT=$BASE
+AGENT_PORT=$((BASE + 1))
+MYSQL_PORT=$((BASE + 2))
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hawk-bench.XXXXXX")
+MOCK=
+
+cleanup()
+{
+	[ -f "$WORK/hawk.pid" ] && kill "$(cat "$WORK/hawk.pid")" 2>/dev/null
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+start_mock()
+{
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null && wait "$MOCK" 2>/dev/null
+	./bench/mock_mysqld -p "$MYSQL_PORT" "$@" 2>>"$WORK/mock.log" &
+	MOCK=$!
+	sleep 0.2
+}
+
+scenario()
+{
+	echo
+	echo "== $1"
+}
+
+mkdir -p "$WORK/conf" "$WORK/log"
+cat > "$WORK/conf/hawkd.ini" <<CONF
+[mysql]
+host =		127.0.0.1
+user =		bench
+pass =		bench
+
+[hawk]
+port =		$HTTP_PORT
+agent_port =	$AGENT_PORT
+daemon_user =	$(id -un)
+probe_interval = 100
+pid_path =	$WORK/hawk.pid
+CONF
+
+start_mock
+
+# The client library falls back to MYSQL_TCP_PORT when no port is given
+MYSQL_TCP_PORT=$MYSQL_PORT HAWK_HOME=$WORK ./hawk || exit 1
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	grep -q "First probe completed" "$WORK/log/hawkd.log" 2>/dev/null && break
+	sleep 0.2
+done
+grep "First probe\|First live" "$WORK/log/hawkd.log"
+
+scenario "http, 1 checker"
+./bench/loadgen -p "$HTTP_PORT" -c 1 -d "$SECS"
+
+scenario "http, $CONNS checkers"
+./bench/loadgen -p "$HTTP_PORT" -c "$CONNS" -d "$SECS"
+
+scenario "agent-check, $CONNS checkers"
+./bench/loadgen -p "$AGENT_PORT" -a -c "$CONNS" -d "$SECS"
+
+scenario "http, $CONNS checkers, MySQL answering in 50ms"
+start_mock -l 50
+./bench/loadgen -p "$HTTP_PORT" -c "$CONNS" -d "$SECS"
+
+scenario "http, $CONNS checkers, node flapping Synced/Donor every 500ms"
+printf '0 wsrep_local_state 4\n500 wsrep_local_state 2\n999 wsrep_local_state 2\n' > "$WORK/flap.script"
+start_mock -f "$WORK/flap.script" -r
+./bench/loadgen -p "$HTTP_PORT" -c "$CONNS" -d "$SECS"
@@ -0,0 +1,235 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*	slowread - checks that answers survive a slow, small-buffered peer
+
+	Makes -n checks one after another. Each connection gets a receive
+	buffer of -b bytes, sends its request followed by -j bytes the
+	server will never read, then takes the answer -c bytes at a time
+	with -w ms between reads. Every answer is checked for completeness:
+	an HTTP answer must carry as many body bytes as its Content-Length,
+	an agent answer (-a) must be one whole line. Resets and short
+	answers are counted; the exit status is non-zero if there were any.
+
+	With -S n one quick check is first made from each of n loopback
+	source addresses (127.0.1.x and up), so HAwk has that many clients
+	to list on /metrics. With -D the last body is written to stdout.
+
+	Usage: slowread [-h host] [-p port] [-P path] [-n checks] [-b rcvbuf]
+	                [-c chunk] [-w ms] [-j junk bytes] [-S sources] [-a] [-D] */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+static struct sockaddr_in target;
+static char answer[1 << 20];
+
+static int dial(uint32_t source, int rcvbuf)
+{
+	struct sockaddr_in src;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (fd < 0)
+	{
+		return -1;
+	}
+	//Has to be set before connecting to limit the advertised window
+	if (rcvbuf > 0)
+	{
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	}
+	if (source)
+	{
+		memset(&src, 0, sizeof(src));
+		src.sin_family = AF_INET;
+		src.sin_addr.s_addr = htonl(source);
+		if (bind(fd, (struct sockaddr *)&src, sizeof(src)) != 0)
+		{
+			close(fd);
+			return -1;
+		}
+	}
+	if (connect(fd, (struct sockaddr *)&target, sizeof(target)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void pause_ms(int ms)
+{
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+
+	nanosleep(&ts, NULL);
+}
+
+//0 complete, 1 short, 2 reset, 3 other error
+static int check(const char *request, int agent, int rcvbuf, int chunk, int wait, int junk, size_t *got)
+{
+	static char filler[65536];
+	const char *body = NULL;
+	char *end = NULL;
+	long length = -1;
+	ssize_t n = 0;
+	int fd = dial(0, rcvbuf);
+
+	*got = 0;
+	if (fd < 0)
+	{
+		return 3;
+	}
+	if (!agent && write(fd, request, strlen(request)) < 0)
+	{
+		close(fd);
+		return 3;
+	}
+	memset(filler, 'x', sizeof(filler));
+	for (int left = junk; left > 0; left -= n)
+	{
+		n = write(fd, filler, left < (int)sizeof(filler) ? left : (int)sizeof(filler));
+		if (n <= 0)
+		{
+			break;
+		}
+	}
+	for (;;)
+	{
+		if (wait > 0)
+		{
+			pause_ms(wait);
+		}
+		n = read(fd, answer + *got, chunk < (int)(sizeof(answer) - 1 - *got) ? chunk : (int)(sizeof(answer) - 1 - *got));
+		if (n <= 0)
+		{
+			break;
+		}
+		*got += n;
+	}
+	close(fd);
+	answer[*got] = '\0';
+	if (n < 0)
+	{
+		return errno == ECONNRESET ? 2 : 3;
+	}
+	if (agent)
+	{
+		return (*got > 0 && answer[*got - 1] == '\n' && memchr(answer, '\n', *got) == answer + *got - 1) ? 0 : 1;
+	}
+	body = strstr(answer, "\r\n\r\n");
+	end = strcasestr(answer, "Content-Length:");
+	if (end)
+	{
+		length = strtol(end + 15, NULL, 10);
+	}
+	return (body && length >= 0 && (long)(*got - (body + 4 - answer)) == length) ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *host = "127.0.0.1";
+	const char *path = "/";
+	char request[256];
+	int port = 8080;
+	int count = 10;
+	int rcvbuf = 0;
+	int chunk = 512;
+	int wait = 0;
+	int junk = 0;
+	int sources = 0;
+	int agent = 0;
+	int dump = 0;
+	int opt = 0;
+	int fd = 0;
+	unsigned long outcome[4] = {0, 0, 0, 0};
+	size_t got = 0;
+	size_t most = 0;
+
+	while ((opt = getopt(argc, argv, "h:p:P:n:b:c:w:j:S:aD")) != -1)
+	{
+		switch (opt)
+		{
+			case 'h': host = optarg; break;
+			case 'p': port = atoi(optarg); break;
+			case 'P': path = optarg; break;
+			case 'n': count = atoi(optarg); break;
+			case 'b': rcvbuf = atoi(optarg); break;
+			case 'c': chunk = atoi(optarg); break;
+			case 'w': wait = atoi(optarg); break;
+			case 'j': junk = atoi(optarg); break;
+			case 'S': sources = atoi(optarg); break;
+			case 'a': agent = 1; break;
+			case 'D': dump = 1; break;
+			default:
+				fprintf(stderr, "Usage: %s [-h host] [-p port] [-P path] [-n checks] [-b rcvbuf] [-c chunk] [-w ms] [-j junk bytes] [-S sources] [-a] [-D]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (chunk < 1)
+	{
+		chunk = 1;
+	}
+	memset(&target, 0, sizeof(target));
+	target.sin_family = AF_INET;
+	target.sin_port = htons(port);
+	if (inet_pton(AF_INET, host, &target.sin_addr) != 1)
+	{
+		fprintf(stderr, "slowread: bad host %s\n", host);
+		return 1;
+	}
+	snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: hawk\r\nConnection: close\r\n\r\n", path);
+
+	for (int i = 0; i < sources; i++)
+	{
+		fd = dial(0x7f000101 + i, 0);
+		if (fd >= 0)
+		{
+			if (!agent)
+			{
+				write(fd, request, strlen(request));
+			}
+			while (read(fd, answer, sizeof(answer)) > 0)
+				;
+			close(fd);
+		}
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		outcome[check(request, agent, rcvbuf, chunk, wait, junk, &got)]++;
+		most = got > most ? got : most;
+	}
+	if (dump)
+	{
+		fputs(answer, stdout);
+	}
+	fprintf(dump ? stderr : stdout, "slowread: %s %s:%d checks=%d rcvbuf=%d chunk=%d wait=%dms junk=%d\n"
+		"  complete=%lu short=%lu resets=%lu errors=%lu largest=%zu bytes\n",
+		agent ? "agent" : path, host, port, count, rcvbuf, chunk, wait, junk,
+		outcome[0], outcome[1], outcome[2], outcome[3], most);
+	return outcome[1] + outcome[2] + outcome[3] ? 2 : 0;
+}
@@ -0,0 +1,90 @@
+#!/bin/sh
+#
+#	HAwk small socket buffer check - runs entirely on localhost
+#
+#	Starts a scratch HAwk whose accepted sockets get a send buffer of a
+#	few kilobytes and has bench/slowread take answers from it through a
+#	small receive buffer, a few hundred bytes at a time. /metrics is
+#	padded with a few hundred clients so it cannot go out in one write.
+#	Health and agent checks also send bytes HAwk never reads, which
+#	would turn a plain close into a reset. Exits non-zero if any answer
+#	arrives short or reset, or if no answer needed a second write.
+#
+#	SMALLBUF_SNDBUF	send buffer HAwk sets on checks (default 4096)
+#	SMALLBUF_CHECKS	checks per run (default 20)
+#	BENCH_PORT	first of the local ports to use (default 17500)
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+SNDBUF=${SMALLBUF_SNDBUF:-4096}
+CHECKS=${SMALLBUF_CHECKS:-20}
+BASE=${BENCH_PORT:-17500}
+HTTP_PORT=$BASE
+AGENT_PORT=$((BASE + 1))
+MYSQL_PORT=$((BASE + 2))
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hawk-smallbuf.XXXXXX")
+MOCK=
+FAILED=0
+
+cleanup()
+{
+	[ -f "$WORK/hawk.pid" ] && kill "$(cat "$WORK/hawk.pid")" 2>/dev/null
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+run()
+{
+	echo
+	echo "== $1"
+	shift
+	./bench/slowread -p "$HTTP_PORT" "$@" || FAILED=1
+}
+
+mkdir -p "$WORK/conf" "$WORK/log"
+cat > "$WORK/conf/hawkd.ini" <<CONF
+[mysql]
+host =		127.0.0.1
+user =		bench
+pass =		bench
+
+[hawk]
+port =		$HTTP_PORT
+agent_port =	$AGENT_PORT
+daemon_user =	$(id -un)
+probe_interval = 1000
+pid_path =	$WORK/hawk.pid
+
+[limits]
+clients =	2048
+sndbuf =	$SNDBUF
+request_timeout = 5000
+CONF
+
+./bench/mock_mysqld -p "$MYSQL_PORT" 2>>"$WORK/mock.log" &
+MOCK=$!
+sleep 0.2
+MYSQL_TCP_PORT=$MYSQL_PORT HAWK_HOME=$WORK ./hawk || exit 1
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	grep -q "First probe completed" "$WORK/log/hawkd.log" 2>/dev/null && break
+	sleep 0.2
+done
+
+# One check from each of 400 loopback addresses, each listed on /metrics
+./bench/slowread -p "$HTTP_PORT" -S 400 -n 0 > /dev/null
+
+run "/metrics through a 1 KB receive buffer, 256 bytes per read" -P /metrics -n "$CHECKS" -b 1024 -c 256 -w 1
+run "health checks with 8 KB of unread request body" -n "$CHECKS" -j 8192
+run "health checks through a 1 KB receive buffer, 16 bytes per read" -n "$CHECKS" -b 1024 -c 16 -w 1 -j 2048
+run "agent checks with 4 KB of unread input" -p "$AGENT_PORT" -a -n "$CHECKS" -j 4096
+
+echo
+echo "== counters"
+./bench/slowread -p "$HTTP_PORT" -P /metrics -n 1 -D 2>/dev/null > "$WORK/metrics" || FAILED=1
+grep -E "^hawk_(partial_writes|write_timeouts|request_timeouts|slab_full)_total" "$WORK/metrics" | sed 's/^/  /'
+grep -qE "^hawk_partial_writes_total [1-9]" "$WORK/metrics" || { echo "  no answer needed more than one write"; FAILED=1; }
+
+exit $FAILED
@@ -0,0 +1,190 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*	Seqlock snapshot benchmark
+	One writer republishes the snapshot in a tight loop while 1..N reader
+	threads, pinned to separate CPUs where possible, read it and check
+	every copy for torn fields. Reports ns per read and torn reads; the
+	exit status is non-zero if any torn read was seen.	*/
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../src/snapshot.h"
+
+static struct hawk_snapshot_cell cell;
+static volatile int running = 1;
+
+struct reader
+{
+	pthread_t thread;
+	int cpu;
+	unsigned long reads;
+	unsigned long torn;
+	double ns;
+} __attribute__((aligned(HAWK_CACHELINE)));
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void pin(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu % sysconf(_SC_NPROCESSORS_ONLN), &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+//Every field is derived from the generation so a mix of two is detectable
+static void fill(struct hawk_snapshot *snap, uint64_t gen)
+{
+	snap->generation = gen;
+	snap->probed_at = (int64_t)gen;
+	snap->grace_until = -(int64_t)gen;
+	snap->node = (int32_t)(gen & 3);
+	snap->weight = (int32_t)(gen % 101);
+	for (int i = 0; i < STATUS_VARS; i++)
+	{
+		snap->var[i] = (int64_t)gen * (i + 1);
+	}
+	memset(snap->state, 0, sizeof(snap->state));
+	snprintf(snap->state, sizeof(snap->state), "%llu", (unsigned long long)(gen % 1000000));
+}
+
+static int consistent(const struct hawk_snapshot *snap)
+{
+	struct hawk_snapshot expect;
+
+	memset(&expect, 0, sizeof(expect));
+	fill(&expect, snap->generation);
+	expect.fresh = snap->fresh;
+	expect.ok = snap->ok;
+	return memcmp(&expect, snap, sizeof(expect)) == 0;
+}
+
+static void* writer_main(void *arg)
+{
+	struct hawk_snapshot snap;
+	uint64_t gen = 1;
+
+	(void)arg;
+	pin(0);
+	memset(&snap, 0, sizeof(snap));
+	while (running)
+	{
+		fill(&snap, gen++);
+		snapshot_publish(&cell, &snap);
+	}
+	return NULL;
+}
+
+static void* reader_main(void *arg)
+{
+	struct reader *r = arg;
+	struct hawk_snapshot snap;
+	double start = 0;
+
+	pin(r->cpu);
+	start = now_ns();
+	while (running)
+	{
+		snapshot_read(&cell, &snap);
+		if (!consistent(&snap))
+		{
+			r->torn++;
+		}
+		r->reads++;
+	}
+	r->ns = now_ns() - start;
+	return NULL;
+}
+
+//Read cost without the consistency check, single thread, no writer
+static double uncontended_ns(void)
+{
+	struct hawk_snapshot snap;
+	long n = 20000000;
+	double start = now_ns();
+
+	for (long i = 0; i < n; i++)
+	{
+		snapshot_read(&cell, &snap);
+		__asm__ __volatile__("" : : "r"(&snap) : "memory");
+	}
+	return (now_ns() - start) / n;
+}
+
+int main(int argc, char **argv)
+{
+	int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int max_readers = argc > 1 ? atoi(argv[1]) : (cpus > 1 ? cpus - 1 : 1);
+	int millis = argc > 2 ? atoi(argv[2]) : 500;
+	struct reader *readers = calloc(max_readers, sizeof(*readers));
+	struct hawk_snapshot snap;
+	pthread_t writer;
+	unsigned long torn = 0;
+
+	memset(&snap, 0, sizeof(snap));
+	fill(&snap, 0);
+	snapshot_publish(&cell, &snap);
+
+	printf("snapshot %zu bytes, cell %zu bytes, %d cpus\n", sizeof(struct hawk_snapshot), sizeof(struct hawk_snapshot_cell), cpus);
+	printf("uncontended read: %.2f ns\n", uncontended_ns());
+	printf("%8s %14s %12s %10s\n", "readers", "reads", "ns/read", "torn");
+
+	for (int n = 1; n <= max_readers; n++)
+	{
+		unsigned long reads = 0;
+		unsigned long round_torn = 0;
+		double ns = 0;
+
+		running = 1;
+		memset(readers, 0, max_readers * sizeof(*readers));
+		pthread_create(&writer, NULL, writer_main, NULL);
+		for (int i = 0; i < n; i++)
+		{
+			readers[i].cpu = i + 1;
+			pthread_create(&readers[i].thread, NULL, reader_main, &readers[i]);
+		}
+		usleep(millis * 1000);
+		running = 0;
+		pthread_join(writer, NULL);
+		for (int i = 0; i < n; i++)
+		{
+			pthread_join(readers[i].thread, NULL);
+			reads += readers[i].reads;
+			ns += readers[i].ns;
+			round_torn += readers[i].torn;
+		}
+		torn += round_torn;
+		printf("%8d %14lu %12.2f %10lu\n", n, reads, reads ? ns / reads : 0, round_torn);
+	}
+	free(readers);
+	return torn != 0;
+}
@@ -0,0 +1,103 @@
+#!/bin/sh
+#
+#	HAwk probe transport comparison - runs entirely on localhost
+#
+#	Probes bench/mock_mysqld over loopback TCP and over its Unix socket
+#	with both MySQL clients and reports connect (with login) and query
+#	latency for each. Then runs a scratch HAwk probing every
+#	SOCKET_INTERVAL ms, first with mysql:host and mysql:port and then
+#	with mysql:socket = auto, and reports the mean probe phases from
+#	its /metrics. The second run also checks that the socket was found
+#	and used.
+#
+#	PROBE_COUNT	probes per client and transport (default 2000)
+#	SOCKET_SECONDS	length of each HAwk run (default 5)
+#	SOCKET_INTERVAL	HAwk probe interval in ms (default 10)
+#	BENCH_PORT	first of the local ports to use (default 17900)
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+COUNT=${PROBE_COUNT:-2000}
+SECS=${SOCKET_SECONDS:-5}
+INTERVAL=${SOCKET_INTERVAL:-10}
+BASE=${BENCH_PORT:-17900}
+HTTP_PORT=$BASE
+MYSQL_PORT=$((BASE + 2))
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hawk-socket.XXXXXX")
+SOCK=$WORK/mysqld.sock
+MOCK=
+FAILED=0
+
+cleanup()
+{
+	[ -f "$WORK/hawk.pid" ] && kill "$(cat "$WORK/hawk.pid")" 2>/dev/null
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+alive()
+{
+	[ -e /proc/"$1" ] && ! grep -qs '^State:.*Z' /proc/"$1"/status
+}
+
+run()
+{
+	label=$1
+	where=$2
+	rm -f "$WORK/log/hawkd.log"
+	cat > "$WORK/conf/hawkd.ini" <<CONF
+[mysql]
+host =		127.0.0.1
+user =		bench
+pass =		bench
+$where
+
+[hawk]
+port =		$HTTP_PORT
+daemon_user =	$(id -un)
+probe_interval = $INTERVAL
+pid_path =	$WORK/hawk.pid
+latency_stats =	1
+CONF
+	# MYSQL_UNIX_PORT is where mysql:socket = auto looks first
+	MYSQL_UNIX_PORT=$SOCK HAWK_HOME=$WORK ./hawk || { FAILED=1; return; }
+	sleep "$SECS"
+	pid=$(cat "$WORK/hawk.pid")
+
+	echo
+	echo "== $label"
+	grep -E "Probing MySQL|probing .* over TCP" "$WORK/log/hawkd.log" | sed 's/^.*INFO - /  /'
+	./bench/slowread -p "$HTTP_PORT" -P /metrics -n 1 -D 2>/dev/null > "$WORK/metrics" || FAILED=1
+	kill -TERM "$pid"
+	while alive "$pid"; do :; done
+	rm -f "$WORK/hawk.pid"
+	grep -q "ERROR" "$WORK/log/hawkd.log" && { grep "ERROR" "$WORK/log/hawkd.log" | sed 's/^/  /'; FAILED=1; }
+	awk -F'[{}" ]+' '
+		/^hawk_phase_seconds_sum\{phase="probe_/ { sum[$3] = $4 }
+		/^hawk_phase_seconds_count\{phase="probe_/ { count[$3] = $4 }
+		END {
+			n = split("probe_connect probe_query probe_result probe_total", p, " ")
+			for (i = 1; i <= n; i++)
+				if (count[p[i]] > 0)
+					printf "  %-14s probes=%-6d mean_us=%.0f\n", p[i], count[p[i]], sum[p[i]] / count[p[i]] * 1e6
+		}' "$WORK/metrics"
+	grep -q 'hawk_phase_seconds_count{phase="probe_total"} [1-9]' "$WORK/metrics" || { echo "  no probes recorded"; FAILED=1; }
+}
+
+mkdir -p "$WORK/conf" "$WORK/log"
+./bench/mock_mysqld -p "$MYSQL_PORT" -S "$SOCK" 2>>"$WORK/mock.log" &
+MOCK=$!
+sleep 0.2
+
+echo "== probe_bench"
+./bench/probe_bench -p "$MYSQL_PORT" -n "$COUNT" || FAILED=1
+./bench/probe_bench -p "$MYSQL_PORT" -S "$SOCK" -n "$COUNT" || FAILED=1
+
+run "hawk over TCP (mysql:port)" "port =		$MYSQL_PORT"
+run "hawk over the socket (mysql:socket = auto)" "socket =	auto"
+grep -q "Probing MySQL through $SOCK" "$WORK/log/hawkd.log" || { echo "  the socket was not used"; FAILED=1; }
+
+exit $FAILED
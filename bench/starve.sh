@@ -0,0 +1,113 @@
+#!/bin/sh
+#
+#	HAwk starvation benchmark - runs entirely on localhost
+#
+#	Drives a scratch HAwk at a fixed check rate three times: on a quiet
+#	host, under bench/hog with the default [process] settings, and under
+#	the same hog with memory locked and a real-time scheduling class.
+#	The p99/p999 of the loaded runs show how much of HAwk's answer time
+#	is down to competing with mysqld for CPU and memory.
+#
+#	STARVE_SECONDS	duration of each run (default 10)
+#	STARVE_RATE	checks per second (default 500)
+#	HOG_CPUS	spinning workers (default twice the CPU count)
+#	HOG_VMS		memory workers (default 2)
+#	HOG_MB		megabytes each memory worker keeps dirtying (default 256)
+#	STARVE_SCHED	[process] sched for the tuned run (default fifo)
+#	BENCH_PORT	first of the local ports to use (default 17400)
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+SECS=${STARVE_SECONDS:-10}
+RATE=${STARVE_RATE:-500}
+CPUS=${HOG_CPUS:-$(( $(getconf _NPROCESSORS_ONLN) * 2 ))}
+VMS=${HOG_VMS:-2}
+MB=${HOG_MB:-256}
+SCHED=${STARVE_SCHED:-fifo}
+BASE=${BENCH_PORT:-17400}
+HTTP_PORT=$BASE
+MYSQL_PORT=$((BASE + 2))
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hawk-starve.XXXXXX")
+MOCK=
+HOG=
+
+stop_hawk()
+{
+	[ -f "$WORK/hawk.pid" ] || return
+	kill "$(cat "$WORK/hawk.pid")" 2>/dev/null
+	while [ -e /proc/"$(cat "$WORK/hawk.pid")" ]; do sleep 0.05; done
+	rm -f "$WORK/hawk.pid"
+}
+
+cleanup()
+{
+	stop_hawk
+	[ -n "$HOG" ] && kill "$HOG" 2>/dev/null
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+# start_hawk <extra [process] lines>
+start_hawk()
+{
+	stop_hawk
+	cat > "$WORK/conf/hawkd.ini" <<CONF
+[mysql]
+host =		127.0.0.1
+user =		bench
+pass =		bench
+
+[hawk]
+port =		$HTTP_PORT
+daemon_user =	$(id -un)
+probe_interval = 100
+pid_path =	$WORK/hawk.pid
+
+[process]
+$1
+CONF
+	MYSQL_TCP_PORT=$MYSQL_PORT HAWK_HOME=$WORK ./hawk || exit 1
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		grep -q "First probe completed" "$WORK/log/hawkd.log" 2>/dev/null && break
+		sleep 0.2
+	done
+}
+
+run()
+{
+	echo
+	echo "== $1"
+	./bench/loadgen -p "$HTTP_PORT" -c 64 -r "$RATE" -d "$SECS" -e 200
+}
+
+hog()
+{
+	./bench/hog -c "$CPUS" -m "$VMS" -M "$MB" -d $((SECS + 2)) &
+	HOG=$!
+	sleep 1
+}
+
+mkdir -p "$WORK/conf" "$WORK/log"
+./bench/mock_mysqld -p "$MYSQL_PORT" 2>>"$WORK/mock.log" &
+MOCK=$!
+sleep 0.2
+
+start_hawk ""
+run "quiet host"
+
+hog
+run "hog, default scheduling"
+wait "$HOG"
+HOG=
+
+start_hawk "lock_memory =	1
+sched =		$SCHED
+priority =	10"
+grep -E "ERROR|Memory locked" "$WORK/log/hawkd.log" | sed 's/^/  /'
+hog
+run "hog, lock_memory and sched=$SCHED"
+wait "$HOG"
+HOG=
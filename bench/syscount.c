@@ -0,0 +1,203 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*	syscount - counts the system calls a process makes through libc
+
+	Preloaded into HAwk by the io_uring benchmark, which has no strace to
+	lean on. Each wrapper below counts a call and passes it on; io_uring
+	calls go through syscall(2) and are counted by number. At exit the
+	counts are written as "name count" lines to $SYSCOUNT_FILE.<pid>.
+	Calls libc makes internally, such as the writes behind fprintf, are
+	not seen; HAwk makes few of those outside logging.
+
+	Usage: LD_PRELOAD=bench/syscount.so SYSCOUNT_FILE=out program */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/types.h>
+
+enum call
+{
+	C_ACCEPT,
+	C_READ,
+	C_RECV,
+	C_WRITE,
+	C_SEND,
+	C_CLOSE,
+	C_SHUTDOWN,
+	C_SETSOCKOPT,
+	C_FCNTL,
+	C_EPOLL_WAIT,
+	C_EPOLL_CTL,
+	C_TIMERFD,
+	C_URING_ENTER,
+	C_SYSCALL,
+	CALLS
+};
+
+static const char *names[CALLS] = {"accept", "read", "recv", "write", "send", "close", "shutdown",
+	"setsockopt", "fcntl", "epoll_wait", "epoll_ctl", "timerfd_settime", "io_uring_enter", "syscall"};
+static unsigned long counts[CALLS];
+
+#define COUNT(c)	__atomic_fetch_add(&counts[c], 1, __ATOMIC_RELAXED)
+#define REAL(name)	static __typeof__(name) *real; if (!real) real = dlsym(RTLD_NEXT, #name)
+
+int accept4(int fd, struct sockaddr *addr, socklen_t *len, int flags)
+{
+	REAL(accept4);
+	COUNT(C_ACCEPT);
+	return real(fd, addr, len, flags);
+}
+
+int accept(int fd, struct sockaddr *addr, socklen_t *len)
+{
+	REAL(accept);
+	COUNT(C_ACCEPT);
+	return real(fd, addr, len);
+}
+
+ssize_t read(int fd, void *buf, size_t len)
+{
+	REAL(read);
+	COUNT(C_READ);
+	return real(fd, buf, len);
+}
+
+ssize_t recv(int fd, void *buf, size_t len, int flags)
+{
+	REAL(recv);
+	COUNT(C_RECV);
+	return real(fd, buf, len, flags);
+}
+
+ssize_t write(int fd, const void *buf, size_t len)
+{
+	REAL(write);
+	COUNT(C_WRITE);
+	return real(fd, buf, len);
+}
+
+ssize_t send(int fd, const void *buf, size_t len, int flags)
+{
+	REAL(send);
+	COUNT(C_SEND);
+	return real(fd, buf, len, flags);
+}
+
+int close(int fd)
+{
+	REAL(close);
+	COUNT(C_CLOSE);
+	return real(fd);
+}
+
+int shutdown(int fd, int how)
+{
+	REAL(shutdown);
+	COUNT(C_SHUTDOWN);
+	return real(fd, how);
+}
+
+int setsockopt(int fd, int level, int name, const void *val, socklen_t len)
+{
+	REAL(setsockopt);
+	COUNT(C_SETSOCKOPT);
+	return real(fd, level, name, val, len);
+}
+
+int fcntl(int fd, int cmd, ...)
+{
+	va_list ap;
+	long arg = 0;
+
+	REAL(fcntl);
+	COUNT(C_FCNTL);
+	va_start(ap, cmd);
+	arg = va_arg(ap, long);
+	va_end(ap);
+	return real(fd, cmd, arg);
+}
+
+int epoll_wait(int epfd, struct epoll_event *events, int max, int timeout)
+{
+	REAL(epoll_wait);
+	COUNT(C_EPOLL_WAIT);
+	return real(epfd, events, max, timeout);
+}
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev)
+{
+	REAL(epoll_ctl);
+	COUNT(C_EPOLL_CTL);
+	return real(epfd, op, fd, ev);
+}
+
+int timerfd_settime(int fd, int flags, const struct itimerspec *value, struct itimerspec *old)
+{
+	REAL(timerfd_settime);
+	COUNT(C_TIMERFD);
+	return real(fd, flags, value, old);
+}
+
+long syscall(long number, ...)
+{
+	va_list ap;
+	long a[6];
+
+	REAL(syscall);
+	COUNT(number == __NR_io_uring_enter ? C_URING_ENTER : C_SYSCALL);
+	va_start(ap, number);
+	for (int i = 0; i < 6; i++)
+	{
+		a[i] = va_arg(ap, long);
+	}
+	va_end(ap);
+	return real(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+__attribute__((destructor)) static void report(void)
+{
+	const char *base = getenv("SYSCOUNT_FILE");
+	char path[4096];
+	FILE *out = NULL;
+
+	if (base == NULL)
+	{
+		return;
+	}
+	snprintf(path, sizeof(path), "%s.%d", base, (int)getpid());
+	if ((out = fopen(path, "w")) == NULL)
+	{
+		return;
+	}
+	for (int i = 0; i < CALLS; i++)
+	{
+		fprintf(out, "%s %lu\n", names[i], counts[i]);
+	}
+	fclose(out);
+}
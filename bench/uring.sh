@@ -0,0 +1,128 @@
+#!/bin/sh
+#
+#	HAwk io_uring comparison - runs entirely on localhost
+#
+#	Serves health checks from a scratch HAwk with hawk:io set to epoll and
+#	then to uring, under the same closed-loop load from bench/loadgen, and
+#	reports throughput and the system calls HAwk made per answered check,
+#	counted by the bench/syscount.so preload. A kernel without the io_uring
+#	support HAwk needs falls back to epoll, and is reported as such.
+#	Then hits each backend with far more checkers than that, twice, and
+#	checks that a single checker is still answered afterwards. Exits
+#	non-zero if a run gets no answers, or a burst gets resets or timeouts.
+#
+#	URING_SECONDS	length of each run (default 5)
+#	URING_CONNS	concurrent checkers (default 64)
+#	URING_BURST	concurrent checkers in a burst (default 1000)
+#	BENCH_PORT	first of the local ports to use (default 17600)
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+SECS=${URING_SECONDS:-5}
+CONNS=${URING_CONNS:-64}
+BURST=${URING_BURST:-1000}
+BASE=${BENCH_PORT:-17600}
+HTTP_PORT=$BASE
+MYSQL_PORT=$((BASE + 2))
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hawk-uring.XXXXXX")
+MOCK=
+FAILED=0
+
+cleanup()
+{
+	[ -f "$WORK/hawk.pid" ] && kill "$(cat "$WORK/hawk.pid")" 2>/dev/null
+	[ -n "$MOCK" ] && kill "$MOCK" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+alive()
+{
+	[ -e /proc/"$1" ] && ! grep -qs '^State:.*Z' /proc/"$1"/status
+}
+
+# start <io> [VAR=value...]: a scratch HAwk on that backend, with the
+# variables in its environment
+start()
+{
+	io=$1
+	shift
+	rm -f "$WORK"/count.* "$WORK/log/hawkd.log"
+	cat > "$WORK/conf/hawkd.ini" <<CONF
+[mysql]
+host =		127.0.0.1
+user =		bench
+pass =		bench
+
+[hawk]
+port =		$HTTP_PORT
+daemon_user =	$(id -un)
+probe_interval = 1000
+pid_path =	$WORK/hawk.pid
+io =		$io
+CONF
+	env "$@" MYSQL_TCP_PORT=$MYSQL_PORT HAWK_HOME=$WORK ./hawk || return 1
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		grep -q "First probe completed" "$WORK/log/hawkd.log" 2>/dev/null && break
+		sleep 0.2
+	done
+	pid=$(cat "$WORK/hawk.pid")
+	[ "$io" = uring ] && ! grep -q "with io_uring" "$WORK/log/hawkd.log" && \
+		grep "ERROR" "$WORK/log/hawkd.log" | sed 's/^/  /'
+	return 0
+}
+
+stop()
+{
+	kill -TERM "$pid"
+	while alive "$pid"; do :; done
+	rm -f "$WORK/hawk.pid"
+}
+
+run()
+{
+	echo
+	echo "== hawk:io = $1"
+	start "$1" LD_PRELOAD="$PWD/bench/syscount.so" SYSCOUNT_FILE="$WORK/count" || { FAILED=1; return; }
+	./bench/loadgen -p "$HTTP_PORT" -c "$CONNS" -d "$SECS" -e 200 > "$WORK/load" || FAILED=1
+	sed 's/^/  /' "$WORK/load"
+	stop
+
+	# Startup and the poller are in the counts too; both are small next
+	# to tens of thousands of checks
+	answers=$(sed -n 's/.*answers=\([0-9]*\).*/\1/p' "$WORK/load")
+	[ -f "$WORK/count.$pid" ] || { echo "  no counts from syscount.so"; FAILED=1; return; }
+	awk -v n="$answers" '
+		$2 > 0 { printf "  %-16s %10d  %6.2f per check\n", $1, $2, $2 / n; total += $2 }
+		END { printf "  %-16s %10d  %6.2f per check\n", "total", total, total / n }' "$WORK/count.$pid"
+}
+
+mkdir -p "$WORK/conf" "$WORK/log"
+./bench/mock_mysqld -p "$MYSQL_PORT" 2>>"$WORK/mock.log" &
+MOCK=$!
+sleep 0.2
+
+# A completion queue or buffer ring smaller than the checks in flight
+# once left the ring unable to answer anyone
+burst()
+{
+	echo
+	echo "== hawk:io = $1, $BURST checkers twice, then 1"
+	start "$1" || { FAILED=1; return; }
+	for conns in "$BURST" "$BURST" 1; do
+		./bench/loadgen -p "$HTTP_PORT" -c "$conns" -d 2 -t 2000 -e 200 > "$WORK/load"
+		sed -n 's/^ */  /; /answers=/p' "$WORK/load"
+		grep -q "answers=[1-9][0-9]* .* timeouts=0 resets=0" "$WORK/load" || FAILED=1
+	done
+	grep -q "errors=0 timeouts=0 resets=0" "$WORK/load" || FAILED=1
+	stop
+}
+
+run epoll
+run uring
+burst epoll
+burst uring
+
+exit $FAILED
@@ -17,6 +17,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */    
     
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -28,16 +29,127 @@
 #include <time.h>
 #include <stdarg.h>
 #include <pwd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <malloc.h>
+#ifndef HAWK_NO_LIBMYSQL
 #include <mysql/mysql.h>
+#endif
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
 #include <sys/socket.h> 
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include "lib/iniparser/src/iniparser.h"
+#include "src/statefile.h"
+#include "src/policy.h"
+#include "src/breaker.h"
+#include "src/admit.h"
+#include "src/runtime.h"
+#include "src/slab.h"
+#include "src/uring.h"
+#include "src/wire.h"
+#include "src/pipeline.h"
+#include "src/status.h"
+#include "src/expr.h"
+#include "src/snapshot.h"
+#include "src/stats.h"
+#include "src/latency.h"
+#include "src/trace.h"
 
 /*	Globals					*/
-int sig_flag = 0;
+int sig_flag = 0;		//4 on SIGTERM, 6 on SIGHUP
+long long start_ms = 0;
+const char *state_label = "wsrep_local_state";	//what the raw state in logs is; under state.lock
+
+#define HAWK_MAX_LISTENERS	8
+#define SD_LISTEN_FDS_START	3
+
+//What a listener speaks
+#define LISTEN_HTTP		0
+#define LISTEN_AGENT		1
+#define LISTEN_EVENTS		2
+
+/*	Node State				*/
+enum node_state
+{
+	NODE_WARMING,
+	NODE_SYNCED,
+	NODE_NOT_SYNCED,
+	NODE_UNKNOWN		//only ever computed when answering
+};
+
+//MySQL settings copied out of the dictionary so the poller never touches it
+struct probe_conf
+{
+	char host[256];
+	char user[128];
+	char pass[128];
+	char socket[256];	//Unix socket to probe through, "" for host and port
+	int port;		//0 for the client's default
+	int find_socket;	//mysql:socket = auto; the poller fills in socket
+	int replication;	//hawk:mode = replication: async replica, not Galera
+	char heartbeat[384];	//query for the heartbeat lag in ms, "" for none
+	int max_lag;		//ms of lag past which the replica is down
+	int weight_lag;		//ms of lag at which the weight starts to drop
+	int min_weight;		//weight just short of max_lag
+	int weight_step;	//weights are rounded down to this
+	struct donor_conf donor;	//[donor]: which Donor/Desynced nodes stay up
+	char online_sst[256];	//SST methods that do not block the donor
+	int interval;
+	int timeout;		//ms, applied to connect, read and write
+	int native;		//built-in client instead of libmysqlclient
+};
+
+//How old an answer may get before it is flagged or withheld. Read and
+//reloaded only by the thread that answers checks
+struct reply_conf
+{
+	int interval;
+	int deadline;		//ms a probe may overrun before answers go stale
+	int max_stale;		//ms past which no status is given at all
+	int unknown_code;
+	int request_timeout;	//ms to send a complete request
+	int rate_reply;		//answer over-rate checks instead of resetting
+	int report_interval;	//ms between per-client drop reports
+	int sndbuf;		//SO_SNDBUF for accepted checks, 0 for the default
+	int max_subscribers;
+	int keepalive;		//ms between keepalives to idle subscribers
+};
+
+//Owned by the poller thread; the lock only guards it against reloads.
+//Request handlers read the published snapshot instead.
+struct hawk_state
+{
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	enum node_state node;
+	int weight;
+	long long probed_at;
+	int fresh;		//node was set by a probe of this process
+	long long grace_until;	//restored state is served until then
+	int stop;
+	struct probe_conf probe;
+	struct policy policy;
+	struct breaker breaker;
+	struct expr health;
+	struct hawk_statefile *persist;
+};
+
+struct hawk_state state;
+struct hawk_snapshot_cell published;
+struct reply_conf reply;
+struct admit admission;
+int notify_fd = -1;		//poller -> event loop, on every state change
+int signal_fd = -1;		//SIGTERM and SIGHUP, blocked in every thread
+int memory_locked = 0;		//process:lock_memory took effect
 
 /* 	Get Execution Directory			*/
 char* get_execdir(void)
@@ -54,6 +166,21 @@ char* get_execdir(void)
         }
 }
 
+/*	Monotonic Clock				*/
+long long mono_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+long long mono_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 /*	Basic Functions				*/
 char* concat_str(char *first, ...)
 {
@@ -117,22 +244,6 @@ char* get_config(dictionary *file, char* arg_name)
 	return key;
 }
 
-/*	Signal Handling				*/
-void signal_handler(int sig)
-{
-	switch(sig)
-	{
-		case SIGTERM:
-			sig_flag = 4;
-			break;
-		case SIGHUP:
-			sig_flag = 6;
-			break;
-		default:
-			break;
-	}
-}
-
 /*	User Lookup				*/
 uid_t getid_byName(char *name)
 {
@@ -159,7 +270,7 @@ FILE* open_logs(void)
         errno = 0;
 
 	char *path = concat_str(get_execdir(), "/log/hawkd.log", NULL);
-        log = fopen("./log/hawkd.log", "a");
+        log = fopen(path, "a");
         if(errno || (NULL == log))
         {
                 printf("%s", "FATAL - Failed to open main log file. Exiting...");
@@ -174,21 +285,163 @@ void put_log(FILE *log_file, char *message)
 {
 	//Construct timestamp
 	char ts[20];
-	struct tm *sTm;
+	struct tm sTm;
 	time_t now = time (0);
-	sTm = localtime(&now);
+	localtime_r(&now, &sTm);
 
-	strftime (ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", sTm);
+	strftime (ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &sTm);
 
 	//Write to log file and flush
 	fprintf(log_file, "[%s] %s\n", ts, message);
 	fflush(log_file);
 }
 
+//Reopen in place so the pointer held by the poller thread stays valid
+void reopen_logs(FILE *log)
+{
+	char *path = concat_str(get_execdir(), "/log/hawkd.log", NULL);
+	fflush(log);
+	if (freopen(path, "a", log) == NULL)
+	{
+		exit(1);
+	}
+	free(path);
+}
+
+/*	Listener Options		*/
+//Set per listener in [listen_http], [listen_agent] or [listen_events],
+//falling back to [listen]
+struct listen_conf
+{
+	int reuseaddr;
+	int nodelay;
+	int defer_accept;	//seconds, HTTP only
+	int fastopen;		//queue of pending TFO handshakes, 0 for off
+	int backlog;
+};
+
+const char *listen_names[] = {"http", "agent", "events"};
+
+int listen_getint(dictionary *conf, int kind, const char *key, int def)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "listen:%s", key);
+	def = iniparser_getint(conf, name, def);
+	snprintf(name, sizeof(name), "listen_%s:%s", listen_names[kind], key);
+	return iniparser_getint(conf, name, def);
+}
+
+int read_sysctl(const char *path, int def)
+{
+	FILE *f = fopen(path, "r");
+	int val = def;
+
+	if (f)
+	{
+		if (fscanf(f, "%d", &val) != 1)
+			val = def;
+		fclose(f);
+	}
+	return val;
+}
+
+void load_listen_conf(dictionary *conf, int kind, struct listen_conf *lc)
+{
+	lc->reuseaddr = listen_getint(conf, kind, "reuseaddr", 1);
+	lc->nodelay = listen_getint(conf, kind, "nodelay", 1);
+	//Agent checks and plain event subscribers send nothing; deferring
+	//would hold them until the kernel gives up waiting
+	lc->defer_accept = kind == LISTEN_HTTP ? listen_getint(conf, kind, "defer_accept", 0) : 0;
+	lc->fastopen = listen_getint(conf, kind, "fastopen", 0);
+	//0 sizes it for every check that can be held at once. total_clients
+	//is still honoured for older configurations
+	lc->backlog = listen_getint(conf, kind, "backlog", 0);
+	if (lc->backlog <= 0)
+	{
+		lc->backlog = iniparser_getint(conf, "hawk:total_clients", 0);
+	}
+	if (lc->backlog <= 0)
+	{
+		lc->backlog = iniparser_getint(conf, "limits:max_conns", 1024);
+	}
+	if (lc->backlog <= 0)
+	{
+		lc->backlog = 1024;
+	}
+}
+
+//Append to a note that stops growing once full, rather than writing
+//past it
+static void note_add(char *note, size_t len, size_t *used, const char *fmt, ...)
+{
+	va_list ap;
+	int n = 0;
+
+	if (*used >= len - 1)
+	{
+		return;
+	}
+	va_start(ap, fmt);
+	n = vsnprintf(note + *used, len - *used, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+	{
+		note[*used] = '\0';
+		return;
+	}
+	*used += (size_t)n;
+	if (*used > len - 1)
+	{
+		*used = len - 1;
+	}
+}
+
+//Everything but SO_REUSEADDR, which has to come before bind. A summary
+//for the log goes to note, with anything the kernel refused or caps
+void listen_tune(int fd, struct listen_conf *lc, char *note, size_t len)
+{
+	int somaxconn = read_sysctl("/proc/sys/net/core/somaxconn", 4096);
+	int tfo = read_sysctl("/proc/sys/net/ipv4/tcp_fastopen", 1);
+	size_t used = 0;
+
+	note[0] = '\0';
+	note_add(note, len, &used, "backlog %d", lc->backlog);
+	if (lc->backlog > somaxconn)
+	{
+		note_add(note, len, &used, " (capped to %d by net.core.somaxconn)", somaxconn);
+	}
+	//Accepted sockets inherit these, which io_uring relies on
+	if (lc->nodelay)
+	{
+		if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &lc->nodelay, sizeof(lc->nodelay)) == 0)
+			note_add(note, len, &used, ", nodelay");
+		else
+			note_add(note, len, &used, ", nodelay failed (%s)", strerror(errno));
+	}
+	if (lc->defer_accept > 0)
+	{
+		if (setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &lc->defer_accept, sizeof(lc->defer_accept)) == 0)
+			note_add(note, len, &used, ", defer_accept %ds", lc->defer_accept);
+		else
+			note_add(note, len, &used, ", defer_accept failed (%s)", strerror(errno));
+	}
+	if (lc->fastopen > 0)
+	{
+		if (setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &lc->fastopen, sizeof(lc->fastopen)) != 0)
+			note_add(note, len, &used, ", fastopen failed (%s)", strerror(errno));
+		else if (!(tfo & 2))
+			note_add(note, len, &used, ", fastopen %d (off in net.ipv4.tcp_fastopen)", lc->fastopen);
+		else
+			note_add(note, len, &used, ", fastopen %d", lc->fastopen);
+	}
+}
+
 /*	Initialize Socket		*/
-int socket_init(dictionary *conf)
+int socket_init(dictionary *conf, char *port_key, int kind, char *note, size_t len)
 {
 	char *entry = NULL;
+	struct listen_conf lc;
 
         //Setup socket related structures
         int listenfd = 0;
@@ -196,8 +449,9 @@ int socket_init(dictionary *conf)
         int flags = 0;
 
         char sendBuff[1025];
-        int port = atoi(get_config(conf, "hawk:port"));
-        int backlog = atoi(get_config(conf, "hawk:total_clients"));
+        int port = atoi(get_config(conf, port_key));
+
+        load_listen_conf(conf, kind, &lc);
 
         //Configure socket      
         listenfd = socket(AF_INET, SOCK_STREAM, 0);
@@ -228,6 +482,13 @@ int socket_init(dictionary *conf)
                 exit(1);
         }
 
+        //Checks are now closed gracefully, so a restart finds the port
+        //in TIME_WAIT
+        if (lc.reuseaddr)
+        {
+                setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &lc.reuseaddr, sizeof(lc.reuseaddr));
+        }
+
         memset(&serv_addr, '0', sizeof(serv_addr));
         memset(sendBuff, '0', sizeof(sendBuff));
 
@@ -246,44 +507,244 @@ int socket_init(dictionary *conf)
                 exit(1);
         }
 
-        listen(listenfd, (backlog + 1));
+        listen_tune(listenfd, &lc, note, len);
+        listen(listenfd, lc.backlog);
 
         return listenfd;
 }
 
+/*	Inherit Pre-bound Listeners		*/
+//sd_listen_fds() semantics without libsystemd: LISTEN_PID must name this
+//process and LISTEN_FDS sockets are numbered from SD_LISTEN_FDS_START.
+//A socket named "agent" in LISTEN_FDNAMES speaks the agent-check protocol.
+int listen_fds_inherit(int *fds, int *kinds, int max)
+{
+	char *pid = getenv("LISTEN_PID");
+	char *count = getenv("LISTEN_FDS");
+	char *names = getenv("LISTEN_FDNAMES");
+	char *name = NULL;
+	struct stat st;
+	int total = 0;
+	int found = 0;
+	int flags = 0;
+	int kind = LISTEN_HTTP;
+
+	if (pid == NULL || count == NULL)
+	{
+		return 0;
+	}
+	if (strtol(pid, NULL, 10) != getpid())
+	{
+		return 0;
+	}
+	total = atoi(count);
+
+	//Children must not try to claim the same sockets
+	unsetenv("LISTEN_PID");
+	unsetenv("LISTEN_FDS");
+	unsetenv("LISTEN_FDNAMES");
+
+	names = names ? concat_str(names, NULL) : NULL;
+	name = names;
+	for (int fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + total && found < max; fd++)
+	{
+		kind = LISTEN_HTTP;
+		if (name && strncmp(name, "agent", 5) == 0 && (name[5] == ':' || name[5] == '\0'))
+		{
+			kind = LISTEN_AGENT;
+		}
+		else if (name && strncmp(name, "events", 6) == 0 && (name[6] == ':' || name[6] == '\0'))
+		{
+			kind = LISTEN_EVENTS;
+		}
+		name = name ? strchr(name, ':') : NULL;
+		name = name ? name + 1 : NULL;
+		if (fstat(fd, &st) != 0 || !S_ISSOCK(st.st_mode))
+		{
+			continue;
+		}
+		flags = fcntl(fd, F_GETFD, 0);
+		fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+		flags = fcntl(fd, F_GETFL, 0);
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+		kinds[found] = kind;
+		fds[found++] = fd;
+	}
+	free(names);
+	return found;
+}
+
+/*	Query Columns By Name			*/
+#ifndef HAWK_NO_LIBMYSQL
+//First row of a query, columns picked by name. Returns the number of
+//rows, or -1
+int library_named(MYSQL *curs, const char *sql, const char *const *names, int n, char **cols, char buf[][64])
+{
+	MYSQL_RES *result = NULL;
+	MYSQL_FIELD *fields = NULL;
+	MYSQL_ROW row;
+	int rows = 0;
+
+	for (int i = 0; i < n; i++)
+	{
+		cols[i] = NULL;
+	}
+	if (mysql_query(curs, sql) != 0 || (result = mysql_store_result(curs)) == NULL)
+	{
+		return -1;
+	}
+	fields = mysql_fetch_fields(result);
+	while ((row = mysql_fetch_row(result)))
+	{
+		for (unsigned f = 0; rows == 0 && f < mysql_num_fields(result); f++)
+		{
+			for (int i = 0; i < n; i++)
+			{
+				if (row[f] && strcasecmp(fields[f].name, names[i]) == 0)
+				{
+					snprintf(buf[i], 64, "%s", row[f]);
+					cols[i] = buf[i];
+				}
+			}
+		}
+		rows++;
+	}
+	mysql_free_result(result);
+	return rows;
+}
+#endif
+
+//The same through the built-in client; wider rows are cut short
+#define NAMED_MAX_COLUMNS	128
+#define NAMED_MAX_PICK		8
+
+int native_named(struct wire *w, const char *sql, const char *const *names, int n, char **cols, char buf[][64], long long deadline)
+{
+	struct wire_field f[NAMED_MAX_COLUMNS];
+	int index[NAMED_MAX_PICK];
+	int rows = 0;
+	int rc = 0;
+
+	for (int i = 0; i < n; i++)
+	{
+		cols[i] = NULL;
+	}
+	if (n > NAMED_MAX_PICK || wire_query_columns(w, sql, names, n, index, deadline) < 0)
+	{
+		return -1;
+	}
+	while ((rc = wire_row(w, f, NAMED_MAX_COLUMNS, deadline)) == 1)
+	{
+		for (int i = 0; rows == 0 && i < n; i++)
+		{
+			if (index[i] >= 0 && index[i] < NAMED_MAX_COLUMNS && f[index[i]].data)
+			{
+				snprintf(buf[i], 64, "%.*s", (int)f[index[i]].len, f[index[i]].data);
+				cols[i] = buf[i];
+			}
+		}
+		rows++;
+	}
+	return rc < 0 ? -1 : rows;
+}
+
 /*	Query MySQL/MariaDB WS_REP Status	*/
-char* mysql_status(dictionary *conf, FILE *log)
+#define STATUS_QUERY	"SHOW GLOBAL STATUS LIKE 'wsrep_%'"
+//Only asked of a Donor/Desynced node, with donor handling on
+#define DONOR_QUERY	"SELECT @@wsrep_sst_method, @@wsrep_desync"
+const char *const donor_columns[] = {"@@wsrep_sst_method", "@@wsrep_desync"};
+
+//Whether the donor's SST method is one it keeps serving through, and
+//whether it was desynced by hand. What the server did not say stays -1
+void donor_fill(struct probe_conf *probe, struct hawk_status *st, char **cols)
+{
+	const char *w = probe->online_sst;
+	size_t n = 0;
+
+	if (cols[0])
+	{
+		st->var[VAR_ONLINE_SST] = 0;
+		while (*(w += strspn(w, " ,\t")))
+		{
+			n = strcspn(w, " ,\t");
+			if (n == strlen(cols[0]) && strncasecmp(w, cols[0], n) == 0)
+			{
+				st->var[VAR_ONLINE_SST] = 1;
+				break;
+			}
+			w += n;
+		}
+	}
+	if (cols[1])
+	{
+		st->var[VAR_DESYNCED] = strcasecmp(cols[1], "ON") == 0 || strcmp(cols[1], "1") == 0;
+	}
+}
+
+#ifndef HAWK_NO_LIBMYSQL
+//Fills st from the wsrep status variables; on failure st is left cleared
+int library_status(struct probe_conf *probe, FILE *log, struct hawk_status *st)
 {
 	MYSQL *curs = mysql_init(NULL);
 	MYSQL_ROW row;	
 	char *entry = NULL;
+	char *cols[2];
+	char buf[2][64];
+	unsigned int timeout = (probe->timeout + 999) / 1000;
+	long long began = 0;
+	long long took = 0;
+	int rows = 0;
+
+	status_clear(st);
 
 	if (!curs)
 	{
 		entry = concat_str("ERROR - Could not create MySQL cursor: ", mysql_error(curs), NULL);
 		put_log(log, entry);
 		free(entry);
-		return("0");
+		return -1;
 	}
 
-	if (mysql_real_connect(curs, get_config(conf, "mysql:host"), get_config(conf, "mysql:user"), get_config(conf, "mysql:pass"), "mysql", 0, NULL, 0) == NULL)
+	//Without these a hung server holds the probe for the TCP timeout.
+	//The client library only takes whole seconds
+	mysql_options(curs, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+	mysql_options(curs, MYSQL_OPT_READ_TIMEOUT, &timeout);
+	mysql_options(curs, MYSQL_OPT_WRITE_TIMEOUT, &timeout);
+
+	began = mono_ns();
+	//The library only takes the socket for localhost
+	if (mysql_real_connect(curs, probe->socket[0] ? "localhost" : probe->host, probe->user, probe->pass, "mysql",
+		probe->port, probe->socket[0] ? probe->socket : NULL, 0) == NULL)
 	{
+		HAWK_TRACE2(mysql__connect, (mono_ns() - began) / 1000, 0);
 		entry = concat_str("ERROR - Could not connect to MySQL server: ", mysql_error(curs), NULL);
                 put_log(log, entry);
 		free(entry);
 		mysql_close(curs);
-		return("0");
+		return -1;
 	}
 	
-	if (mysql_query(curs, "SHOW STATUS LIKE 'wsrep_local_state'"))
+	took = mono_ns() - began;
+	HAWK_TRACE2(mysql__connect, took / 1000, 1);
+	latency_record(LAT_PROBE_CONNECT, took);
+
+	began = mono_ns();
+	if (mysql_query(curs, STATUS_QUERY))
 	{
+		HAWK_TRACE2(mysql__query, (mono_ns() - began) / 1000, 0);
 		entry = concat_str("ERROR - Could not execute query on ws_rep status: ", mysql_error(curs), NULL);
                 put_log(log, entry);
 		free(entry);
 		mysql_close(curs);
-      		return("0");
+      		return -1;
   	}
 
+	took = mono_ns() - began;
+	HAWK_TRACE2(mysql__query, took / 1000, 1);
+	latency_record(LAT_PROBE_QUERY, took);
+
+	//The rows are only read off the socket here
+	began = mono_ns();
 	MYSQL_RES *result = mysql_store_result(curs);
 	
 	if (!result)
@@ -292,151 +753,3474 @@ char* mysql_status(dictionary *conf, FILE *log)
                 put_log(log, entry);
 		free(entry);
 		mysql_close(curs);
-		return("0");
+		return -1;
 	}
 	
 	int num_fields = mysql_num_fields(result);
 
-	char *ws_rep_status = NULL;
-
 	while ((row = mysql_fetch_row(result)))
 	{
-		for (int i=0; i < num_fields; i++)
+		if (num_fields >= 2 && row[0])
 		{
-			ws_rep_status =  (row[i]);
+			status_set(st, row[0], row[1]);
 		}
+		rows++;
 	}
+	st->ok = 1;
+	took = mono_ns() - began;
+	HAWK_TRACE2(mysql__result, took / 1000, rows);
+	latency_record(LAT_PROBE_RESULT, took);
 
 	mysql_free_result(result);
+	if (probe->donor.enabled && st->var[VAR_STATE] == 2)
+	{
+		if (library_named(curs, DONOR_QUERY, donor_columns, 2, cols, buf) < 0)
+		{
+			entry = concat_str("ERROR - Could not read donor settings: ", mysql_error(curs), NULL);
+			put_log(log, entry);
+			free(entry);
+		}
+		donor_fill(probe, st, cols);
+	}
 	mysql_close(curs);
-	return ws_rep_status;
+	return 0;
 }
+#endif
 
-/* 	Main Routine				*/
-int main_construct(FILE *log, dictionary *conf, int listenfd)
+//Owned by the poller; holds the built-in client's buffers between probes
+struct wire probe_wire;
+
+//Where the built-in client connects
+int probe_target(struct probe_conf *probe, struct wire_target *target, char *err, size_t len)
 {
-        int connfd = 0;
-        struct sockaddr_in serv_addr;
-        char sendBuff[140];
+	char *path = probe->socket[0] ? probe->socket : NULL;
+	char *port = getenv("MYSQL_TCP_PORT");
 
-        //Start main loop
-        while(1)
-        {
+	//As the client library reads them: localhost means the Unix socket
+	if (!path && strcmp(probe->host, "localhost") == 0)
+	{
+		path = getenv("MYSQL_UNIX_PORT") ? getenv("MYSQL_UNIX_PORT") : "/var/run/mysqld/mysqld.sock";
+	}
+	return wire_target(target, probe->host, probe->port ? probe->port : port ? atoi(port) : 3306, path, err, len);
+}
 
-                //If data is recieved - run mysql_status and write result to socket
-                connfd = accept(listenfd, (struct sockaddr*)NULL, NULL);
+//The same probe through the built-in client. Nothing is allocated
+//unless the host has to be looked up by name or a probe fails. Login
+//gets probe_timeout to the millisecond, and the query with all of its
+//rows gets another
+int native_status(struct probe_conf *probe, FILE *log, struct hawk_status *st)
+{
+	struct wire_target target;
+	struct wire_field f[2];
+	char name[64];
+	char value[64];
+	char entry[256];
+	char *cols[2];
+	char buf[2][64];
+	long long deadline = 0;
+	long long began = 0;
+	long long took = 0;
+	int rows = 0;
+	int rc = 0;
 
-                if (connfd != -1)
-                {
-                        char *message = "HTTP/1.1 503 Service Unavailable\r\nContent-Type: text/plain\r\nConnection: close\r\nContent-Length: 44\r\n\r\nMariaDB Cluster Node is not synced.\r\n";
-                        char *status = mysql_status(conf, log);
+	status_clear(st);
 
-                        if (strncmp("4", status, 1024) == 0)
-                        {
-                                message = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nConnection: close\r\nContent-Length: 40\r\n\r\nMariaDB Cluster Node is synced.\r\n";
-                        }
-                        snprintf(sendBuff, sizeof(sendBuff), "%s\r\n", message);
-                        write(connfd, sendBuff, strlen(sendBuff));
-                }
+	if (probe_target(probe, &target, value, sizeof(value)) != 0)
+	{
+		snprintf(entry, sizeof(entry), "ERROR - Could not connect to MySQL server: %s", value);
+		put_log(log, entry);
+		return -1;
+	}
 
-		//Signal Actions
-		if (sig_flag == 4)
+	began = mono_ns();
+	if (wire_connect(&probe_wire, &target, probe->user, probe->pass, mono_ms() + probe->timeout) != 0)
+	{
+		HAWK_TRACE2(mysql__connect, (mono_ns() - began) / 1000, 0);
+		snprintf(entry, sizeof(entry), "ERROR - Could not connect to MySQL server: %s", probe_wire.error);
+		put_log(log, entry);
+		wire_close(&probe_wire);
+		return -1;
+	}
+	took = mono_ns() - began;
+	HAWK_TRACE2(mysql__connect, took / 1000, 1);
+	latency_record(LAT_PROBE_CONNECT, took);
+
+	began = mono_ns();
+	deadline = mono_ms() + probe->timeout;
+	if (wire_query(&probe_wire, STATUS_QUERY, deadline) < 0)
+	{
+		HAWK_TRACE2(mysql__query, (mono_ns() - began) / 1000, 0);
+		snprintf(entry, sizeof(entry), "ERROR - Could not execute query on ws_rep status: %s", probe_wire.error);
+		put_log(log, entry);
+		wire_close(&probe_wire);
+		return -1;
+	}
+	took = mono_ns() - began;
+	HAWK_TRACE2(mysql__query, took / 1000, 1);
+	latency_record(LAT_PROBE_QUERY, took);
+
+	began = mono_ns();
+	while ((rc = wire_row(&probe_wire, f, 2, deadline)) == 1)
+	{
+		if (f[0].data && f[1].data && f[0].len < sizeof(name) && f[1].len < sizeof(value))
 		{
-			put_log(log, "INFO - Shutting down HAwk...");
-        		put_log(log, "INFO - Releasing Socket");
-        		close(listenfd);
-			//Freeing configuration dictionary
-			iniparser_freedict(conf);
-        		put_log(log, "INFO - Closing Log Files");
-			fflush(log);
-			fclose(log);
-			close(connfd);
-			break;
+			memcpy(name, f[0].data, f[0].len);
+			name[f[0].len] = '\0';
+			memcpy(value, f[1].data, f[1].len);
+			value[f[1].len] = '\0';
+			status_set(st, name, value);
 		}
-		if (sig_flag == 6)
+		rows++;
+	}
+	if (rc < 0)
+	{
+		status_clear(st);
+		snprintf(entry, sizeof(entry), "ERROR - Could not store MySQL result: %s", probe_wire.error);
+		put_log(log, entry);
+		wire_close(&probe_wire);
+		return -1;
+	}
+	st->ok = 1;
+	took = mono_ns() - began;
+	HAWK_TRACE2(mysql__result, took / 1000, rows);
+	latency_record(LAT_PROBE_RESULT, took);
+
+	if (probe->donor.enabled && st->var[VAR_STATE] == 2)
+	{
+		if (native_named(&probe_wire, DONOR_QUERY, donor_columns, 2, cols, buf, deadline) < 0)
 		{
-			put_log(log, "INFO - Received HUP. Reloading...");
-			fflush(log);
-			fclose(log);
-			close(connfd);
-			log = open_logs();
-			put_log(log, "INFO - Successfully reloaded logs");
-			//free(conf);
-			iniparser_freedict(conf);
-			conf = load_conf();
-			sig_flag = 0;	
+			snprintf(entry, sizeof(entry), "ERROR - Could not read donor settings: %s", probe_wire.error);
+			put_log(log, entry);
 		}
-		close(connfd);
-                sleep(1);
-        }
+		donor_fill(probe, st, cols);
+	}
+	wire_close(&probe_wire);
 	return 0;
 }
 
-int main(void)
-{
-        pid_t pid, sid;
-        
-        //Fork off the parent process
-        pid = fork();
-        if (pid < 0) {
-                exit(EXIT_FAILURE);
-        }
-        //If we got a good PID, then we can exit the parent process
-        if (pid > 0) {
-                exit(EXIT_SUCCESS);
-        }
+/*	Query Replication Status		*/
+//SHOW REPLICA STATUS columns, as MySQL 8.0.22 and later name them and
+//as older servers, and MariaDB throughout, do
+const char *const replica_columns[] = {"Replica_IO_Running", "Replica_SQL_Running", "Seconds_Behind_Source",
+	"Slave_IO_Running", "Slave_SQL_Running", "Seconds_Behind_Master"};
+#define REPLICA_COLUMNS		6
+const char *const heartbeat_column[] = {"lag_ms"};
+#define ER_PARSE_ERROR		1064
 
-        //Change the file mode mask
-        umask(0);       
+//Turns the SHOW REPLICA STATUS row and the heartbeat lag into status
+//variables. Columns the server does not have are NULL, as is the row
+//of a server that is not a replica
+void replication_fill(struct hawk_status *st, char **cols, const char *heartbeat)
+{
+	char *io = cols[0] ? cols[0] : cols[3];
+	char *sql = cols[1] ? cols[1] : cols[4];
+	char *behind = cols[2] ? cols[2] : cols[5];
 
-	//Load Configuration File        
-        dictionary *conf = load_conf();
+	st->var[VAR_IO_RUNNING] = io && strcasecmp(io, "Yes") == 0;
+	st->var[VAR_SQL_RUNNING] = sql && strcasecmp(sql, "Yes") == 0;
+	//Seconds_Behind is NULL while either thread is stopped
+	st->var[VAR_LAG] = behind && *behind ? strtoll(behind, NULL, 10) * 1000 : -1;
+	//The heartbeat still tells the truth when the I/O thread has stalled
+	//without noticing
+	if (heartbeat)
+	{
+		st->var[VAR_LAG] = strtoll(heartbeat, NULL, 10);
+	}
+	snprintf(st->state, sizeof(st->state), "%lld", (long long)st->var[VAR_LAG]);
+	st->ok = 1;
+}
 
-        //Opening Log
-	FILE *log = open_logs();
+#ifndef HAWK_NO_LIBMYSQL
+int library_replication(struct probe_conf *probe, FILE *log, struct hawk_status *st)
+{
+	MYSQL *curs = mysql_init(NULL);
+	char *cols[REPLICA_COLUMNS];
+	char *lag[1];
+	char buf[REPLICA_COLUMNS][64];
+	char lag_buf[1][64];
+	char entry[320];
+	unsigned int timeout = (probe->timeout + 999) / 1000;
+	long long began = 0;
+	long long took = 0;
+	int rows = 0;
 
-	//Query for UID/GID
-	uid_t id = getid_byName(get_config(conf, "hawk:daemon_user"));
+	status_clear(st);
+	snprintf(st->state, sizeof(st->state), "-1");
+	if (!curs)
+	{
+		put_log(log, "ERROR - Could not create MySQL cursor");
+		return -1;
+	}
+	mysql_options(curs, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+	mysql_options(curs, MYSQL_OPT_READ_TIMEOUT, &timeout);
+	mysql_options(curs, MYSQL_OPT_WRITE_TIMEOUT, &timeout);
 
-	//Set UID
-	if (setuid(id) != 0)
+	began = mono_ns();
+	if (mysql_real_connect(curs, probe->socket[0] ? "localhost" : probe->host, probe->user, probe->pass, "mysql",
+		probe->port, probe->socket[0] ? probe->socket : NULL, 0) == NULL)
 	{
-		put_log(log, "FATAL - Could not set UID for daemon");
-		exit(1);
+		HAWK_TRACE2(mysql__connect, (mono_ns() - began) / 1000, 0);
+		snprintf(entry, sizeof(entry), "ERROR - Could not connect to MySQL server: %s", mysql_error(curs));
+		put_log(log, entry);
+		mysql_close(curs);
+		return -1;
 	}
-	
-        //Create a new SID for the child process 
-        sid = setsid();
-        if (sid < 0) {
-                put_log(log, "FATAL - Session ID was not set properly");
-                exit(EXIT_FAILURE);
-        }
+	took = mono_ns() - began;
+	HAWK_TRACE2(mysql__connect, took / 1000, 1);
+	latency_record(LAT_PROBE_CONNECT, took);
 
-	//Write PID file
-	if(strcmp(get_config(conf, "hawk:pid_path"),"") > 0)
+	began = mono_ns();
+	rows = library_named(curs, "SHOW REPLICA STATUS", replica_columns, REPLICA_COLUMNS, cols, buf);
+	if (rows < 0 && mysql_errno(curs) == ER_PARSE_ERROR)
 	{
-		FILE *pidfile;
-		pidfile = fopen(get_config(conf, "hawk:pid_path"), "w");
-		fprintf(pidfile, "%d", getpid());
-		fflush(pidfile);
+		rows = library_named(curs, "SHOW SLAVE STATUS", replica_columns, REPLICA_COLUMNS, cols, buf);
 	}
-        
-	//Initialize Socket
-	int listenfd = socket_init(conf);
+	if (rows >= 0 && probe->heartbeat[0] && library_named(curs, probe->heartbeat, heartbeat_column, 1, lag, lag_buf) < 0)
+	{
+		rows = -1;
+	}
+	if (rows < 0)
+	{
+		HAWK_TRACE2(mysql__query, (mono_ns() - began) / 1000, 0);
+		snprintf(entry, sizeof(entry), "ERROR - Could not read replication status: %s", mysql_error(curs));
+		put_log(log, entry);
+		mysql_close(curs);
+		return -1;
+	}
+	took = mono_ns() - began;
+	HAWK_TRACE2(mysql__query, took / 1000, 1);
+	latency_record(LAT_PROBE_QUERY, took);
+	replication_fill(st, cols, probe->heartbeat[0] ? lag[0] : NULL);
+	mysql_close(curs);
+	return 0;
+}
+#endif
 
-        //Close out the standard file descriptors
-        fflush(stdin);
+int native_replication(struct probe_conf *probe, FILE *log, struct hawk_status *st)
+{
+	struct wire_target target;
+	char *cols[REPLICA_COLUMNS];
+	char *lag[1];
+	char buf[REPLICA_COLUMNS][64];
+	char lag_buf[1][64];
+	char err[64];
+	char entry[320];
+	long long deadline = 0;
+	long long began = 0;
+	long long took = 0;
+	int rows = 0;
+
+	status_clear(st);
+	snprintf(st->state, sizeof(st->state), "-1");
+	if (probe_target(probe, &target, err, sizeof(err)) != 0)
+	{
+		snprintf(entry, sizeof(entry), "ERROR - Could not connect to MySQL server: %s", err);
+		put_log(log, entry);
+		return -1;
+	}
+
+	began = mono_ns();
+	if (wire_connect(&probe_wire, &target, probe->user, probe->pass, mono_ms() + probe->timeout) != 0)
+	{
+		HAWK_TRACE2(mysql__connect, (mono_ns() - began) / 1000, 0);
+		snprintf(entry, sizeof(entry), "ERROR - Could not connect to MySQL server: %s", probe_wire.error);
+		put_log(log, entry);
+		wire_close(&probe_wire);
+		return -1;
+	}
+	took = mono_ns() - began;
+	HAWK_TRACE2(mysql__connect, took / 1000, 1);
+	latency_record(LAT_PROBE_CONNECT, took);
+
+	began = mono_ns();
+	deadline = mono_ms() + probe->timeout;
+	rows = native_named(&probe_wire, "SHOW REPLICA STATUS", replica_columns, REPLICA_COLUMNS, cols, buf, deadline);
+	if (rows < 0 && probe_wire.err_no == ER_PARSE_ERROR)
+	{
+		rows = native_named(&probe_wire, "SHOW SLAVE STATUS", replica_columns, REPLICA_COLUMNS, cols, buf, deadline);
+	}
+	if (rows >= 0 && probe->heartbeat[0] && native_named(&probe_wire, probe->heartbeat, heartbeat_column, 1, lag, lag_buf, deadline) < 0)
+	{
+		rows = -1;
+	}
+	if (rows < 0)
+	{
+		HAWK_TRACE2(mysql__query, (mono_ns() - began) / 1000, 0);
+		snprintf(entry, sizeof(entry), "ERROR - Could not read replication status: %s", probe_wire.error);
+		put_log(log, entry);
+		wire_close(&probe_wire);
+		return -1;
+	}
+	took = mono_ns() - began;
+	HAWK_TRACE2(mysql__query, took / 1000, 1);
+	latency_record(LAT_PROBE_QUERY, took);
+	replication_fill(st, cols, probe->heartbeat[0] ? lag[0] : NULL);
+	wire_close(&probe_wire);
+	return 0;
+}
+
+//Option files a packaged server reads its socket and datadir from
+const char *server_cnfs[] = {"/etc/my.cnf", "/etc/mysql/my.cnf", "/etc/mysql/mariadb.conf.d/50-server.cnf",
+	"/etc/my.cnf.d/server.cnf", "/etc/my.cnf.d/mariadb-server.cnf", NULL};
+
+//Pulls socket and datadir out of the server groups of a my.cnf.
+//Includes are not followed; the files above cover the packaged layouts
+void read_server_cnf(const char *file, char *sock, char *datadir, size_t len)
+{
+	FILE *f = fopen(file, "r");
+	char line[512];
+	char *key = NULL;
+	char *val = NULL;
+	char *end = NULL;
+	int server = 0;
+
+	if (!f)
+	{
+		return;
+	}
+	while (fgets(line, sizeof(line), f))
+	{
+		key = line + strspn(line, " \t");
+		key[strcspn(key, "#;\r\n")] = '\0';
+		if (*key == '[')
+		{
+			server = strncmp(key, "[mysqld]", 8) == 0 || strncmp(key, "[server]", 8) == 0
+				|| strncmp(key, "[mariadb]", 9) == 0 || strncmp(key, "[galera]", 8) == 0;
+			continue;
+		}
+		if (!server || !(val = strchr(key, '=')))
+		{
+			continue;
+		}
+		for (end = val; end > key && (end[-1] == ' ' || end[-1] == '\t'); end--);
+		*end = '\0';
+		val += 1 + strspn(val + 1, " \t\"'");
+		val[strcspn(val, " \t\"'")] = '\0';
+		//Later settings win, as they do for the server
+		if (strcmp(key, "socket") == 0)
+		{
+			snprintf(sock, len, "%s", val);
+		}
+		else if (strcmp(key, "datadir") == 0)
+		{
+			snprintf(datadir, len, "%s", val);
+		}
+	}
+	fclose(f);
+}
+
+//Where the local server listens, for mysql:socket = auto: the client's
+//MYSQL_UNIX_PORT, the socket set in the server's option files, the
+//socket in its datadir, then the packaged defaults. Returns 0 with the
+//first that is a socket, -1 if none is
+int find_socket(char *path, size_t len)
+{
+	char sock[256] = "";
+	char datadir[256] = "/var/lib/mysql";
+	char in_datadir[2][300];
+	const char *tried[8];
+	struct stat sb;
+	int n = 0;
+
+	for (int i = 0; server_cnfs[i]; i++)
+	{
+		read_server_cnf(server_cnfs[i], sock, datadir, sizeof(sock));
+	}
+	snprintf(in_datadir[0], sizeof(in_datadir[0]), "%s/mysql.sock", datadir);
+	snprintf(in_datadir[1], sizeof(in_datadir[1]), "%s/mysqld.sock", datadir);
+	tried[n++] = getenv("MYSQL_UNIX_PORT");
+	tried[n++] = sock;
+	tried[n++] = in_datadir[0];
+	tried[n++] = in_datadir[1];
+	tried[n++] = "/run/mysqld/mysqld.sock";
+	tried[n++] = "/var/run/mysqld/mysqld.sock";
+	tried[n++] = "/tmp/mysql.sock";
+	for (int i = 0; i < n; i++)
+	{
+		if (tried[i] && tried[i][0] && strlen(tried[i]) < len && stat(tried[i], &sb) == 0 && S_ISSOCK(sb.st_mode))
+		{
+			snprintf(path, len, "%s", tried[i]);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+//A socket only reaches a server on this host
+int local_host(const char *host)
+{
+	return !host[0] || strcmp(host, "localhost") == 0 || strcmp(host, "127.0.0.1") == 0 || strcmp(host, "::1") == 0;
+}
+
+int mysql_status(struct probe_conf *probe, FILE *log, struct hawk_status *st)
+{
+#ifndef HAWK_NO_LIBMYSQL
+	if (!probe->native)
+	{
+		return probe->replication ? library_replication(probe, log, st) : library_status(probe, log, st);
+	}
+#endif
+	return probe->replication ? native_replication(probe, log, st) : native_status(probe, log, st);
+}
+
+/*	Check Pipeline				*/
+struct pipeline checks;
+
+//What the SQL stages connect with. The poller refreshes it every round,
+//once it knows which socket to use
+struct probe_conf check_probe;
+pthread_mutex_t check_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//Buffers of the built-in client, one per stage as stages run at once
+struct wire check_wires[PIPELINE_STAGES];
+
+//Takes one row of a check query: up to two columns, NULL for SQL NULL
+typedef void (*row_fn)(void *arg, char **fields, int n);
+
+#ifndef HAWK_NO_LIBMYSQL
+int library_rows(struct probe_conf *probe, int timeout, const char *sql, row_fn fn, void *arg, char *err, size_t len)
+{
+	MYSQL *curs = mysql_init(NULL);
+	MYSQL_RES *result = NULL;
+	MYSQL_ROW row;
+	unsigned int secs = (timeout + 999) / 1000;
+	int n = 0;
+
+	if (!curs)
+	{
+		snprintf(err, len, "could not create MySQL cursor");
+		return -1;
+	}
+	mysql_options(curs, MYSQL_OPT_CONNECT_TIMEOUT, &secs);
+	mysql_options(curs, MYSQL_OPT_READ_TIMEOUT, &secs);
+	mysql_options(curs, MYSQL_OPT_WRITE_TIMEOUT, &secs);
+	if (mysql_real_connect(curs, probe->socket[0] ? "localhost" : probe->host, probe->user, probe->pass, "mysql",
+		probe->port, probe->socket[0] ? probe->socket : NULL, 0) == NULL
+		|| mysql_query(curs, sql) != 0)
+	{
+		snprintf(err, len, "%s", mysql_error(curs));
+		mysql_close(curs);
+		return -1;
+	}
+	//A statement without rows leaves no result and no error
+	result = mysql_store_result(curs);
+	if (!result && mysql_field_count(curs) != 0)
+	{
+		snprintf(err, len, "%s", mysql_error(curs));
+		mysql_close(curs);
+		return -1;
+	}
+	if (result)
+	{
+		n = mysql_num_fields(result) < 2 ? mysql_num_fields(result) : 2;
+		while ((row = mysql_fetch_row(result)))
+		{
+			fn(arg, row, n);
+		}
+		mysql_free_result(result);
+	}
+	mysql_close(curs);
+	return 0;
+}
+#endif
+
+//One deadline covers the login, the query and its rows
+int native_rows(struct probe_conf *probe, struct wire *w, int timeout, const char *sql, row_fn fn, void *arg, char *err, size_t len)
+{
+	struct wire_target target;
+	struct wire_field f[2];
+	char value[2][128];
+	char *fields[2];
+	long long deadline = mono_ms() + timeout;
+	int n = 0;
+	int rc = 0;
+
+	if (probe_target(probe, &target, err, len) != 0)
+	{
+		return -1;
+	}
+	if (wire_connect(w, &target, probe->user, probe->pass, deadline) != 0 || (n = wire_query(w, sql, deadline)) < 0)
+	{
+		snprintf(err, len, "%s", w->error);
+		wire_close(w);
+		return -1;
+	}
+	n = n < 2 ? n : 2;
+	while (n > 0 && (rc = wire_row(w, f, n, deadline)) == 1)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			fields[i] = NULL;
+			if (f[i].data)
+			{
+				snprintf(value[i], sizeof(value[i]), "%.*s", (int)f[i].len, f[i].data);
+				fields[i] = value[i];
+			}
+		}
+		fn(arg, fields, n);
+	}
+	if (rc < 0)
+	{
+		snprintf(err, len, "%s", w->error);
+		wire_close(w);
+		return -1;
+	}
+	wire_close(w);
+	return 0;
+}
+
+int check_rows(struct wire *w, int timeout, const char *sql, row_fn fn, void *arg, char *err, size_t len)
+{
+	struct probe_conf probe;
+
+	pthread_mutex_lock(&check_lock);
+	probe = check_probe;
+	pthread_mutex_unlock(&check_lock);
+#ifndef HAWK_NO_LIBMYSQL
+	if (!probe.native)
+	{
+		return library_rows(&probe, timeout, sql, fn, arg, err, len);
+	}
+#endif
+	return native_rows(&probe, w, timeout, sql, fn, arg, err, len);
+}
+
+//read_only and super_read_only rows; MariaDB has no super_read_only
+void read_only_row(void *arg, char **fields, int n)
+{
+	struct stage_result *res = arg;
+
+	if (n == 2 && fields[0] && fields[1] && (strcasecmp(fields[0], "read_only") == 0 || strcasecmp(fields[0], "super_read_only") == 0))
+	{
+		if (res->value < 0)
+		{
+			res->value = 0;
+		}
+		if (strcasecmp(fields[1], "ON") == 0 || strcmp(fields[1], "1") == 0)
+		{
+			res->value = 1;
+			snprintf(res->detail, sizeof(res->detail), "%s is ON", fields[0]);
+		}
+	}
+}
+
+int check_read_only(void *ctx, const struct stage_conf *conf, struct stage_result *res)
+{
+	char err[128];
+
+	if (check_rows(ctx, conf->timeout, "SHOW GLOBAL VARIABLES LIKE '%read_only'", read_only_row, res, err, sizeof(err)) != 0)
+	{
+		res->value = -1;
+		snprintf(res->detail, sizeof(res->detail), "%s", err);
+		return STAGE_FAIL;
+	}
+	if (res->value < 0)
+	{
+		snprintf(res->detail, sizeof(res->detail), "server has no read_only variable");
+		return STAGE_FAIL;
+	}
+	return res->value ? STAGE_FAIL : STAGE_PASS;
+}
+
+//First column of the first row
+struct sql_answer
+{
+	int rows;
+	char value[128];
+};
+
+void sql_row(void *arg, char **fields, int n)
+{
+	struct sql_answer *answer = arg;
+
+	if (answer->rows++ == 0 && n > 0)
+	{
+		snprintf(answer->value, sizeof(answer->value), "%s", fields[0] ? fields[0] : "NULL");
+	}
+}
+
+int check_sql(void *ctx, const struct stage_conf *conf, struct stage_result *res)
+{
+	struct sql_answer answer;
+	char err[128];
+
+	memset(&answer, 0, sizeof(answer));
+	if (check_rows(ctx, conf->timeout, conf->arg, sql_row, &answer, err, sizeof(err)) != 0)
+	{
+		snprintf(res->detail, sizeof(res->detail), "%s", err);
+		return STAGE_FAIL;
+	}
+	res->value = answer.rows && strcmp(answer.value, conf->expect) == 0;
+	if (!answer.rows)
+	{
+		snprintf(res->detail, sizeof(res->detail), "no rows, expected \"%.60s\"", conf->expect);
+	}
+	else if (!res->value)
+	{
+		snprintf(res->detail, sizeof(res->detail), "got \"%.60s\", expected \"%.60s\"", answer.value, conf->expect);
+	}
+	return res->value ? STAGE_PASS : STAGE_FAIL;
+}
+
+void check_enter(void)
+{
+#ifndef HAWK_NO_LIBMYSQL
+	mysql_thread_init();
+#endif
+}
+
+/*	Process Setup				*/
+//Parses "0,2-3" into set. Returns the number of CPUs, -1 if malformed
+int parse_cpus(const char *list, cpu_set_t *set)
+{
+	char *end = NULL;
+	long from = 0;
+	long to = 0;
+	int n = 0;
+
+	CPU_ZERO(set);
+	while (*list)
+	{
+		from = strtol(list, &end, 10);
+		if (end == list || from < 0 || from >= CPU_SETSIZE)
+		{
+			return -1;
+		}
+		to = from;
+		if (*end == '-')
+		{
+			list = end + 1;
+			to = strtol(list, &end, 10);
+			if (end == list || to < from || to >= CPU_SETSIZE)
+			{
+				return -1;
+			}
+		}
+		for (long cpu = from; cpu <= to; cpu++)
+		{
+			CPU_SET(cpu, set);
+			n++;
+		}
+		if (*end != ',' && *end != '\0')
+		{
+			return -1;
+		}
+		list = *end ? end + 1 : end;
+	}
+	return n;
+}
+
+//Touch stack the loop may need later so it is resident when locked
+void prefault_stack(void)
+{
+	volatile char pad[256 * 1024];
+
+	for (size_t i = 0; i < sizeof(pad); i += 4096)
+	{
+		pad[i] = 0;
+	}
+}
+
+//Affinity, scheduling and memory locking from [process]. Runs as root
+//before any thread starts; threads inherit all of it. Failures are
+//logged and the daemon carries on without that setting.
+void process_init(dictionary *conf, FILE *log)
+{
+	char *cpus = iniparser_getstring(conf, "process:cpus", "");
+	char *policy = iniparser_getstring(conf, "process:sched", "other");
+	int nice = iniparser_getint(conf, "process:nice", 0);
+	struct sched_param sp;
+	struct rlimit memlock;
+	char entry[160];
+	cpu_set_t set;
+	int sched = SCHED_OTHER;
+
+	if (*cpus)
+	{
+		if (parse_cpus(cpus, &set) <= 0)
+		{
+			snprintf(entry, sizeof(entry), "ERROR - Invalid process:cpus \"%s\"", cpus);
+			put_log(log, entry);
+		}
+		else if (sched_setaffinity(0, sizeof(set), &set) != 0)
+		{
+			snprintf(entry, sizeof(entry), "ERROR - Could not pin to CPUs %s: %s", cpus, strerror(errno));
+			put_log(log, entry);
+		}
+	}
+
+	memset(&sp, 0, sizeof(sp));
+	if (strcmp(policy, "fifo") == 0)
+		sched = SCHED_FIFO;
+	else if (strcmp(policy, "rr") == 0)
+		sched = SCHED_RR;
+	else if (strcmp(policy, "batch") == 0)
+		sched = SCHED_BATCH;
+	else if (strcmp(policy, "idle") == 0)
+		sched = SCHED_IDLE;
+	else if (strcmp(policy, "other") != 0)
+	{
+		snprintf(entry, sizeof(entry), "ERROR - Unknown process:sched \"%s\", using other", policy);
+		put_log(log, entry);
+	}
+	if (sched == SCHED_FIFO || sched == SCHED_RR)
+	{
+		sp.sched_priority = iniparser_getint(conf, "process:priority", 1);
+	}
+	if (sched != SCHED_OTHER && sched_setscheduler(0, sched, &sp) != 0)
+	{
+		snprintf(entry, sizeof(entry), "ERROR - Could not set scheduling policy %s: %s", policy, strerror(errno));
+		put_log(log, entry);
+	}
+	if (nice != 0 && setpriority(PRIO_PROCESS, 0, nice) != 0)
+	{
+		snprintf(entry, sizeof(entry), "ERROR - Could not set nice %d: %s", nice, strerror(errno));
+		put_log(log, entry);
+	}
+
+	if (!iniparser_getint(conf, "process:lock_memory", 0))
+	{
+		return;
+	}
+	//Freed memory stays in the one heap for reuse instead of being
+	//handed back and faulted in again, and the lock outlives dropping
+	//root
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+	mallopt(M_ARENA_MAX, 1);
+	memlock.rlim_cur = memlock.rlim_max = RLIM_INFINITY;
+	setrlimit(RLIMIT_MEMLOCK, &memlock);
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+	{
+		snprintf(entry, sizeof(entry), "ERROR - Could not lock memory: %s", strerror(errno));
+		put_log(log, entry);
+		return;
+	}
+	prefault_stack();
+	memory_locked = 1;
+	put_log(log, "INFO - Memory locked");
+}
+
+/*	Shared State				*/
+void load_probe_conf(dictionary *conf, struct probe_conf *probe)
+{
+	snprintf(probe->host, sizeof(probe->host), "%s", get_config(conf, "mysql:host"));
+	snprintf(probe->user, sizeof(probe->user), "%s", get_config(conf, "mysql:user"));
+	snprintf(probe->pass, sizeof(probe->pass), "%s", get_config(conf, "mysql:pass"));
+	snprintf(probe->socket, sizeof(probe->socket), "%s", iniparser_getstring(conf, "mysql:socket", ""));
+	probe->port = iniparser_getint(conf, "mysql:port", 0);
+	probe->find_socket = strcmp(probe->socket, "auto") == 0;
+	if (probe->find_socket)
+	{
+		probe->socket[0] = '\0';
+	}
+	probe->interval = iniparser_getint(conf, "hawk:probe_interval", 1000);
+	if (probe->interval < 1)
+	{
+		probe->interval = 1;
+	}
+	probe->timeout = iniparser_getint(conf, "hawk:probe_timeout", 5000);
+	if (probe->timeout < 1)
+	{
+		probe->timeout = 1;
+	}
+#ifdef HAWK_NO_LIBMYSQL
+	probe->native = 1;
+#else
+	probe->native = strcmp(iniparser_getstring(conf, "mysql:client", "library"), "native") == 0;
+#endif
+	probe->replication = strcmp(iniparser_getstring(conf, "hawk:mode", "galera"), "replication") == 0;
+	state_label = probe->replication ? "replication lag ms" : "wsrep_local_state";
+	probe->heartbeat[0] = '\0';
+	if (strlen(iniparser_getstring(conf, "replication:heartbeat_table", "")) > 0)
+	{
+		//pt-heartbeat keeps the source's clock in ts, as local time
+		//unless it runs with --utc
+		snprintf(probe->heartbeat, sizeof(probe->heartbeat), "SELECT TIMESTAMPDIFF(MICROSECOND, MAX(ts), %s) DIV 1000 AS lag_ms FROM %s",
+			iniparser_getint(conf, "replication:heartbeat_utc", 0) ? "UTC_TIMESTAMP(6)" : "NOW(6)",
+			iniparser_getstring(conf, "replication:heartbeat_table", ""));
+	}
+	probe->max_lag = iniparser_getint(conf, "replication:max_lag", 30000);
+	probe->weight_lag = iniparser_getint(conf, "replication:weight_lag", 1000);
+	probe->min_weight = iniparser_getint(conf, "replication:min_weight", 10);
+	probe->weight_step = iniparser_getint(conf, "replication:weight_step", 5);
+	if (probe->weight_lag > probe->max_lag)
+	{
+		probe->weight_lag = probe->max_lag;
+	}
+	if (probe->min_weight < 1 || probe->min_weight > 100)
+	{
+		probe->min_weight = probe->min_weight < 1 ? 1 : 100;
+	}
+	if (probe->weight_step < 1)
+	{
+		probe->weight_step = 1;
+	}
+
+	probe->donor.enabled = iniparser_getint(conf, "donor:enabled", 0) && !probe->replication;
+	probe->donor.weight = iniparser_getint(conf, "donor:weight", 50);
+	//down, or the weight percent to serve at
+	probe->donor.desynced = strcmp(iniparser_getstring(conf, "donor:desynced", "down"), "down") == 0 ? 0 : iniparser_getint(conf, "donor:desynced", 0);
+	probe->donor.last_node = iniparser_getint(conf, "donor:last_node", 1);
+	snprintf(probe->online_sst, sizeof(probe->online_sst), "%s", iniparser_getstring(conf, "donor:online_sst", "xtrabackup xtrabackup-v2 mariabackup"));
+	if (probe->donor.weight < 0 || probe->donor.weight > 100)
+	{
+		probe->donor.weight = probe->donor.weight < 0 ? 0 : 100;
+	}
+	if (probe->donor.desynced < 0 || probe->donor.desynced > 100)
+	{
+		probe->donor.desynced = probe->donor.desynced < 0 ? 0 : 100;
+	}
+}
+
+void load_reply_conf(dictionary *conf, struct reply_conf *rc)
+{
+	rc->interval = iniparser_getint(conf, "hawk:probe_interval", 1000);
+	rc->deadline = iniparser_getint(conf, "hawk:response_deadline", 2000);
+	rc->max_stale = iniparser_getint(conf, "hawk:max_stale", 30000);
+	rc->unknown_code = iniparser_getint(conf, "hawk:unknown_code", 504);
+	if (rc->unknown_code < 100 || rc->unknown_code > 599)
+	{
+		rc->unknown_code = 504;
+	}
+	rc->request_timeout = iniparser_getint(conf, "limits:request_timeout", 2000);
+	rc->rate_reply = strcmp(iniparser_getstring(conf, "limits:over_rate", "reply"), "reset") != 0;
+	rc->report_interval = iniparser_getint(conf, "limits:report_interval", 60) * 1000;
+	rc->sndbuf = iniparser_getint(conf, "limits:sndbuf", 0);
+	rc->max_subscribers = iniparser_getint(conf, "events:max_subscribers", 4096);
+	rc->keepalive = iniparser_getint(conf, "events:keepalive", 15) * 1000;
+	//Per-phase histograms on /metrics; the tracepoints are always there
+	latency_enable(iniparser_getint(conf, "hawk:latency_stats", 0));
+}
+
+void load_policy_conf(dictionary *conf, struct policy_conf *pc)
+{
+	pc->rise = iniparser_getint(conf, "policy:rise", 1);
+	pc->fall = iniparser_getint(conf, "policy:fall", 1);
+	pc->half_life = iniparser_getint(conf, "policy:half_life", 0);
+	pc->suppress = iniparser_getint(conf, "policy:suppress", 0);
+	pc->reuse = iniparser_getint(conf, "policy:reuse", 0);
+	pc->max_penalty = iniparser_getint(conf, "policy:max_penalty", 0);
+	pc->penalty[0] = iniparser_getint(conf, "policy:penalty_failed", 1000);
+	pc->penalty[1] = iniparser_getint(conf, "policy:penalty_joining", 1000);
+	pc->penalty[2] = iniparser_getint(conf, "policy:penalty_donor", 500);
+	pc->penalty[3] = iniparser_getint(conf, "policy:penalty_joined", 1000);
+	pc->penalty[4] = iniparser_getint(conf, "policy:penalty_synced", 0);
+}
+
+//Stage settings live in [check_<stage>]
+char *check_getstring(dictionary *conf, int id, const char *key, char *def)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "check_%s:%s", stage_names[id], key);
+	return iniparser_getstring(conf, name, def);
+}
+
+int check_getint(dictionary *conf, int id, const char *key, int def)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "check_%s:%s", stage_names[id], key);
+	return iniparser_getint(conf, name, def);
+}
+
+void load_checks(dictionary *conf, FILE *log)
+{
+	//Cache and failure defaults, same order as the stages
+	static const int ttls[PIPELINE_STAGES] = {0, 10000, 0, 5000};
+	static const int on_fails[PIPELINE_STAGES] = {STAGE_DOWN, STAGE_DOWN, STAGE_DOWN, 50};
+	struct stage_conf sc;
+	char sock[256] = "";
+	char datadir[256] = "/var/lib/mysql";
+	char entry[160];
+	char how[32];
+	char *on_fail = NULL;
+	stage_fn run = NULL;
+
+	for (int i = 0; i < PIPELINE_STAGES; i++)
+	{
+		memset(&sc, 0, sizeof(sc));
+		sc.enabled = check_getint(conf, i, "enabled", 0);
+		sc.timeout = check_getint(conf, i, "timeout", iniparser_getint(conf, "hawk:probe_timeout", 5000));
+		sc.ttl = check_getint(conf, i, "ttl", ttls[i]);
+		if (sc.timeout < 1)
+		{
+			sc.timeout = 1;
+		}
+		on_fail = check_getstring(conf, i, "on_fail", NULL);
+		sc.on_fail = on_fails[i];
+		if (on_fail)
+		{
+			sc.on_fail = strcmp(on_fail, "down") == 0 ? STAGE_DOWN : atoi(on_fail);
+		}
+		if (sc.on_fail > 100)
+		{
+			sc.on_fail = 100;
+		}
+		switch (i)
+		{
+			case STAGE_READ_ONLY:
+				sc.mysql = 1;
+				run = check_read_only;
+				break;
+			case STAGE_DISK:
+				for (int f = 0; server_cnfs[f]; f++)
+				{
+					read_server_cnf(server_cnfs[f], sock, datadir, sizeof(datadir));
+				}
+				snprintf(sc.arg, sizeof(sc.arg), "%s", check_getstring(conf, i, "path", datadir));
+				sc.limit = check_getint(conf, i, "min_free", 5);
+				run = stage_disk;
+				break;
+			case STAGE_SQL:
+				sc.mysql = 1;
+				snprintf(sc.arg, sizeof(sc.arg), "%s", check_getstring(conf, i, "query", ""));
+				snprintf(sc.expect, sizeof(sc.expect), "%s", check_getstring(conf, i, "expect", "1"));
+				if (sc.enabled && !sc.arg[0])
+				{
+					put_log(log, "ERROR - check_sql:query is not set; the SQL check is off");
+					sc.enabled = 0;
+				}
+				run = check_sql;
+				break;
+			case STAGE_LOAD:
+				sc.limit = (long long)(iniparser_getdouble(conf, "check_load:max", 2.0) * 100);
+				run = stage_load;
+				break;
+		}
+		if (sc.enabled)
+		{
+			snprintf(how, sizeof(how), "caps the weight at %d%%", sc.on_fail);
+			snprintf(entry, sizeof(entry), "INFO - Check %s: timeout %d ms, reused for %d ms, %s on failure",
+				stage_names[i], sc.timeout, sc.ttl, sc.on_fail == STAGE_DOWN ? "takes the node down" : how);
+			put_log(log, entry);
+		}
+		pipeline_configure(&checks, i, &sc, run, &check_wires[i]);
+	}
+}
+
+void load_breaker_conf(dictionary *conf, struct breaker_conf *bc)
+{
+	bc->failures = iniparser_getint(conf, "breaker:failures", 0);
+	bc->backoff_min = iniparser_getint(conf, "breaker:backoff_min", 1000);
+	bc->backoff_max = iniparser_getint(conf, "breaker:backoff_max", 30000);
+	bc->jitter = iniparser_getint(conf, "breaker:jitter", 20);
+	if (bc->backoff_min < 1)
+	{
+		bc->backoff_min = 1;
+	}
+	if (bc->backoff_max < bc->backoff_min)
+	{
+		bc->backoff_max = bc->backoff_min;
+	}
+}
+
+//Compiles policy:health; the previous rule is kept when it does not compile
+int load_health_rule(dictionary *conf, FILE *log, struct expr *health)
+{
+	struct expr compiled;
+	//A replica is fit while both threads run; lag is handled apart
+	char *rule = iniparser_getstring(conf, "policy:health",
+		strcmp(iniparser_getstring(conf, "hawk:mode", "galera"), "replication") == 0 ? "io_running && sql_running" : "state == 4");
+	char *entry = NULL;
+	char err[96];
+
+	if (expr_compile(&compiled, rule, status_var_names, STATUS_VARS, err, sizeof(err)) != 0)
+	{
+		entry = concat_str("ERROR - Invalid health rule \"", rule, "\": ", err, NULL);
+		put_log(log, entry);
+		free(entry);
+		return -1;
+	}
+	*health = compiled;
+	return 0;
+}
+
+/*	HAProxy Push				*/
+#define HAWK_MAX_RUNTIME	8
+
+//Desired state for the pusher thread. Only the latest one matters, so
+//changes that arrive while a push is in progress are coalesced
+struct push_state
+{
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	int node;
+	int weight;
+	unsigned long long generation;	//bumped on every change of node/weight
+	int stop;
+	struct runtime_sock socks[HAWK_MAX_RUNTIME];
+	int nsocks;
+	char servers[512];		//"backend/server" names, comma separated
+	char down_state[16];
+	int batch;			//ms to wait for more changes
+	int retries;
+	int retry_delay;		//ms, doubled on each retry
+	int retry_interval;		//ms before a socket that failed is tried again
+	int timeout;			//ms per exchange
+};
+
+struct push_state push;
+
+int push_init(dictionary *conf, FILE *log)
+{
+	pthread_condattr_t attr;
+	char *sockets = iniparser_getstring(conf, "haproxy:sockets", "");
+	char *spec = NULL;
+	char *save = NULL;
+	char *list = NULL;
+	char *entry = NULL;
+
+	memset(&push, 0, sizeof(push));
+	pthread_mutex_init(&push.lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&push.wake, &attr);
+	pthread_condattr_destroy(&attr);
+	snprintf(push.servers, sizeof(push.servers), "%s", iniparser_getstring(conf, "haproxy:servers", ""));
+	snprintf(push.down_state, sizeof(push.down_state), "%s", iniparser_getstring(conf, "haproxy:down_state", "drain"));
+	push.batch = iniparser_getint(conf, "haproxy:batch", 20);
+	push.retries = iniparser_getint(conf, "haproxy:retries", 3);
+	push.retry_delay = iniparser_getint(conf, "haproxy:retry_delay", 100);
+	push.retry_interval = iniparser_getint(conf, "haproxy:retry_interval", 5000);
+	push.timeout = iniparser_getint(conf, "haproxy:timeout", 1000);
+	push.node = NODE_WARMING;
+
+	list = concat_str(sockets, NULL);
+	for (spec = strtok_r(list, ",", &save); spec && push.nsocks < HAWK_MAX_RUNTIME; spec = strtok_r(NULL, ",", &save))
+	{
+		if (runtime_parse(&push.socks[push.nsocks], spec) != 0)
+		{
+			entry = concat_str("ERROR - Ignoring HAProxy socket \"", spec, "\"", NULL);
+			put_log(log, entry);
+			free(entry);
+			continue;
+		}
+		push.nsocks++;
+	}
+	free(list);
+	if (push.nsocks > 0 && strlen(push.servers) == 0)
+	{
+		put_log(log, "ERROR - haproxy:sockets is set but haproxy:servers is not; not pushing");
+		push.nsocks = 0;
+	}
+	return push.nsocks;
+}
+
+//Called with the new published state; cheap when nothing changed
+void push_want(int node, int weight)
+{
+	if (push.nsocks == 0)
+	{
+		return;
+	}
+	pthread_mutex_lock(&push.lock);
+	if (node != push.node || weight != push.weight)
+	{
+		push.node = node;
+		push.weight = weight;
+		push.generation++;
+		pthread_cond_signal(&push.wake);
+	}
+	pthread_mutex_unlock(&push.lock);
+}
+
+//One line for every configured server, e.g.
+//"set server be/db1 state ready;set server be/db1 weight 100"
+//Returns the number of servers whose commands did not fit and were left
+//out; a command is never sent cut short
+int push_commands(char *out, size_t len, int node, int weight)
+{
+	char servers[512];
+	char *server = NULL;
+	char *save = NULL;
+	size_t used = 0;
+	int dropped = 0;
+	int n = 0;
+
+	out[0] = '\0';
+	snprintf(servers, sizeof(servers), "%s", push.servers);
+	for (server = strtok_r(servers, ", \t", &save); server; server = strtok_r(NULL, ", \t", &save))
+	{
+		//Weights are percentages throughout, so HAProxy scales them
+		//against the weight configured for the server
+		if (node == NODE_SYNCED)
+		{
+			n = snprintf(out + used, len - used, "%sset server %s state ready;set server %s weight %d%%", used ? ";" : "", server, server, weight);
+		}
+		else
+		{
+			n = snprintf(out + used, len - used, "%sset server %s state %s", used ? ";" : "", server, push.down_state);
+		}
+		if (n < 0 || (size_t)n >= len - used)
+		{
+			out[used] = '\0';
+			dropped++;
+			continue;
+		}
+		used += n;
+	}
+	return dropped;
+}
+
+void* pusher_main(void *arg)
+{
+	FILE *log = arg;
+	struct timespec until;
+	char cmds[2048];
+	char err[HAWK_MAX_RUNTIME][160];
+	int result[HAWK_MAX_RUNTIME];
+	int tried[HAWK_MAX_RUNTIME];
+	char entry[sizeof(push.socks[0].spec) + sizeof(err[0]) + 64];
+	unsigned long long generation = 0;
+	long long retry_at = 0;
+	long long started = 0;
+	int node = 0;
+	int weight = 0;
+	int pending = 0;
+	int failed = 0;
+	int sent = 0;
+	int dropped = 0;
+
+	pthread_mutex_lock(&push.lock);
+	while (!push.stop)
+	{
+		//Sleep until a change arrives or a failed socket is due again
+		pending = 0;
+		for (int i = 0; i < push.nsocks; i++)
+		{
+			pending |= push.generation && push.socks[i].pushed != push.generation;
+		}
+		if (!pending)
+		{
+			pthread_cond_wait(&push.wake, &push.lock);
+			continue;
+		}
+		if (retry_at && mono_ms() < retry_at && push.generation == generation)
+		{
+			until.tv_sec = retry_at / 1000;
+			until.tv_nsec = (retry_at % 1000) * 1000000;
+			pthread_cond_timedwait(&push.wake, &push.lock, &until);
+			continue;
+		}
+
+		//Give a burst of changes a moment to settle into one batch
+		if (push.batch > 0 && push.generation != generation)
+		{
+			started = mono_ms() + push.batch;
+			until.tv_sec = started / 1000;
+			until.tv_nsec = (started % 1000) * 1000000;
+			while (!push.stop && mono_ms() < started)
+			{
+				pthread_cond_timedwait(&push.wake, &push.lock, &until);
+			}
+		}
+		generation = push.generation;
+		node = push.node;
+		weight = push.weight;
+		pthread_mutex_unlock(&push.lock);
+
+		if ((dropped = push_commands(cmds, sizeof(cmds), node, weight)) > 0)
+		{
+			snprintf(entry, sizeof(entry), "ERROR - Commands for %d HAProxy server(s) do not fit in one batch, not pushed", dropped);
+			put_log(log, entry);
+		}
+		started = mono_ms();
+		memset(tried, 0, sizeof(tried));
+
+		//Every socket gets a try before any is retried, so one dead
+		//HAProxy does not hold up the others
+		for (int attempt = 0; attempt <= push.retries && !push.stop; attempt++)
+		{
+			pending = 0;
+			if (attempt > 0)
+			{
+				usleep((useconds_t)push.retry_delay * 1000 << (attempt - 1));
+			}
+			for (int i = 0; i < push.nsocks; i++)
+			{
+				if (push.socks[i].pushed == generation)
+				{
+					continue;
+				}
+				tried[i] = 1;
+				result[i] = runtime_send(&push.socks[i], cmds, push.timeout, err[i], sizeof(err[i]));
+				if (result[i] >= 0)
+				{
+					//Refused commands are not retried either
+					push.socks[i].pushed = generation;
+				}
+				else
+				{
+					pending++;
+				}
+			}
+			if (!pending)
+			{
+				break;
+			}
+		}
+
+		failed = 0;
+		sent = 0;
+		for (int i = 0; i < push.nsocks; i++)
+		{
+			if (!tried[i])
+			{
+				continue;
+			}
+			sent++;
+			if (result[i] == 0)
+			{
+				if (push.socks[i].failures > 0)
+				{
+					snprintf(entry, sizeof(entry), "INFO - HAProxy at %s is reachable again", push.socks[i].spec);
+					put_log(log, entry);
+				}
+				push.socks[i].failures = 0;
+				stats_inc(STAT_PUSHES);
+				continue;
+			}
+			failed++;
+			stats_inc(STAT_PUSH_FAILURES);
+			//Unreachable sockets are logged once, not on every retry
+			if (result[i] > 0 || push.socks[i].failures++ == 0)
+			{
+				snprintf(entry, sizeof(entry), "ERROR - Could not push state to HAProxy at %s: %.*s", push.socks[i].spec, (int)sizeof(err[i]) - 1, err[i]);
+				put_log(log, entry);
+			}
+		}
+		if (failed < sent)
+		{
+			snprintf(entry, sizeof(entry), "INFO - Pushed %s to %d of %d HAProxy socket(s) in %lld ms",
+				(node == NODE_SYNCED) ? "ready" : push.down_state, sent - failed, sent, mono_ms() - started);
+			put_log(log, entry);
+		}
+
+		pthread_mutex_lock(&push.lock);
+		retry_at = failed ? mono_ms() + push.retry_interval : 0;
+	}
+	pthread_mutex_unlock(&push.lock);
+	for (int i = 0; i < push.nsocks; i++)
+	{
+		runtime_close(&push.socks[i]);
+	}
+	return NULL;
+}
+
+//Caller holds state.lock; the poller is the only writer once running
+void state_publish(struct hawk_status *st)
+{
+	struct hawk_snapshot snap;
+	uint64_t one = 1;
+
+	memset(&snap, 0, sizeof(snap));
+	snap.node = state.node;
+	snap.weight = state.weight;
+	snap.fresh = state.fresh;
+	snap.breaker = state.breaker.state;
+	snap.probed_at = state.probed_at;
+	snap.grace_until = state.grace_until;
+	snap.generation = published.data.generation + 1;
+	if (st)
+	{
+		snap.ok = st->ok;
+		memcpy(snap.var, st->var, sizeof(snap.var));
+		memcpy(snap.state, st->state, sizeof(snap.state));
+	}
+	//Only the poller writes, so the previous snapshot can be read as is
+	if (notify_fd >= 0 && (snap.node != published.data.node || snap.weight != published.data.weight ||
+		strcmp(snap.state, published.data.state) != 0))
+	{
+		write(notify_fd, &one, sizeof(one));
+	}
+	snapshot_publish(&published, &snap);
+	stats_publish(&snap);
+	if (snap.fresh)
+	{
+		push_want(snap.node, snap.weight);
+	}
+}
+
+void state_init(dictionary *conf, FILE *log)
+{
+	pthread_condattr_t attr;
+	struct policy_conf pc;
+	struct breaker_conf bc;
+	char *path = get_config(conf, "hawk:state_path");
+	char *shm_name = get_config(conf, "hawk:shm_name");
+	char *entry = NULL;
+	char detail[160];
+	time_t now = time(0);
+
+	pthread_mutex_init(&state.lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&state.wake, &attr);
+	pthread_condattr_destroy(&attr);
+	state.node = NODE_WARMING;
+	state.weight = 0;
+	state.probed_at = 0;
+	state.fresh = 0;
+	state.grace_until = 0;
+	state.stop = 0;
+	state.persist = NULL;
+	notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	load_probe_conf(conf, &state.probe);
+	load_reply_conf(conf, &reply);
+	load_policy_conf(conf, &pc);
+	policy_init(&state.policy, &pc, 0, 0);
+	load_breaker_conf(conf, &bc);
+	breaker_init(&state.breaker, &bc, (unsigned int)getpid() ^ (unsigned int)now);
+	pipeline_init(&checks, check_enter);
+	load_checks(conf, log);
+	if (load_health_rule(conf, log, &state.health) != 0)
+	{
+		put_log(log, "FATAL - No usable health rule. Exiting...");
+		exit(1);
+	}
+
+	//Local readers get status and counters from shared memory
+	if (strcmp(shm_name, "NULL") != 0 && strlen(shm_name) > 0 && stats_shm_open(shm_name, status_var_names, STATUS_VARS, getid_byName(get_config(conf, "hawk:daemon_user"))) != 0)
+	{
+		entry = concat_str("ERROR - Could not create shared memory segment ", shm_name, ": ", strerror(errno), NULL);
+		put_log(log, entry);
+		free(entry);
+	}
+
+	state_publish(NULL);
+	if (strcmp(path, "NULL") == 0 || strlen(path) == 0)
+	{
+		return;
+	}
+
+	//Relative paths live under HAWK_HOME like the config and log
+	path = (path[0] == '/') ? concat_str(path, NULL) : concat_str(get_execdir(), "/", path, NULL);
+	state.persist = statefile_open(path);
+	if (state.persist == NULL)
+	{
+		entry = concat_str("ERROR - Could not map state file ", path, ": ", strerror(errno), NULL);
+		put_log(log, entry);
+		free(entry);
+		free(path);
+		return;
+	}
+
+	//Serve the last known state while the first probe runs, but only
+	//for a bounded grace period and only if it is recent enough
+	if (statefile_valid(state.persist, now, iniparser_getint(conf, "hawk:state_max_age", 300)) &&
+		(state.persist->node == NODE_SYNCED || state.persist->node == NODE_NOT_SYNCED))
+	{
+		state.node = state.persist->node;
+		state.weight = state.persist->weight;
+		state.grace_until = start_ms + iniparser_getint(conf, "hawk:state_grace", 5000);
+		//Hysteresis continues from the restored output
+		policy_init(&state.policy, &pc, 1, state.node == NODE_SYNCED);
+		state_publish(NULL);
+		snprintf(detail, sizeof(detail), " (%s %s, confirmed %llds ago, weight %d)", state_label, state.persist->status,
+			(long long)(now - state.persist->confirmed_at), state.weight);
+		entry = concat_str("INFO - Restored last known state from ", path, detail, NULL);
+		put_log(log, entry);
+		free(entry);
+	}
+	free(path);
+}
+
+/*	Policy Transitions			*/
+void log_policy_events(FILE *log, int events, char *status, double penalty)
+{
+	char entry[128];
+
+	if (events & POLICY_EV_SUPPRESS)
+	{
+		snprintf(entry, sizeof(entry), "INFO - Node suppressed for flapping (penalty %.0f)", penalty);
+		put_log(log, entry);
+	}
+	if (events & POLICY_EV_REUSE)
+	{
+		snprintf(entry, sizeof(entry), "INFO - Flap suppression lifted (penalty %.0f)", penalty);
+		put_log(log, entry);
+	}
+	if (events & (POLICY_EV_UP | POLICY_EV_DOWN))
+	{
+		snprintf(entry, sizeof(entry), "INFO - Node marked %s (%s %s)", (events & POLICY_EV_UP) ? "up" : "down", state_label, status);
+		put_log(log, entry);
+	}
+}
+
+/*	Circuit Transitions			*/
+void log_breaker_events(FILE *log, int events, struct breaker *b, long long now)
+{
+	char entry[128];
+
+	if (events & BREAKER_EV_OPEN)
+	{
+		snprintf(entry, sizeof(entry), "INFO - Circuit opened, next MySQL probe in %lld ms", b->retry_at - now);
+		put_log(log, entry);
+		stats_inc(STAT_BREAKER_OPENS);
+	}
+	if (events & BREAKER_EV_HALF_OPEN)
+	{
+		put_log(log, "INFO - Circuit half-open, sending a trial probe");
+		stats_inc(STAT_BREAKER_TRIALS);
+	}
+	if (events & BREAKER_EV_CLOSE)
+	{
+		put_log(log, "INFO - Circuit closed, MySQL is answering again");
+		stats_inc(STAT_BREAKER_CLOSES);
+	}
+}
+
+//Full weight up to weight_lag, then falling in a straight line to
+//min_weight at max_lag, in weight_step steps so that small changes in
+//lag do not push a new weight every probe. 0, taking the replica down,
+//past max_lag or when the lag is not known
+int lag_weight(struct probe_conf *probe, int64_t lag)
+{
+	int weight = 0;
+
+	if (lag < 0 || lag > probe->max_lag)
+	{
+		return 0;
+	}
+	if (lag <= probe->weight_lag)
+	{
+		return 100;
+	}
+	weight = 100 - (int)((100 - probe->min_weight) * (lag - probe->weight_lag) / (probe->max_lag - probe->weight_lag));
+	weight -= weight % probe->weight_step;
+	return weight < probe->min_weight ? probe->min_weight : weight;
+}
+
+//Logs stages that started or stopped failing; last holds the verdicts
+//of the previous round
+void log_check_results(FILE *log, struct stage_result *results, int *last)
+{
+	char entry[256];
+
+	for (int i = 0; i < PIPELINE_STAGES; i++)
+	{
+		int failing = results[i].verdict == STAGE_FAIL || results[i].verdict == STAGE_TIMEOUT;
+
+		if (failing)
+		{
+			stats_inc(results[i].verdict == STAGE_TIMEOUT ? STAT_CHECK_TIMEOUTS : STAT_CHECK_FAILURES);
+		}
+		if (results[i].verdict == last[i])
+		{
+			continue;
+		}
+		if (failing)
+		{
+			snprintf(entry, sizeof(entry), "INFO - Check %s failing: %s", stage_names[i], results[i].detail);
+			put_log(log, entry);
+		}
+		else if (results[i].verdict == STAGE_PASS && (last[i] == STAGE_FAIL || last[i] == STAGE_TIMEOUT))
+		{
+			snprintf(entry, sizeof(entry), "INFO - Check %s passing again", stage_names[i]);
+			put_log(log, entry);
+		}
+		last[i] = results[i].verdict;
+	}
+}
+
+/*	Background Poller			*/
+void* poller_main(void *arg)
+{
+	FILE *log = arg;
+	struct probe_conf probe;
+	struct timespec until;
+	struct hawk_status status;
+	struct stage_result results[PIPELINE_STAGES];
+	struct stat sb;
+	char found[256] = "";
+	char path[256];
+	char entry[320];
+	long long next = 0;
+	long long began = 0;
+	long long took = 0;
+	long long round = 0;
+	int events = 0;
+	int allowed = 0;
+	int searched = 0;
+	int weight = 100;
+	int donor = -1;
+	int verdicts[PIPELINE_STAGES] = {0};
+	const char *why = NULL;
+	const char *was = NULL;
+
+#ifndef HAWK_NO_LIBMYSQL
+	mysql_thread_init();
+#endif
+	pthread_mutex_lock(&state.lock);
+	while (!state.stop)
+	{
+		probe = state.probe;
+		allowed = breaker_allow(&state.breaker, mono_ms(), &events);
+		log_breaker_events(log, events, &state.breaker, mono_ms());
+		pthread_mutex_unlock(&state.lock);
+
+		//Looked for again whenever it is missing, so a server started
+		//after HAwk, or one that moved its socket, is picked up
+		if (probe.find_socket && local_host(probe.host))
+		{
+			if (!found[0] || stat(found, &sb) != 0)
+			{
+				if (find_socket(path, sizeof(path)) != 0)
+				{
+					path[0] = '\0';
+				}
+				if (!searched || strcmp(path, found) != 0)
+				{
+					if (path[0])
+						snprintf(entry, sizeof(entry), "INFO - Probing MySQL through %s", path);
+					else
+						snprintf(entry, sizeof(entry), "INFO - No local MySQL socket found, probing %s over TCP", probe.host[0] ? probe.host : "localhost");
+					put_log(log, entry);
+				}
+				snprintf(found, sizeof(found), "%s", path);
+				searched = 1;
+			}
+			snprintf(probe.socket, sizeof(probe.socket), "%s", found);
+		}
+		pthread_mutex_lock(&check_lock);
+		check_probe = probe;
+		pthread_mutex_unlock(&check_lock);
+
+		//The other checks run while this thread probes wsrep status.
+		//An open circuit answers for MySQL without connecting to it
+		round = mono_ns();
+		if (pipeline_begin(&checks, allowed) != 0)
+		{
+			put_log(log, "ERROR - Could not start a check thread");
+		}
+		if (allowed)
+		{
+			HAWK_TRACE1(probe__start, probe.timeout);
+			began = mono_ns();
+			mysql_status(&probe, log, &status);
+			took = mono_ns() - began;
+			HAWK_TRACE2(probe__end, status.ok, took / 1000);
+			latency_record(LAT_PROBE_TOTAL, took);
+			stats_inc(STAT_PROBES);
+		}
+		else
+		{
+			status_clear(&status);
+			stats_inc(STAT_PROBES_SKIPPED);
+		}
+		if (!status.ok)
+		{
+			stats_inc(STAT_PROBE_FAILURES);
+		}
+		weight = pipeline_end(&checks, results, status.var);
+		if (probe.replication && lag_weight(&probe, status.var[VAR_LAG]) < weight)
+		{
+			weight = lag_weight(&probe, status.var[VAR_LAG]);
+		}
+		latency_record(LAT_CHECK_ROUND, mono_ns() - round);
+		log_check_results(log, results, verdicts);
+
+		//Donors and the last synced node are decided here rather than
+		//by the health rule; checks can still cap or drop them
+		donor = donor_weight(&probe.donor, status.var, &why);
+		if (donor > 0 && donor < weight)
+		{
+			weight = donor;
+		}
+		if (why && why != was)
+		{
+			if (donor > 0)
+				snprintf(entry, sizeof(entry), "INFO - Keeping node up at %d%%: %s", donor, why);
+			else
+				snprintf(entry, sizeof(entry), "INFO - Taking node down: %s", why);
+			put_log(log, entry);
+		}
+		was = why;
+
+		pthread_mutex_lock(&state.lock);
+		state.probed_at = mono_ms();
+		if (allowed)
+		{
+			events = breaker_result(&state.breaker, status.ok, state.probed_at);
+			log_breaker_events(log, events, &state.breaker, state.probed_at);
+		}
+		if (!state.fresh)
+		{
+			snprintf(entry, sizeof(entry), "INFO - First probe completed %lld ms after start", state.probed_at - start_ms);
+			put_log(log, entry);
+		}
+
+		//Raw reading goes through hysteresis and flap damping
+		events = policy_step(&state.policy, status.ok && weight > 0 && (donor >= 0 ? donor > 0 : expr_eval(&state.health, status.var) != 0),
+			(int)status.var[VAR_STATE], state.probed_at);
+		log_policy_events(log, events, status.state, state.policy.penalty);
+		if (events & (POLICY_EV_UP | POLICY_EV_DOWN))
+		{
+			stats_inc(STAT_TRANSITIONS);
+		}
+		if (events & POLICY_EV_SUPPRESS)
+		{
+			stats_inc(STAT_SUPPRESSIONS);
+		}
+		state.node = state.policy.up ? NODE_SYNCED : NODE_NOT_SYNCED;
+		state.weight = (state.node == NODE_SYNCED) ? weight : 0;
+		state.fresh = 1;
+		state_publish(&status);
+		if (state.persist)
+		{
+			statefile_update(state.persist, state.node, state.weight, status.state, time(0));
+		}
+
+		//Sleep until the next probe is due or shutdown is requested
+		next = state.probed_at + probe.interval;
+		until.tv_sec = next / 1000;
+		until.tv_nsec = (next % 1000) * 1000000;
+		while (!state.stop && mono_ms() < next)
+		{
+			pthread_cond_timedwait(&state.wake, &state.lock, &until);
+		}
+	}
+	pthread_mutex_unlock(&state.lock);
+#ifndef HAWK_NO_LIBMYSQL
+	mysql_thread_end();
+#endif
+	return NULL;
+}
+
+/*	Answer Health Check			*/
+//Sets *stale to the age of the status in ms when the probe meant to
+//replace it is overdue by more than the response deadline, else to 0
+enum node_state current_node(struct hawk_snapshot *snap, long long *stale)
+{
+	long long age = 0;
+
+	*stale = 0;
+	snapshot_read(&published, snap);
+	if (!snap->fresh)
+	{
+		if (snap->node != NODE_WARMING && mono_ms() >= snap->grace_until)
+		{
+			//Grace period for the restored state is over
+			return NODE_WARMING;
+		}
+		return snap->node;
+	}
+
+	//The poller keeps working on a slow probe; answer from what it
+	//last saw until that is too old to mean anything
+	age = mono_ms() - snap->probed_at;
+	if (age > reply.interval + reply.deadline)
+	{
+		*stale = age;
+		if (age > reply.max_stale)
+		{
+			return NODE_UNKNOWN;
+		}
+	}
+	return snap->node;
+}
+
+void count_reply(struct hawk_snapshot *snap, enum node_state node, long long stale)
+{
+	stats_inc(STAT_REQUESTS);
+	if (!snap->fresh)
+	{
+		stats_inc(STAT_EARLY_ANSWERS);
+	}
+	if (node == NODE_UNKNOWN)
+	{
+		stats_inc(STAT_UNKNOWN_ANSWERS);
+	}
+	else if (stale)
+	{
+		stats_inc(STAT_STALE_ANSWERS);
+	}
+}
+
+//One write of an answer, timed
+ssize_t reply_write(int connfd, const char *buf, int len)
+{
+	long long began = mono_ns();
+	ssize_t sent = write(connfd, buf, len);
+	long long took = mono_ns() - began;
+
+	HAWK_TRACE3(response__write, connfd, sent, took / 1000);
+	latency_record(LAT_RESPONSE_WRITE, took);
+	return sent;
+}
+
+char* status_reason(int code)
+{
+	switch (code)
+	{
+		case 200: return "OK";
+		case 500: return "Internal Server Error";
+		case 502: return "Bad Gateway";
+		case 503: return "Service Unavailable";
+		case 504: return "Gateway Timeout";
+		default: return "Unknown";
+	}
+}
+
+//Formats the answer into out and returns its length. *fresh is set
+//when it came from a probe of this process
+int health_format(char *out, size_t size, int *fresh)
+{
+	char stale_header[48] = "";
+	int code = 503;
+	char *body = "MariaDB Cluster Node is not synced.";
+	struct hawk_snapshot snap;
+	long long stale = 0;
+	enum node_state node = current_node(&snap, &stale);
+	int length = 0;
+
+	if (node == NODE_SYNCED)
+	{
+		code = 200;
+		body = "MariaDB Cluster Node is synced.";
+	}
+	else if (node == NODE_WARMING)
+	{
+		body = "MariaDB Cluster Node is warming up.";
+	}
+	else if (node == NODE_UNKNOWN)
+	{
+		code = reply.unknown_code;
+		body = "MariaDB Cluster Node state is unknown.";
+	}
+	if (stale && node != NODE_UNKNOWN)
+	{
+		//Age of the status in milliseconds
+		snprintf(stale_header, sizeof(stale_header), "X-HAwk-Stale: %lld\r\n", stale);
+	}
+
+	length = snprintf(out, size, "HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\nConnection: close\r\n%sContent-Length: %zu\r\n\r\n%s\r\n",
+		code, status_reason(code), stale_header, strlen(body) + 2, body);
+	count_reply(&snap, node, stale);
+	*fresh = snap.fresh;
+	return length;
+}
+
+//HAproxy agent-check: one line with the state and weight
+int agent_format(char *out, size_t size, int *fresh)
+{
+	struct hawk_snapshot snap;
+	long long stale = 0;
+	enum node_state node = current_node(&snap, &stale);
+	int length = 0;
+
+	if (node == NODE_SYNCED)
+	{
+		length = snprintf(out, size, stale ? "up ready %d%% #stale\n" : "up ready %d%%\n", snap.weight);
+	}
+	else if (node == NODE_UNKNOWN)
+	{
+		length = snprintf(out, size, "down #state unknown\n");
+	}
+	else if (snap.breaker == BREAKER_OPEN)
+	{
+		length = snprintf(out, size, "down #mysql unreachable\n");
+	}
+	else
+	{
+		length = snprintf(out, size, "down #%s%s\n", (node == NODE_WARMING) ? "warming up" : "not synced", stale ? ", stale" : "");
+	}
+	count_reply(&snap, node, stale);
+	*fresh = snap.fresh;
+	return length;
+}
+
+/*	Connections				*/
+//What an epoll registration is for. Its data word holds the kind in the
+//top bits and below that the slab handle of a connection or subscriber,
+//or the index of a listener, so an event queued for a connection that
+//has been closed since is recognised and skipped.
+enum ep_kind
+{
+	EP_LISTENER,
+	EP_NOTIFY,
+	EP_CONN,
+	EP_SUB,
+	EP_SIGNAL,
+	EP_TIMER,
+	EP_URING
+};
+
+#define EP_DATA(kind, id)	(((uint64_t)(kind) << SLAB_HANDLE_BITS) | (id))
+#define EP_KIND(data)		((enum ep_kind)((data) >> SLAB_HANDLE_BITS))
+#define EP_ID(data)		((data) & ((1ULL << SLAB_HANDLE_BITS) - 1))
+
+//Where a connection is in its exchange
+#define CONN_READ		0	//waiting for the request head
+#define CONN_WRITE		1	//answer partly sent, waiting for room
+#define CONN_LINGER		2	//answer sent and shut down, waiting for the peer's FIN
+
+//A check being answered. HTTP checks get one on accept; agent and
+//over-limit checks, answered on accept, only when their answer does not
+//go out in one write or must be lingered on
+struct hawk_conn
+{
+	uint64_t handle;
+	int fd;
+	int state;
+	struct admit_client *client;	//NULL when it holds no admission slot
+	long long deadline;		//ms, for the current state
+	long long accepted_ns;
+	long long parsed_ns;
+	int len;
+	char buf[512];			//the request, then usually the answer
+	const char *out;
+	int out_len;
+	int sent;
+	struct hawk_conn *prev;		//open connections, earliest deadline first
+	struct hawk_conn *next;
+};
+
+struct hawk_listener
+{
+	int fd;
+	int kind;
+	int deferred;			//TCP_DEFER_ACCEPT: requests arrive with the accept
+};
+
+//A state-change subscriber. Kept small: thousands sit idle at a time
+struct hawk_sub
+{
+	uint64_t handle;
+	int fd;
+	int sse;			//text/event-stream, else one line per event
+	struct hawk_sub *prev;
+	struct hawk_sub *next;
+};
+
+//Event payload, formatted once per change and written to everyone
+struct hawk_event
+{
+	uint64_t generation;
+	int len;
+	char sse[256];
+	int line_len;
+	char line[128];
+};
+
+//Open connections in the order they were accepted, for the idle sweep
+struct hawk_conn *conns_head = NULL;
+struct hawk_conn *conns_tail = NULL;
+struct hawk_sub *subs = NULL;
+struct hawk_conn *metrics_conn = NULL;	//owns the metrics buffer while it is sent
+struct slab conn_slab;		//sized by limits:max_conns at startup
+struct slab sub_slab;		//sized by events:max_subscribers at startup
+struct slab ring_slab;		//io_uring connections, when hawk:io is uring
+struct hawk_event last_event;
+int drops_pending = 0;		//drops not yet in a report
+int answers_early = 0;
+int answers_live = 0;
+
+//Logs the first answer given from a probe of this process
+void note_answer(FILE *log, int fresh)
+{
+	char entry[128];
+
+	if (!fresh)
+	{
+		answers_early++;
+	}
+	else if (!answers_live)
+	{
+		answers_live = 1;
+		snprintf(entry, sizeof(entry), "INFO - First live health answer %lld ms after start (%d warming/restored answers before it)", mono_ms() - start_ms, answers_early);
+		put_log(log, entry);
+	}
+}
+
+//Close with a RST instead of a FIN; nothing is owed to this peer
+void conn_reset(int fd)
+{
+	struct linger lin = {1, 0};
+
+	setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+	close(fd);
+}
+
+void conn_unlink(struct hawk_conn *c)
+{
+	if (c->prev)
+		c->prev->next = c->next;
+	else
+		conns_head = c->next;
+	if (c->next)
+		c->next->prev = c->prev;
+	else
+		conns_tail = c->prev;
+	c->prev = c->next = NULL;
+}
+
+void conn_close(struct hawk_conn *c)
+{
+	conn_unlink(c);
+	if (c == metrics_conn)
+	{
+		metrics_conn = NULL;
+	}
+	if (c->client)
+	{
+		admit_close(&admission, c->client);
+	}
+	close(c->fd);
+	slab_put(&conn_slab, c);
+}
+
+//Every state gets the same time limit, so appending to the list keeps
+//it in deadline order
+void conn_enter(int epfd, struct hawk_conn *c, int state, uint32_t events)
+{
+	struct epoll_event ev;
+
+	conn_unlink(c);
+	c->state = state;
+	c->deadline = mono_ms() + reply.request_timeout;
+	c->prev = conns_tail;
+	if (conns_tail)
+		conns_tail->next = c;
+	else
+		conns_head = c;
+	conns_tail = c;
+
+	ev.events = events;
+	ev.data.u64 = EP_DATA(EP_CONN, c->handle);
+	epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+//NULL, with fd left alone, when every slot is taken
+struct hawk_conn* conn_open(int epfd, int fd, struct admit_client *client)
+{
+	uint64_t handle = 0;
+	struct hawk_conn *c = slab_get(&conn_slab, &handle);
+	struct epoll_event ev;
+
+	if (c == NULL)
+	{
+		stats_inc(STAT_SLAB_FULL);
+		return NULL;
+	}
+	c->handle = handle;
+	c->fd = fd;
+	c->state = CONN_READ;
+	c->client = client;
+	c->deadline = mono_ms() + reply.request_timeout;
+	c->accepted_ns = mono_ns();
+	c->prev = conns_tail;
+	if (conns_tail)
+		conns_tail->next = c;
+	else
+		conns_head = c;
+	conns_tail = c;
+	if (client)
+	{
+		admit_open(&admission, client);
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = EP_DATA(EP_CONN, handle);
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+	{
+		c->fd = -1;
+		conn_close(c);
+		return NULL;
+	}
+	return c;
+}
+
+/*	Output					*/
+//Sends as much of the answer as the socket takes. The rest waits for
+//EPOLLOUT; once it is all out the write side is shut down and the
+//connection lingers until the peer closes, so request bytes it sent and
+//were never read cannot turn the close into a RST that destroys the
+//answer on its way
+void conn_output(int epfd, struct hawk_conn *c)
+{
+	ssize_t sent = 0;
+
+	while (c->sent < c->out_len)
+	{
+		sent = reply_write(c->fd, c->out + c->sent, c->out_len - c->sent);
+		if (sent > 0)
+		{
+			c->sent += sent;
+			continue;
+		}
+		if (sent < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (sent < 0 && errno == EAGAIN)
+		{
+			if (c->state != CONN_WRITE)
+			{
+				stats_inc(STAT_PARTIAL_WRITES);
+				conn_enter(epfd, c, CONN_WRITE, EPOLLOUT);
+			}
+			return;
+		}
+		conn_close(c);
+		return;
+	}
+	if (c->parsed_ns)
+	{
+		latency_record(LAT_ANSWER, mono_ns() - c->parsed_ns);
+	}
+	if (c == metrics_conn)
+	{
+		metrics_conn = NULL;
+	}
+	shutdown(c->fd, SHUT_WR);
+	conn_enter(epfd, c, CONN_LINGER, EPOLLIN | EPOLLRDHUP);
+}
+
+//Starts sending an answer; out must stay valid until it is sent
+void conn_send(int epfd, struct hawk_conn *c, const char *out, int len)
+{
+	c->out = out;
+	c->out_len = len;
+	c->sent = 0;
+	conn_output(epfd, c);
+}
+
+//Lingering: read and discard until the peer closes
+void conn_drain(struct hawk_conn *c)
+{
+	char drain[512];
+	ssize_t got = 0;
+
+	while ((got = read(c->fd, drain, sizeof(drain))) > 0)
+		;
+	if (got == 0 || (errno != EAGAIN && errno != EINTR))
+	{
+		conn_close(c);
+	}
+}
+
+//An answer given on accept, from a stack buffer. It takes a connection
+//slot to linger on if one is free; otherwise whatever request bytes have
+//arrived are read and the connection is shut down and closed at once
+void answer_now(int epfd, int fd, const char *out, int len)
+{
+	struct hawk_conn *c = NULL;
+	char drain[512];
+
+	if (len > (int)sizeof(c->buf) || conn_slab.used >= conn_slab.capacity || (c = conn_open(epfd, fd, NULL)) == NULL)
+	{
+		reply_write(fd, out, len);
+		while (recv(fd, drain, sizeof(drain), MSG_DONTWAIT) > 0)
+			;
+		shutdown(fd, SHUT_WR);
+		close(fd);
+		return;
+	}
+	memcpy(c->buf, out, len);
+	conn_send(epfd, c, c->buf, len);
+}
+
+/*	Admission				*/
+void load_admit_conf(dictionary *conf, struct admit_conf *ac)
+{
+	ac->rate = iniparser_getint(conf, "limits:rate", 0);
+	ac->burst = iniparser_getint(conf, "limits:burst", 10);
+	ac->max_conns = iniparser_getint(conf, "limits:max_conns", 1024);
+}
+
+//Peer address as a v4-mapped IPv6 address
+void peer_addr(struct sockaddr_storage *ss, uint8_t *addr)
+{
+	memset(addr, 0, 16);
+	if (ss->ss_family == AF_INET)
+	{
+		addr[10] = 0xff;
+		addr[11] = 0xff;
+		memcpy(addr + 12, &((struct sockaddr_in *)ss)->sin_addr, 4);
+	}
+	else if (ss->ss_family == AF_INET6)
+	{
+		memcpy(addr, &((struct sockaddr_in6 *)ss)->sin6_addr, 16);
+	}
+}
+
+char* format_addr(const uint8_t *addr, char *out, size_t len)
+{
+	static const uint8_t mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+	if (memcmp(addr, mapped, 12) == 0)
+	{
+		inet_ntop(AF_INET, addr + 12, out, len);
+	}
+	else
+	{
+		inet_ntop(AF_INET6, addr, out, len);
+	}
+	return out;
+}
+
+//Log clients that had checks dropped since the last report
+void report_drops(FILE *log)
+{
+	struct admit_client *c = NULL;
+	char addr[INET6_ADDRSTRLEN];
+	char entry[192];
+
+	for (int i = 0; i < admission.size; i++)
+	{
+		c = &admission.clients[i];
+		if (!c->used || c->rate_drops + c->busy_drops == c->reported)
+		{
+			continue;
+		}
+		snprintf(entry, sizeof(entry), "INFO - Dropped %llu checks from %s (%llu over rate, %llu busy in total, %llu answered)",
+			(unsigned long long)(c->rate_drops + c->busy_drops - c->reported), format_addr(c->addr, addr, sizeof(addr)),
+			(unsigned long long)c->rate_drops, (unsigned long long)c->busy_drops, (unsigned long long)c->answered);
+		put_log(log, entry);
+		c->reported = c->rate_drops + c->busy_drops;
+	}
+}
+
+/*	State Change Stream			*/
+void event_format(struct hawk_event *ev, struct hawk_snapshot *snap)
+{
+	char *node = (snap->node == NODE_SYNCED) ? "synced" : (snap->node == NODE_NOT_SYNCED) ? "not_synced" : "warming";
+
+	ev->generation = snap->generation;
+	ev->len = snprintf(ev->sse, sizeof(ev->sse), "id: %llu\nevent: state\ndata: {\"node\":\"%s\",\"weight\":%d,\"wsrep_local_state\":\"%s\"}\n\n",
+		(unsigned long long)snap->generation, node, snap->weight, snap->state);
+	ev->line_len = snprintf(ev->line, sizeof(ev->line), "%s %d %s %llu\n", node, snap->weight, snap->state, (unsigned long long)snap->generation);
+}
+
+void sub_close(struct hawk_sub *s)
+{
+	if (s->prev)
+		s->prev->next = s->next;
+	else
+		subs = s->next;
+	if (s->next)
+		s->next->prev = s->prev;
+	close(s->fd);
+	slab_put(&sub_slab, s);
+}
+
+//All or nothing: a subscriber that cannot take a whole event at once is
+//too far behind to be worth buffering for, and is dropped
+int sub_send(struct hawk_sub *s, const char *data, int len)
+{
+	if (write(s->fd, data, len) != len)
+	{
+		stats_inc(STAT_SUBSCRIBERS_DROPPED);
+		sub_close(s);
+		return -1;
+	}
+	return 0;
+}
+
+//Takes over fd, which has already been admitted. The subscriber gets
+//the current state straight away
+void sub_open(int epfd, int fd, int sse)
+{
+	static const char head[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n";
+	struct hawk_snapshot snap;
+	struct hawk_event ev;
+	struct epoll_event eev;
+	struct hawk_sub *s = NULL;
+	uint64_t handle = 0;
+
+	if (sub_slab.used >= reply.max_subscribers || (s = slab_get(&sub_slab, &handle)) == NULL)
+	{
+		stats_inc(STAT_BUSY_REJECTS);
+		conn_reset(fd);
+		return;
+	}
+	s->handle = handle;
+	s->fd = fd;
+	s->sse = sse;
+	s->next = subs;
+	if (subs)
+		subs->prev = s;
+	subs = s;
+	stats_inc(STAT_SUBSCRIPTIONS);
+
+	snapshot_read(&published, &snap);
+	event_format(&ev, &snap);
+	if ((sse && sub_send(s, head, sizeof(head) - 1) != 0) || sub_send(s, sse ? ev.sse : ev.line, sse ? ev.len : ev.line_len) != 0)
+	{
+		return;
+	}
+
+	//Only hang-ups are expected from here on
+	eev.events = EPOLLIN | EPOLLRDHUP;
+	eev.data.u64 = EP_DATA(EP_SUB, handle);
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &eev) != 0)
+	{
+		sub_close(s);
+	}
+}
+
+void sub_input(struct hawk_sub *s)
+{
+	char drain[256];
+	ssize_t got = read(s->fd, drain, sizeof(drain));
+
+	if (got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR))
+	{
+		sub_close(s);
+	}
+}
+
+//Poller signalled a change: send it to every subscriber once
+void sub_broadcast(void)
+{
+	struct hawk_snapshot snap;
+	struct hawk_sub *s = subs;
+	struct hawk_sub *next = NULL;
+	uint64_t count = 0;
+
+	read(notify_fd, &count, sizeof(count));
+	snapshot_read(&published, &snap);
+	if (snap.generation == last_event.generation)
+	{
+		return;
+	}
+	event_format(&last_event, &snap);
+	stats_inc(STAT_EVENTS);
+	for (; s; s = next)
+	{
+		next = s->next;
+		sub_send(s, s->sse ? last_event.sse : last_event.line, s->sse ? last_event.len : last_event.line_len);
+	}
+}
+
+//Lets idle subscribers notice a dead HAwk, and HAwk a dead subscriber
+void sub_keepalive(void)
+{
+	struct hawk_sub *s = subs;
+	struct hawk_sub *next = NULL;
+
+	for (; s; s = next)
+	{
+		next = s->next;
+		if (s->sse)
+			sub_send(s, ":\n\n", 3);
+		else
+			sub_send(s, "\n", 1);
+	}
+}
+
+/*	Metrics					*/
+//Prometheus text format: node state, counters and per-client admission
+//The body is rendered behind room for the head, which is put in front
+//of it once the length is known. One scrape is sent at a time
+#define METRICS_HEAD	128
+#define METRICS_FIXED	65536		//counters and latency histograms
+#define METRICS_CLIENT	400		//one client's lines, IPv6 and 20 digit counts
+#define METRICS_TAIL	64		//kept for hawk_metrics_truncated
+#define METRICS_MAX	(8 << 20)
+
+char *metrics_out = NULL;
+size_t metrics_size = 0;
+
+//Sized once from the client table, so a scrape lists every client
+//unless the table is very large
+int metrics_init(int clients)
+{
+	metrics_size = METRICS_HEAD + METRICS_FIXED + (size_t)clients * METRICS_CLIENT + METRICS_TAIL;
+	if (metrics_size > METRICS_MAX)
+	{
+		metrics_size = METRICS_MAX;
+	}
+	metrics_out = malloc(metrics_size);
+	return metrics_out ? 0 : -1;
+}
+
+//Appends a whole record or nothing, so a full buffer never cuts a
+//sample line. Returns -1 when it did not fit
+static int metrics_put(char *body, size_t room, size_t *len, const char *fmt, ...)
+{
+	va_list ap;
+	int n = 0;
+
+	va_start(ap, fmt);
+	n = vsnprintf(body + *len, room - *len, fmt, ap);
+	va_end(ap);
+	if (n < 0 || (size_t)n >= room - *len)
+	{
+		body[*len] = '\0';
+		return -1;
+	}
+	*len += n;
+	return 0;
+}
+
+void metrics_reply(int epfd, struct hawk_conn *conn)
+{
+	static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+	struct hawk_snapshot snap;
+	struct admit_client *c = NULL;
+	char addr[INET6_ADDRSTRLEN];
+	char head[METRICS_HEAD];
+	char *body = metrics_out + METRICS_HEAD;
+	size_t size = metrics_size - METRICS_HEAD;
+	size_t room = size - METRICS_TAIL;
+	size_t len = 0;
+	int truncated = 0;
+	int hlen = 0;
+
+	stats_inc(STAT_REQUESTS);
+	if (metrics_conn)
+	{
+		conn_send(epfd, conn, busy, sizeof(busy) - 1);
+		return;
+	}
+	snapshot_read(&published, &snap);
+	//Fixed series first; only the per-client section can run out of room
+	metrics_put(body, room, &len, "hawk_node %d\nhawk_weight %d\nhawk_connections %d\nhawk_subscribers %d\n"
+		"hawk_slab_used{slab=\"conns\"} %d\nhawk_slab_peak{slab=\"conns\"} %d\nhawk_slab_capacity{slab=\"conns\"} %d\n"
+		"hawk_slab_used{slab=\"subs\"} %d\nhawk_slab_peak{slab=\"subs\"} %d\nhawk_slab_capacity{slab=\"subs\"} %d\n"
+		"hawk_slab_used{slab=\"ring\"} %d\nhawk_slab_peak{slab=\"ring\"} %d\nhawk_slab_capacity{slab=\"ring\"} %d\n",
+		snap.node, snap.weight, admission.conns, sub_slab.used,
+		conn_slab.used, conn_slab.peak, conn_slab.capacity, sub_slab.used, sub_slab.peak, sub_slab.capacity,
+		ring_slab.used, ring_slab.peak, ring_slab.capacity);
+	for (int i = 0; i < HAWK_STATS; i++)
+	{
+		metrics_put(body, room, &len, "hawk_%s_total %llu\n", stat_names[i], (unsigned long long)stats_get(i));
+	}
+	len += latency_render(body + len, room - len);
+	for (int i = 0; i < admission.size; i++)
+	{
+		c = &admission.clients[i];
+		if (!c->used)
+		{
+			continue;
+		}
+		format_addr(c->addr, addr, sizeof(addr));
+		if (metrics_put(body, room, &len, "hawk_client_answered_total{client=\"%s\"} %llu\n"
+			"hawk_client_dropped_total{client=\"%s\",reason=\"rate\"} %llu\n"
+			"hawk_client_dropped_total{client=\"%s\",reason=\"busy\"} %llu\n",
+			addr, (unsigned long long)c->answered, addr, (unsigned long long)c->rate_drops, addr, (unsigned long long)c->busy_drops) != 0)
+		{
+			truncated = 1;
+			break;
+		}
+	}
+	//1 when clients were left out of this scrape
+	metrics_put(body, size, &len, "hawk_metrics_truncated %d\n", truncated);
+
+	hlen = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\nContent-Length: %zu\r\n\r\n", len);
+	memcpy(body - hlen, head, hlen);
+	metrics_conn = conn;
+	conn_send(epfd, conn, body - hlen, hlen + len);
+}
+
+/*	Requests				*/
+//Answer once the request head is in; the path picks the endpoint
+void conn_input(FILE *log, int epfd, struct hawk_conn *c)
+{
+	ssize_t got = read(c->fd, c->buf + c->len, sizeof(c->buf) - 1 - c->len);
+	int fresh = 0;
+	int len = 0;
+
+	if (got < 0 && (errno == EAGAIN || errno == EINTR))
+	{
+		return;
+	}
+	if (got <= 0)
+	{
+		conn_close(c);
+		return;
+	}
+	c->len += got;
+	c->buf[c->len] = '\0';
+	if (!strstr(c->buf, "\r\n\r\n") && !strstr(c->buf, "\n\n") && c->len < (int)sizeof(c->buf) - 1)
+	{
+		return;
+	}
+	c->parsed_ns = mono_ns();
+	HAWK_TRACE2(request__parsed, c->fd, (c->parsed_ns - c->accepted_ns) / 1000);
+	latency_record(LAT_REQUEST_READ, c->parsed_ns - c->accepted_ns);
+
+	if (strncmp(c->buf, "GET /events ", 12) == 0)
+	{
+		//Leaves the request slots for a subscriber of its own
+		epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+		conn_unlink(c);
+		admit_close(&admission, c->client);
+		sub_open(epfd, c->fd, 1);
+		slab_put(&conn_slab, c);
+		return;
+	}
+	if (strncmp(c->buf, "GET /metrics ", 13) == 0)
+	{
+		metrics_reply(epfd, c);
+		return;
+	}
+	//The request is done with; the answer goes out of the same buffer
+	len = health_format(c->buf, sizeof(c->buf), &fresh);
+	note_answer(log, fresh);
+	conn_send(epfd, c, c->buf, len);
+}
+
+void conn_event(FILE *log, int epfd, struct hawk_conn *c)
+{
+	switch (c->state)
+	{
+		case CONN_READ:
+			conn_input(log, epfd, c);
+			break;
+		case CONN_WRITE:
+			conn_output(epfd, c);
+			break;
+		case CONN_LINGER:
+			conn_drain(c);
+			break;
+	}
+}
+
+void accept_checks(FILE *log, int epfd, struct hawk_listener *l)
+{
+	struct sockaddr_storage ss;
+	socklen_t sslen = sizeof(ss);
+	struct admit_client *client = NULL;
+	struct hawk_conn *c = NULL;
+	uint8_t addr[16];
+	char drain[512];
+	int connfd = 0;
+	int verdict = 0;
+	long long now = 0;
+	long long began = 0;
+	char out[320];
+	int fresh = 0;
+	int len = 0;
+
+	//Bounded so one busy listener cannot starve the others or the
+	//connections already waiting for their request
+	for (int i = 0; i < 64; i++)
+	{
+		sslen = sizeof(ss);
+		connfd = accept4(l->fd, (struct sockaddr *)&ss, &sslen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (connfd == -1)
+		{
+			return;
+		}
+
+		HAWK_TRACE2(accept, connfd, l->kind);
+		//Every slot taken: refuse before doing any per-client work
+		if (l->kind == LISTEN_HTTP && conn_slab.used >= conn_slab.capacity)
+		{
+			stats_inc(STAT_SLAB_FULL);
+			conn_reset(connfd);
+			continue;
+		}
+		if (reply.sndbuf > 0)
+		{
+			setsockopt(connfd, SOL_SOCKET, SO_SNDBUF, &reply.sndbuf, sizeof(reply.sndbuf));
+		}
+		now = mono_ms();
+		peer_addr(&ss, addr);
+		client = admit_client(&admission, addr, now);
+		verdict = client ? admit_check(&admission, client, l->kind == LISTEN_HTTP, now) : ADMIT_BUSY;
+		drops_pending |= verdict != ADMIT_OK;
+		if (verdict == ADMIT_BUSY)
+		{
+			stats_inc(STAT_BUSY_REJECTS);
+			conn_reset(connfd);
+			continue;
+		}
+		if (verdict == ADMIT_RATE)
+		{
+			stats_inc(STAT_RATE_LIMITED);
+			if (!reply.rate_reply || l->kind == LISTEN_EVENTS)
+			{
+				conn_reset(connfd);
+				continue;
+			}
+			//Answer without reading the request or taking a slot
+			if (l->kind == LISTEN_HTTP)
+			{
+				recv(connfd, drain, sizeof(drain), MSG_DONTWAIT);
+			}
+		}
+
+		if (l->kind == LISTEN_EVENTS)
+		{
+			sub_open(epfd, connfd, 0);
+		}
+		else if (l->kind == LISTEN_AGENT)
+		{
+			//Nothing to read first, so the answer is the whole exchange
+			began = mono_ns();
+			len = agent_format(out, sizeof(out), &fresh);
+			note_answer(log, fresh);
+			answer_now(epfd, connfd, out, len);
+			latency_record(LAT_ANSWER, mono_ns() - began);
+		}
+		else if (verdict == ADMIT_RATE)
+		{
+			len = health_format(out, sizeof(out), &fresh);
+			answer_now(epfd, connfd, out, len);
+		}
+		else if ((c = conn_open(epfd, connfd, client)) == NULL)
+		{
+			conn_reset(connfd);
+		}
+		else if (l->deferred)
+		{
+			//The request is almost always in already; answering it now
+			//saves a trip through epoll
+			conn_input(log, epfd, c);
+		}
+	}
+}
+
+/*	io_uring Backend			*/
+//With hawk:io = uring the HTTP listener is served from a ring instead
+//of epoll. A multishot accept hands over each check as a direct
+//descriptor in the ring's file table, the request is received into a
+//provided buffer, and the answer is one linked chain - send, shut down
+//the write side, wait for the peer's FIN, close - so a plain health
+//check costs no system calls of its own. The ring's descriptor sits in
+//the epoll set and wakes the loop when completions are waiting.
+//Direct descriptors have no peer address: checks on this listener take
+//a slot but get no per-client admission
+#define RING_ENTRIES		256
+#define RING_CQES_PER_CONN	4	//send, drain and a failed shutdown or close
+#define RING_BUFFERS_MAX	32768	//largest provided buffer ring
+#define RING_BUFFER_SIZE	512
+#define RING_BGID		1
+
+//Operation in the top bits of user_data, handle below, like EP_DATA
+enum ring_op
+{
+	RING_ACCEPT = 1,
+	RING_RECV,
+	RING_SEND,
+	RING_SHUTDOWN,
+	RING_DRAIN,
+	RING_CLOSE,
+	RING_CANCEL,
+	RING_INSTALL
+};
+
+#define RING_DATA(op, id)	EP_DATA(op, id)
+#define RING_OP(data)		((enum ring_op)((data) >> SLAB_HANDLE_BITS))
+
+//Where a ring connection is; completions for it always end with one
+//for the last operation queued, which releases it
+#define RING_READ		0	//a receive is queued for the request
+#define RING_ANSWER		1	//the answer chain is queued
+#define RING_INSTALL_FD		2	//becoming a plain descriptor for /metrics or /events
+#define RING_DEAD		3	//timed out, operations cancelled
+
+struct ring_conn
+{
+	uint64_t handle;
+	int slot;			//index in the ring's file table
+	int state;
+	long long deadline;
+	long long accepted_ns;
+	long long parsed_ns;
+	int len;
+	char buf[512];
+	int out_len;
+	struct ring_conn *prev;		//live connections, earliest deadline first
+	struct ring_conn *next;
+};
+
+struct uring ring;
+struct ring_conn *ring_head = NULL;
+struct ring_conn *ring_tail = NULL;
+int ring_listenfd = -1;		//-1 while the HTTP listener is on epoll
+int ring_accepting = 0;
+
+//An SQE, submitting what is queued first if there is no room for need
+//more. A chain has to go to the kernel in one submission
+struct io_uring_sqe* ring_sqe(unsigned need)
+{
+	if (uring_room(&ring) < need)
+	{
+		uring_submit(&ring, 0);
+	}
+	return uring_sqe(&ring);
+}
+
+void ring_unlink(struct ring_conn *c)
+{
+	if (c->prev)
+		c->prev->next = c->next;
+	else if (ring_head == c)
+		ring_head = c->next;
+	if (c->next)
+		c->next->prev = c->prev;
+	else if (ring_tail == c)
+		ring_tail = c->prev;
+	c->prev = c->next = NULL;
+}
+
+void ring_accept(void)
+{
+	struct io_uring_sqe *sqe = ring_sqe(1);
+
+	if (sqe == NULL)
+	{
+		return;
+	}
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = ring_listenfd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->file_index = IORING_FILE_INDEX_ALLOC;
+	sqe->user_data = RING_DATA(RING_ACCEPT, 0);
+	ring_accepting = 1;
+}
+
+//Receives into a buffer from the ring; op tells a request from a drain.
+//Returns -1 when the submission queue has no room
+int ring_recv(struct ring_conn *c, enum ring_op op, uint8_t link)
+{
+	struct io_uring_sqe *sqe = ring_sqe(1);
+
+	if (sqe == NULL)
+	{
+		return -1;
+	}
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = c->slot;
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT | link;
+	sqe->buf_group = RING_BGID;
+	sqe->user_data = RING_DATA(op, c->handle);
+	return 0;
+}
+
+//Queues the close of a table slot; nothing of it comes back on success.
+//With the queue full it is closed straight away instead
+void ring_close_slot(int slot, uint8_t link)
+{
+	struct io_uring_sqe *sqe = ring_sqe(1);
+
+	if (sqe == NULL)
+	{
+		uring_file_close(&ring, slot);
+		return;
+	}
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->file_index = slot + 1;
+	sqe->flags = IOSQE_CQE_SKIP_SUCCESS | link;
+	sqe->user_data = RING_DATA(RING_CLOSE, 0);
+}
+
+void ring_free(struct ring_conn *c)
+{
+	ring_unlink(c);
+	slab_put(&ring_slab, c);
+}
+
+//Nothing is queued for it, so nothing will release it later
+void ring_drop(struct ring_conn *c)
+{
+	ring_close_slot(c->slot, 0);
+	ring_free(c);
+}
+
+//The whole answer in one submission. MSG_WAITALL keeps the send going
+//until all of it is out however small the socket buffer, and the links
+//stop the chain at the first step that fails
+void ring_answer(struct ring_conn *c)
+{
+	struct io_uring_sqe *sqe = NULL;
+
+	if (uring_room(&ring) < 4)
+	{
+		uring_submit(&ring, 0);
+	}
+	if (uring_room(&ring) < 4)
+	{
+		ring_drop(c);
+		return;
+	}
+	sqe = uring_sqe(&ring);
+	c->state = RING_ANSWER;
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = c->slot;
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+	sqe->addr = (uint64_t)(uintptr_t)c->buf;
+	sqe->len = c->out_len;
+	sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+	sqe->user_data = RING_DATA(RING_SEND, c->handle);
+
+	sqe = uring_sqe(&ring);
+	sqe->opcode = IORING_OP_SHUTDOWN;
+	sqe->fd = c->slot;
+	sqe->len = SHUT_WR;
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+	sqe->user_data = RING_DATA(RING_SHUTDOWN, c->handle);
+
+	//Linger for the peer's FIN, then close
+	ring_recv(c, RING_DRAIN, IOSQE_IO_LINK);
+	ring_close_slot(c->slot, 0);
+}
+
+void ring_open(int slot)
+{
+	uint64_t handle = 0;
+	struct ring_conn *c = NULL;
+
+	HAWK_TRACE2(accept, slot, LISTEN_HTTP);
+	if (conn_slab.used + ring_slab.used >= conn_slab.capacity || (c = slab_get(&ring_slab, &handle)) == NULL)
+	{
+		stats_inc(STAT_SLAB_FULL);
+		ring_close_slot(slot, 0);
+		return;
+	}
+	c->handle = handle;
+	c->slot = slot;
+	c->state = RING_READ;
+	c->deadline = mono_ms() + reply.request_timeout;
+	c->accepted_ns = mono_ns();
+	c->prev = ring_tail;
+	if (ring_tail)
+		ring_tail->next = c;
+	else
+		ring_head = c;
+	ring_tail = c;
+	if (ring_recv(c, RING_RECV, 0) != 0)
+	{
+		ring_drop(c);
+	}
+}
+
+//Request bytes arrived, or the receive failed
+void ring_input(FILE *log, struct ring_conn *c, struct io_uring_cqe *cqe)
+{
+	struct io_uring_sqe *sqe = NULL;
+	int fresh = 0;
+	int got = cqe->res;
+
+	//The provided buffers ran out before this request's bytes could be
+	//placed; they are still in the socket, so receive again
+	if (got == -ENOBUFS && c->state == RING_READ)
+	{
+		stats_inc(STAT_RING_NOBUFS);
+		if (ring_recv(c, RING_RECV, 0) != 0)
+		{
+			ring_drop(c);
+		}
+		return;
+	}
+	if (got <= 0 || c->state == RING_DEAD)
+	{
+		ring_drop(c);
+		return;
+	}
+	if (got > (int)sizeof(c->buf) - 1 - c->len)
+	{
+		got = sizeof(c->buf) - 1 - c->len;
+	}
+	memcpy(c->buf + c->len, uring_buffer(&ring, cqe->flags >> IORING_CQE_BUFFER_SHIFT), got);
+	c->len += got;
+	c->buf[c->len] = '\0';
+	if (!strstr(c->buf, "\r\n\r\n") && !strstr(c->buf, "\n\n") && c->len < (int)sizeof(c->buf) - 1)
+	{
+		if (ring_recv(c, RING_RECV, 0) != 0)
+		{
+			ring_drop(c);
+		}
+		return;
+	}
+	c->parsed_ns = mono_ns();
+	HAWK_TRACE2(request__parsed, c->slot, (c->parsed_ns - c->accepted_ns) / 1000);
+	latency_record(LAT_REQUEST_READ, c->parsed_ns - c->accepted_ns);
+
+	//The stream and the metrics scrape outlive a one-shot exchange and
+	//go back to epoll as plain descriptors
+	if (strncmp(c->buf, "GET /events ", 12) == 0 || strncmp(c->buf, "GET /metrics ", 13) == 0)
+	{
+		c->state = RING_INSTALL_FD;
+		sqe = ring_sqe(1);
+		if (sqe == NULL)
+		{
+			ring_drop(c);
+			return;
+		}
+		sqe->opcode = IORING_OP_FIXED_FD_INSTALL;
+		sqe->fd = c->slot;
+		sqe->flags = IOSQE_FIXED_FILE;
+		sqe->user_data = RING_DATA(RING_INSTALL, c->handle);
+		return;
+	}
+	c->out_len = health_format(c->buf, sizeof(c->buf), &fresh);
+	note_answer(log, fresh);
+	ring_answer(c);
+}
+
+//The direct descriptor now has a plain one as well
+void ring_installed(int epfd, struct ring_conn *c, int fd)
+{
+	struct hawk_conn *conn = NULL;
+	int events = strncmp(c->buf, "GET /events ", 12) == 0;
+
+	ring_close_slot(c->slot, 0);
+	if (fd < 0 || c->state == RING_DEAD)
+	{
+		if (fd >= 0)
+			close(fd);
+		ring_free(c);
+		return;
+	}
+	ring_free(c);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if (events)
+	{
+		sub_open(epfd, fd, 1);
+	}
+	else if ((conn = conn_open(epfd, fd, NULL)) == NULL)
+	{
+		conn_reset(fd);
+	}
+	else
+	{
+		metrics_reply(epfd, conn);
+	}
+}
+
+//Handles every completion in the CQ
+void ring_reap(FILE *log, int epfd)
+{
+	struct io_uring_cqe *cqe = NULL;
+	struct ring_conn *c = NULL;
+	uint64_t data = 0;
+
+	while ((cqe = uring_cqe(&ring)) != NULL)
+	{
+		data = cqe->user_data;
+		//A buffer goes back whatever became of its connection
+		if (cqe->flags & IORING_CQE_F_BUFFER)
+		{
+			c = slab_lookup(&ring_slab, EP_ID(data));
+			if (c && RING_OP(data) == RING_RECV && c->state == RING_READ && cqe->res > 0)
+			{
+				ring_input(log, c, cqe);
+				uring_recycle(&ring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+				uring_seen(&ring);
+				continue;
+			}
+			uring_recycle(&ring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+		}
+		if (RING_OP(data) == RING_ACCEPT)
+		{
+			if (cqe->res >= 0)
+			{
+				ring_open(cqe->res);
+			}
+			if (!(cqe->flags & IORING_CQE_F_MORE))
+			{
+				ring_accepting = 0;
+			}
+			uring_seen(&ring);
+			continue;
+		}
+		c = slab_lookup(&ring_slab, EP_ID(data));
+		if (c == NULL)
+		{
+			uring_seen(&ring);
+			continue;
+		}
+		switch (RING_OP(data))
+		{
+			case RING_RECV:
+				ring_input(log, c, cqe);
+				break;
+			case RING_SEND:
+				if (cqe->res == c->out_len)
+				{
+					latency_record(LAT_ANSWER, mono_ns() - c->parsed_ns);
+				}
+				break;
+			case RING_DRAIN:
+				//The close linked behind it runs unless the drain failed
+				if (cqe->res < 0)
+				{
+					ring_close_slot(c->slot, 0);
+				}
+				ring_free(c);
+				break;
+			case RING_INSTALL:
+				ring_installed(epfd, c, cqe->res);
+				break;
+			default:
+				break;
+		}
+		uring_seen(&ring);
+	}
+}
+
+void ring_complete(FILE *log, int epfd)
+{
+	ring_reap(log, epfd);
+	//Completions past a full CQ wait on the kernel's overflow list, which
+	//does not wake epoll. Once the CQ has room they are moved back
+	while (uring_flush(&ring))
+	{
+		stats_inc(STAT_RING_OVERFLOWS);
+		ring_reap(log, epfd);
+	}
+	//Multishot accept ends on errors and when the kernel runs short
+	if (!ring_accepting)
+	{
+		ring_accept();
+	}
+}
+
+//Every queued operation on the connection is cancelled; the last
+//completion then releases it. Returns -1, leaving it for later, when
+//the submission queue has no room
+int ring_expire(struct ring_conn *c)
+{
+	struct io_uring_sqe *sqe = ring_sqe(1);
+
+	if (sqe == NULL)
+	{
+		return -1;
+	}
+	if (c->state == RING_READ)
+		stats_inc(STAT_REQUEST_TIMEOUTS);
+	else if (c->state == RING_ANSWER)
+		stats_inc(STAT_WRITE_TIMEOUTS);
+	ring_unlink(c);
+	c->state = RING_DEAD;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = c->slot;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_FD_FIXED | IORING_ASYNC_CANCEL_ALL;
+	sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+	sqe->user_data = RING_DATA(RING_CANCEL, 0);
+	return 0;
+}
+
+//Takes over the HTTP listener if hawk:io asks for a ring and the kernel
+//has everything it needs; otherwise it stays on epoll
+int ring_init(dictionary *conf, FILE *log, int epfd, int listenfd)
+{
+	static const int ops[] = {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_SHUTDOWN,
+		IORING_OP_CLOSE, IORING_OP_ASYNC_CANCEL, IORING_OP_FIXED_FD_INSTALL};
+	struct epoll_event ev;
+	struct rlimit nofile;
+	unsigned files = conn_slab.capacity * 2;
+	unsigned bufs = 256;
+	char entry[160];
+
+	if (strcmp(iniparser_getstring(conf, "hawk:io", "epoll"), "uring") != 0)
+	{
+		return 0;
+	}
+	//Slots closed in a chain are free again only once the close has run
+	if (getrlimit(RLIMIT_NOFILE, &nofile) == 0 && files > nofile.rlim_cur)
+	{
+		files = nofile.rlim_cur;
+	}
+	//Every connection can have a few completions waiting at once, and one
+	//receive wanting a buffer; short of either, a burst overflows the CQ
+	//or fails receives with ENOBUFS
+	while (bufs < (unsigned)conn_slab.capacity && bufs < RING_BUFFERS_MAX)
+	{
+		bufs <<= 1;
+	}
+	if (uring_init(&ring, RING_ENTRIES, conn_slab.capacity * RING_CQES_PER_CONN + RING_ENTRIES) != 0)
+	{
+		snprintf(entry, sizeof(entry), "ERROR - io_uring unavailable (%s), serving checks with epoll", strerror(errno));
+		put_log(log, entry);
+		return 0;
+	}
+	if (!uring_supported(&ring, ops, sizeof(ops) / sizeof(ops[0])))
+	{
+		put_log(log, "ERROR - Kernel io_uring lacks operations HAwk needs, serving checks with epoll");
+		uring_close(&ring);
+		return 0;
+	}
+	if (uring_files(&ring, files) != 0 || uring_buffers(&ring, bufs, RING_BUFFER_SIZE, RING_BGID) != 0
+		|| slab_init(&ring_slab, sizeof(struct ring_conn), conn_slab.capacity) != 0)
+	{
+		snprintf(entry, sizeof(entry), "ERROR - Could not set up io_uring resources (%s), serving checks with epoll", strerror(errno));
+		put_log(log, entry);
+		uring_close(&ring);
+		return 0;
+	}
+	ev.events = EPOLLIN;
+	ev.data.u64 = EP_DATA(EP_URING, 0);
+	epoll_ctl(epfd, EPOLL_CTL_ADD, ring.fd, &ev);
+	ring_listenfd = listenfd;
+	ring_accept();
+	uring_submit(&ring, 0);
+	put_log(log, "INFO - Serving HTTP checks with io_uring");
+	return 1;
+}
+
+/*	Timers					*/
+//Earliest thing the loop has to do without being woken by I/O, or 0
+long long next_deadline(long long keepalive_at, long long reported_at)
+{
+	long long next = 0;
+	long long due = 0;
+
+	if (conns_head)
+	{
+		next = conns_head->deadline;
+	}
+	if (ring_head && (next == 0 || ring_head->deadline < next))
+	{
+		next = ring_head->deadline;
+	}
+	if (subs && reply.keepalive > 0)
+	{
+		due = keepalive_at + reply.keepalive;
+		next = (next == 0 || due < next) ? due : next;
+	}
+	if (drops_pending && reply.report_interval > 0)
+	{
+		due = reported_at + reply.report_interval;
+		next = (next == 0 || due < next) ? due : next;
+	}
+	return next;
+}
+
+//Arms the timer for an absolute monotonic ms, or disarms it for 0
+void timer_arm(int timerfd, long long at)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	if (at > 0)
+	{
+		its.it_value.tv_sec = at / 1000;
+		its.it_value.tv_nsec = (at % 1000) * 1000000;
+	}
+	timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* 	Main Routine				*/
+int main_construct(FILE *log, dictionary *conf, int *listenfds, int *listenkinds, int nlisten)
+{
+        struct hawk_listener listeners[HAWK_MAX_LISTENERS];
+        struct hawk_conn *c = NULL;
+        struct hawk_sub *s = NULL;
+        struct signalfd_siginfo si;
+        uint64_t expired = 0;
+        long long armed = 0;
+        long long next = 0;
+        struct epoll_event events[64];
+        struct epoll_event ev;
+        socklen_t optlen = 0;
+        struct policy_conf pc;
+        struct breaker_conf bc;
+        struct admit_conf ac;
+        long long now = 0;
+        long long reported_at = mono_ms();
+        long long keepalive_at = mono_ms();
+        int epfd = epoll_create1(EPOLL_CLOEXEC);
+        int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        int n = 0;
+
+        if (epfd < 0 || timerfd < 0)
+        {
+                put_log(log, "FATAL - Could not create epoll instance or timer");
+                exit(1);
+        }
+        for (int i = 0; i < nlisten; i++)
+        {
+                listeners[i].fd = listenfds[i];
+                listeners[i].kind = listenkinds[i];
+                optlen = sizeof(listeners[i].deferred);
+                if (getsockopt(listenfds[i], IPPROTO_TCP, TCP_DEFER_ACCEPT, &listeners[i].deferred, &optlen) != 0)
+                {
+                        listeners[i].deferred = 0;
+                }
+                if (listenkinds[i] == LISTEN_HTTP && ring_listenfd < 0 && ring_init(conf, log, epfd, listenfds[i]))
+                {
+                        continue;
+                }
+                ev.events = EPOLLIN;
+                ev.data.u64 = EP_DATA(EP_LISTENER, i);
+                epoll_ctl(epfd, EPOLL_CTL_ADD, listenfds[i], &ev);
+        }
+        ev.events = EPOLLIN;
+        ev.data.u64 = EP_DATA(EP_NOTIFY, 0);
+        if (notify_fd >= 0)
+        {
+                epoll_ctl(epfd, EPOLL_CTL_ADD, notify_fd, &ev);
+        }
+        ev.data.u64 = EP_DATA(EP_SIGNAL, 0);
+        epoll_ctl(epfd, EPOLL_CTL_ADD, signal_fd, &ev);
+        ev.data.u64 = EP_DATA(EP_TIMER, 0);
+        epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &ev);
+
+        //Start main loop
+        while(1)
+        {
+                //Sleep until there is I/O, a signal or a deadline; with
+                //nothing pending the timer is disarmed and the loop
+                //does not wake at all
+                next = next_deadline(keepalive_at, reported_at);
+                if (next != armed)
+                {
+                        timer_arm(timerfd, next);
+                        armed = next;
+                }
+                if (ring_listenfd >= 0 && uring_pending(&ring))
+                {
+                        uring_submit(&ring, 0);
+                }
+                n = epoll_wait(epfd, events, 64, -1);
+                for (int i = 0; i < n; i++)
+                {
+                        switch (EP_KIND(events[i].data.u64))
+                        {
+                                case EP_LISTENER:
+                                        accept_checks(log, epfd, &listeners[EP_ID(events[i].data.u64)]);
+                                        break;
+                                case EP_NOTIFY:
+                                        sub_broadcast();
+                                        break;
+                                case EP_CONN:
+                                        //Closed earlier in this batch, maybe reused
+                                        if ((c = slab_lookup(&conn_slab, EP_ID(events[i].data.u64))) != NULL)
+                                        {
+                                                conn_event(log, epfd, c);
+                                        }
+                                        break;
+                                case EP_SUB:
+                                        if ((s = slab_lookup(&sub_slab, EP_ID(events[i].data.u64))) != NULL)
+                                        {
+                                                sub_input(s);
+                                        }
+                                        break;
+                                case EP_SIGNAL:
+                                        while (read(signal_fd, &si, sizeof(si)) == sizeof(si))
+                                        {
+                                                sig_flag = (si.ssi_signo == SIGTERM) ? 4 : (sig_flag == 4 ? 4 : 6);
+                                        }
+                                        break;
+                                case EP_TIMER:
+                                        read(timerfd, &expired, sizeof(expired));
+                                        armed = 0;
+                                        break;
+                                case EP_URING:
+                                        ring_complete(log, epfd);
+                                        break;
+                        }
+                }
+
+                //Checkers that never finish their request, or stop
+                //reading the answer, lose their slot
+                now = mono_ms();
+                while (conns_head && now >= conns_head->deadline)
+                {
+                        if (conns_head->state == CONN_READ)
+                                stats_inc(STAT_REQUEST_TIMEOUTS);
+                        else if (conns_head->state == CONN_WRITE)
+                                stats_inc(STAT_WRITE_TIMEOUTS);
+                        conn_close(conns_head);
+                }
+                while (ring_head && now >= ring_head->deadline)
+                {
+                        if (ring_expire(ring_head) != 0)
+                        {
+                                break;
+                        }
+                }
+                if (reply.keepalive > 0 && now - keepalive_at >= reply.keepalive)
+                {
+                        sub_keepalive();
+                        keepalive_at = now;
+                }
+                if (drops_pending && reply.report_interval > 0 && now - reported_at >= reply.report_interval)
+                {
+                        report_drops(log);
+                        reported_at = now;
+                        drops_pending = 0;
+                }
+
+		//Signal Actions
+		if (sig_flag == 4)
+		{
+			put_log(log, "INFO - Shutting down HAwk...");
+			pthread_mutex_lock(&state.lock);
+			state.stop = 1;
+			pthread_cond_broadcast(&state.wake);
+			pthread_mutex_unlock(&state.lock);
+			report_drops(log);
+        		put_log(log, "INFO - Releasing Socket");
+			for (int i = 0; i < nlisten; i++)
+			{
+        			close(listenfds[i]);
+			}
+			while (conns_head)
+			{
+				conn_close(conns_head);
+			}
+			while (subs)
+			{
+				sub_close(subs);
+			}
+			//Closes every direct descriptor with it
+			if (ring_listenfd >= 0)
+			{
+				uring_close(&ring);
+			}
+			close(timerfd);
+			close(epfd);
+			//Freeing configuration dictionary
+			iniparser_freedict(conf);
+			break;
+		}
+		if (sig_flag == 6)
+		{
+			put_log(log, "INFO - Received HUP. Reloading...");
+			reopen_logs(log);
+			put_log(log, "INFO - Successfully reloaded logs");
+			//free(conf);
+			iniparser_freedict(conf);
+			conf = load_conf();
+			pthread_mutex_lock(&state.lock);
+			load_probe_conf(conf, &state.probe);
+			load_reply_conf(conf, &reply);
+			load_policy_conf(conf, &pc);
+			policy_configure(&state.policy, &pc);
+			load_breaker_conf(conf, &bc);
+			breaker_configure(&state.breaker, &bc);
+			load_health_rule(conf, log, &state.health);
+			//Under the same lock, so a round never sees checks from one
+			//configuration and probe settings from the other
+			load_checks(conf, log);
+			pthread_mutex_unlock(&state.lock);
+			load_admit_conf(conf, &ac);
+			admit_configure(&admission, &ac);
+			sig_flag = 0;	
+		}
+        }
+	return 0;
+}
+
+int main(void)
+{
+        pid_t pid, sid;
+        pthread_t poller;
+        pthread_t pusher;
+        pthread_attr_t attr;
+        int pushing = 0;
+        struct timespec until;
+        int listenfds[HAWK_MAX_LISTENERS];
+        int listenkinds[HAWK_MAX_LISTENERS];
+        int nlisten = 0;
+        int inherited = 0;
+        struct admit_conf ac;
+        struct rlimit nofile;
+        sigset_t sigs;
+        struct listen_conf lc;
+        struct sockaddr_storage ss;
+        socklen_t sslen = 0;
+        char notes[HAWK_MAX_LISTENERS][192];
+        char entry[sizeof(notes[0]) + 64];
+
+        start_ms = mono_ms();
+
+        //Take over sockets from a socket activating supervisor. LISTEN_PID
+        //names the exec'd process, so this has to happen before forking
+        nlisten = listen_fds_inherit(listenfds, listenkinds, HAWK_MAX_LISTENERS);
+        inherited = nlisten;
+
+        //Fork off the parent process
+        pid = fork();
+        if (pid < 0) {
+                exit(EXIT_FAILURE);
+        }
+        //If we got a good PID, then we can exit the parent process
+        if (pid > 0) {
+                exit(EXIT_SUCCESS);
+        }
+
+        //Change the file mode mask
+        umask(0);       
+
+	//Load Configuration File        
+        dictionary *conf = load_conf();
+
+	//Bind before anything else so early checks wait in the backlog
+	//instead of being refused
+	if (nlisten == 0)
+	{
+		listenfds[nlisten] = socket_init(conf, "hawk:port", LISTEN_HTTP, notes[nlisten], sizeof(notes[0]));
+		listenkinds[nlisten++] = LISTEN_HTTP;
+		if (strcmp(get_config(conf, "hawk:agent_port"), "NULL") != 0)
+		{
+			listenfds[nlisten] = socket_init(conf, "hawk:agent_port", LISTEN_AGENT, notes[nlisten], sizeof(notes[0]));
+			listenkinds[nlisten++] = LISTEN_AGENT;
+		}
+		if (strcmp(get_config(conf, "events:port"), "NULL") != 0)
+		{
+			listenfds[nlisten] = socket_init(conf, "events:port", LISTEN_EVENTS, notes[nlisten], sizeof(notes[0]));
+			listenkinds[nlisten++] = LISTEN_EVENTS;
+		}
+	}
+	//Pre-bound sockets get the same options; listening again resizes
+	//the backlog
+	for (int i = 0; i < inherited; i++)
+	{
+		load_listen_conf(conf, listenkinds[i], &lc);
+		listen_tune(listenfds[i], &lc, notes[i], sizeof(notes[0]));
+		listen(listenfds[i], lc.backlog);
+	}
+
+        //Opening Log
+	FILE *log = open_logs();
+	for (int i = 0; i < nlisten; i++)
+	{
+		sslen = sizeof(ss);
+		getsockname(listenfds[i], (struct sockaddr *)&ss, &sslen);
+		snprintf(entry, sizeof(entry), "INFO - %s listener on port %d: %.*s", listen_names[listenkinds[i]],
+			ss.ss_family == AF_INET6 ? ntohs(((struct sockaddr_in6 *)&ss)->sin6_port) : ntohs(((struct sockaddr_in *)&ss)->sin_port), (int)sizeof(notes[0]) - 1, notes[i]);
+		put_log(log, entry);
+	}
+
+	//Needs root, and has to be in place before the threads start
+	process_init(conf, log);
+
+	//Restore persisted state before dropping privileges
+	state_init(conf, log);
+
+	//Query for UID/GID
+	uid_t id = getid_byName(get_config(conf, "hawk:daemon_user"));
+
+	//Set UID
+	if (setuid(id) != 0)
+	{
+		put_log(log, "FATAL - Could not set UID for daemon");
+		exit(1);
+	}
+	
+        //Create a new SID for the child process 
+        sid = setsid();
+        if (sid < 0) {
+                put_log(log, "FATAL - Session ID was not set properly");
+                exit(EXIT_FAILURE);
+        }
+
+	//Write PID file
+	if(strcmp(get_config(conf, "hawk:pid_path"),"") > 0)
+	{
+		FILE *pidfile;
+		pidfile = fopen(get_config(conf, "hawk:pid_path"), "w");
+		fprintf(pidfile, "%d", getpid());
+		fflush(pidfile);
+	}
+        
+        //Close out the standard file descriptors
+        fflush(stdin);
 	fflush(stdout);
 	fflush(stderr);
         close(STDIN_FILENO);
         close(STDOUT_FILENO);
         close(STDERR_FILENO);
 
-	signal(SIGHUP, signal_handler);
-	signal(SIGTERM, signal_handler);
+	//Signals are read from a descriptor in the event loop. Blocked
+	//here, before any thread starts, so no thread takes them itself
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGHUP);
+	sigaddset(&sigs, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+	signal_fd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (signal_fd < 0)
+	{
+		put_log(log, "FATAL - Could not create signalfd");
+		exit(1);
+	}
+	//Peers that hang up are seen as write errors
+	signal(SIGPIPE, SIG_IGN);
+
+	//Idle subscribers each hold a descriptor
+	if (getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur < nofile.rlim_max)
+	{
+		nofile.rlim_cur = nofile.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &nofile);
+	}
 
-        //Begin main routine
+	//Per-client buckets and connection slots
+	load_admit_conf(conf, &ac);
+	if (admit_init(&admission, &ac, iniparser_getint(conf, "limits:clients", 1024)) != 0
+		|| metrics_init(admission.size) != 0)
+	{
+		put_log(log, "FATAL - Could not allocate client table");
+		exit(1);
+	}
+	//The caps in force at startup size the slabs; a reload can lower
+	//them but not raise them past that
+	if (slab_init(&conn_slab, sizeof(struct hawk_conn), ac.max_conns > 0 ? ac.max_conns : 1024) != 0
+		|| slab_init(&sub_slab, sizeof(struct hawk_sub), reply.max_subscribers > 0 ? reply.max_subscribers : 1) != 0)
+	{
+		put_log(log, "FATAL - Could not preallocate connections");
+		exit(1);
+	}
+
+	//Start the poller - checks are answered from its results
 	put_log(log, "INFO - Starting HAwk...");
-        main_construct(log, conf, listenfd);	
+	if (inherited > 0)
+	{
+		snprintf(entry, sizeof(entry), "INFO - Serving on %d pre-bound listener(s)", inherited);
+		put_log(log, entry);
+	}
+	//Optional push to HAProxy's runtime API, off the probe path
+	//Locked thread stacks are resident in full; the default is far more
+	//than either thread uses
+	pthread_attr_init(&attr);
+	if (memory_locked)
+	{
+		pthread_attr_setstacksize(&attr, 512 * 1024);
+	}
+	if (push_init(conf, log) > 0)
+	{
+		pushing = pthread_create(&pusher, &attr, pusher_main, log) == 0;
+		if (!pushing)
+		{
+			put_log(log, "ERROR - Could not start HAProxy push thread");
+		}
+	}
+#ifndef HAWK_NO_LIBMYSQL
+	mysql_library_init(0, NULL, NULL);
+#endif
+	if (pthread_create(&poller, &attr, poller_main, log) != 0)
+	{
+		put_log(log, "FATAL - Could not start poller thread");
+		exit(1);
+	}
+
+        //Begin main routine
+        main_construct(log, conf, listenfds, listenkinds, nlisten);	
+
+	//A probe stuck in MySQL is not worth holding up shutdown
+	clock_gettime(CLOCK_REALTIME, &until);
+	until.tv_sec += 2;
+	if (pthread_timedjoin_np(poller, NULL, &until) != 0)
+	{
+		put_log(log, "ERROR - Poller still busy, exiting without it");
+		return 0;
+	}
+	if (pushing)
+	{
+		pthread_mutex_lock(&push.lock);
+		push.stop = 1;
+		pthread_cond_broadcast(&push.wake);
+		pthread_mutex_unlock(&push.lock);
+		if (pthread_timedjoin_np(pusher, NULL, &until) != 0)
+		{
+			put_log(log, "ERROR - HAProxy push still busy, exiting without it");
+			return 0;
+		}
+	}
+	statefile_close(state.persist);
+	stats_shm_close();
+        put_log(log, "INFO - Closing Log Files");
+	fflush(log);
+	fclose(log);
 	return 0;
 }
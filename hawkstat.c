@@ -0,0 +1,124 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*	hawkstat - print HAwk's status from shared memory
+
+	Usage: hawkstat [-q] [-a max_age_ms] [segment name]
+
+	-q prints nothing and exits 0 when the node is synced, 1 when it is
+	not and 2 when no status is available. A status older than -a
+	milliseconds (default 30000, the default hawk:max_stale), or one left
+	by a HAwk that is no longer running, counts as not synced: a segment
+	outlives a daemon that crashed or was killed	*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include "lib/hawkshm/src/hawkshm.h"
+
+//The pid is cleared on a clean shutdown only. EPERM means it exists;
+//a zombie is a HAwk that died and has not been reaped yet
+static int running(const struct hawkshm_segment *seg)
+{
+	char path[32];
+	char buf[256];
+	char *state = NULL;
+	FILE *f = NULL;
+	size_t n = 0;
+
+	if (seg->pid == 0 || (kill(seg->pid, 0) != 0 && errno == ESRCH))
+	{
+		return 0;
+	}
+	snprintf(path, sizeof(path), "/proc/%d/stat", seg->pid);
+	if ((f = fopen(path, "r")) == NULL)
+	{
+		return 1;
+	}
+	n = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[n] = '\0';
+	state = strrchr(buf, ')');
+	return !(state && state[1] == ' ' && (state[2] == 'Z' || state[2] == 'X'));
+}
+
+int main(int argc, char **argv)
+{
+	const struct hawkshm_segment *seg = NULL;
+	struct hawkshm_status st;
+	const char *name = HAWKSHM_DEFAULT_NAME;
+	long long max_age = 30000;
+	int quiet = 0;
+	int opt = 0;
+
+	while ((opt = getopt(argc, argv, "qa:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'q':
+				quiet = 1;
+				break;
+			case 'a':
+				max_age = atoll(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-q] [-a max_age_ms] [segment name]\n", argv[0]);
+				return 2;
+		}
+	}
+	if (optind < argc)
+	{
+		name = argv[optind];
+	}
+
+	seg = hawkshm_open(name);
+	if (seg == NULL || hawkshm_read(seg, &st) != 0)
+	{
+		if (!quiet)
+		{
+			fprintf(stderr, "hawkstat: %s: %s\n", name, errno == EAGAIN ? "status is being published and never finished; did HAwk die?" : strerror(errno));
+		}
+		return 2;
+	}
+	if (quiet)
+	{
+		return (running(seg) && hawkshm_age(&st) <= max_age && st.node == HAWKSHM_SYNCED) ? 0 : 1;
+	}
+
+	printf("node\t\t%s%s\n", hawkshm_node_name(st.node), st.fresh ? "" : " (not yet probed)");
+	printf("weight\t\t%d\n", st.weight);
+	printf("wsrep_state\t%s\n", st.state);
+	printf("probe_ok\t%s\n", st.ok ? "yes" : "no");
+	printf("age_ms\t\t%lld%s\n", (long long)hawkshm_age(&st), hawkshm_age(&st) > max_age ? " (too old)" : "");
+	printf("pid\t\t%d%s\n", seg->pid, seg->pid == 0 ? " (stopped)" : running(seg) ? "" : " (not running)");
+	printf("generation\t%llu\n", (unsigned long long)st.generation);
+	for (uint32_t i = 0; i < seg->nvars && i < HAWKSHM_MAX_VARS; i++)
+	{
+		printf("var.%s\t%lld\n", seg->var_names[i], (long long)st.var[i]);
+	}
+	for (uint32_t i = 0; i < seg->ncounters && i < HAWKSHM_MAX_COUNTERS; i++)
+	{
+		printf("count.%s\t%llu\n", seg->counter_names[i], (unsigned long long)hawkshm_counter(seg, seg->counter_names[i]));
+	}
+	hawkshm_close(seg);
+	return 0;
+}
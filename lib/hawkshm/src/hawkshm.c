@@ -0,0 +1,156 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hawkshm.h"
+
+#define STATUS_WORDS	(sizeof(struct hawkshm_status) / sizeof(uint64_t))
+//A writer publishes in well under a microsecond; one still mid-publish
+//after this many tries has died there and left seq odd
+#define READ_TRIES	100000
+
+/*	Map Segment				*/
+const struct hawkshm_segment* hawkshm_open(const char *name)
+{
+	struct hawkshm_segment *seg = NULL;
+	struct stat st;
+	int fd = shm_open(name ? name : HAWKSHM_DEFAULT_NAME, O_RDONLY, 0);
+
+	if (fd < 0)
+	{
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*seg))
+	{
+		close(fd);
+		errno = EPROTO;
+		return NULL;
+	}
+	seg = mmap(NULL, sizeof(*seg), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (seg == MAP_FAILED)
+	{
+		return NULL;
+	}
+	if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != HAWKSHM_MAGIC || seg->version != HAWKSHM_VERSION)
+	{
+		munmap(seg, sizeof(*seg));
+		errno = EPROTO;
+		return NULL;
+	}
+	return seg;
+}
+
+void hawkshm_close(const struct hawkshm_segment *seg)
+{
+	if (seg)
+	{
+		munmap((void *)seg, sizeof(*seg));
+	}
+}
+
+/*	Seqlock Read				*/
+int hawkshm_read(const struct hawkshm_segment *seg, struct hawkshm_status *out)
+{
+	const uint64_t *src = (const uint64_t *)&seg->status;
+	uint64_t *dst = (uint64_t *)out;
+	uint64_t before = 0;
+	uint64_t after = 0;
+
+	if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != HAWKSHM_MAGIC)
+	{
+		errno = EPROTO;
+		return -1;
+	}
+	for (int tries = 0; tries < READ_TRIES; tries++)
+	{
+		before = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+		if (before & 1)
+		{
+			continue;
+		}
+		for (size_t i = 0; i < STATUS_WORDS; i++)
+		{
+			dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&seg->seq, __ATOMIC_RELAXED);
+		if (before == after)
+		{
+			return 0;
+		}
+	}
+	errno = EAGAIN;
+	return -1;
+}
+
+/*	Lookups					*/
+uint64_t hawkshm_counter(const struct hawkshm_segment *seg, const char *name)
+{
+	for (uint32_t i = 0; i < seg->ncounters && i < HAWKSHM_MAX_COUNTERS; i++)
+	{
+		if (strncmp(seg->counter_names[i], name, HAWKSHM_NAME_LEN) == 0)
+		{
+			return __atomic_load_n(&seg->counter[i], __ATOMIC_RELAXED);
+		}
+	}
+	return 0;
+}
+
+int hawkshm_var(const struct hawkshm_segment *seg, const struct hawkshm_status *st, const char *name, int64_t *value)
+{
+	for (uint32_t i = 0; i < seg->nvars && i < HAWKSHM_MAX_VARS; i++)
+	{
+		if (strncmp(seg->var_names[i], name, HAWKSHM_NAME_LEN) == 0)
+		{
+			*value = st->var[i];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int64_t hawkshm_age(const struct hawkshm_status *st)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - st->probed_at;
+}
+
+const char* hawkshm_node_name(int node)
+{
+	switch (node)
+	{
+		case HAWKSHM_WARMING:
+			return "warming";
+		case HAWKSHM_SYNCED:
+			return "synced";
+		case HAWKSHM_NOT_SYNCED:
+			return "not_synced";
+		default:
+			return "unknown";
+	}
+}
@@ -0,0 +1,102 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*	hawkshm - read HAwk's node status from shared memory
+	
+	HAwk publishes its status, weight and counters into a POSIX shared
+	memory segment (hawk:shm_name). Once a segment is mapped, reads are
+	plain memory loads: no syscalls and no connection to HAwk or MySQL.
+
+	Timestamps are CLOCK_MONOTONIC milliseconds, which is system wide, so
+	a reader can compute the age of the status with its own clock.	*/
+
+#ifndef _HAWKSHM_H_
+#define _HAWKSHM_H_
+
+#include <stdint.h>
+
+#define HAWKSHM_MAGIC		0x4d534b57	/* "WKSM" */
+#define HAWKSHM_VERSION		1
+#define HAWKSHM_MAX_VARS	32
+#define HAWKSHM_MAX_COUNTERS	32
+#define HAWKSHM_NAME_LEN	24
+#define HAWKSHM_DEFAULT_NAME	"/hawk"
+
+/*	Node States				*/
+#define HAWKSHM_WARMING		0
+#define HAWKSHM_SYNCED		1
+#define HAWKSHM_NOT_SYNCED	2
+
+/*	Status Record				*/
+struct hawkshm_status
+{
+	int32_t node;
+	int32_t weight;
+	int32_t fresh;			//from a probe of the running process
+	int32_t ok;			//last probe completed
+	int64_t probed_at;		//CLOCK_MONOTONIC ms
+	uint64_t generation;		//bumped on every publish
+	int64_t var[HAWKSHM_MAX_VARS];	//named by var_names
+	char state[16];			//raw wsrep_local_state
+};
+
+/*	Segment Layout				*/
+struct hawkshm_segment
+{
+	//Written once; magic is stored last, so a zero magic means not ready
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	int32_t pid;			//0 after a clean shutdown only
+	uint32_t nvars;
+	uint32_t ncounters;
+	char var_names[HAWKSHM_MAX_VARS][HAWKSHM_NAME_LEN];
+	char counter_names[HAWKSHM_MAX_COUNTERS][HAWKSHM_NAME_LEN];
+
+	//Status under a seqlock: seq is odd while it is being rewritten
+	uint64_t seq __attribute__((aligned(64)));
+	struct hawkshm_status status;
+
+	//Monotonic counters, each updated with an atomic add
+	uint64_t counter[HAWKSHM_MAX_COUNTERS] __attribute__((aligned(64)));
+};
+
+/*	Map a segment read-only. Returns NULL with errno set on failure,
+	EPROTO if it is not a segment of this version	*/
+const struct hawkshm_segment* hawkshm_open(const char *name);
+
+/*	Consistent copy of the status. Returns -1 with errno EPROTO if the
+	segment is no longer valid, or EAGAIN if no consistent copy could be
+	taken (a writer died while publishing)	*/
+int hawkshm_read(const struct hawkshm_segment *seg, struct hawkshm_status *out);
+
+/*	Counter by name, or 0 when the name is unknown	*/
+uint64_t hawkshm_counter(const struct hawkshm_segment *seg, const char *name);
+
+/*	Variable by name; returns -1 when the name is unknown	*/
+int hawkshm_var(const struct hawkshm_segment *seg, const struct hawkshm_status *st, const char *name, int64_t *value);
+
+/*	Milliseconds since the status was probed	*/
+int64_t hawkshm_age(const struct hawkshm_status *st);
+
+const char* hawkshm_node_name(int node);
+
+void hawkshm_close(const struct hawkshm_segment *seg);
+
+#endif
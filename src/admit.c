@@ -0,0 +1,164 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "admit.h"
+
+//Entries looked at before an insert gives up and evicts
+#define ADMIT_PROBES		8
+
+/*	Setup					*/
+int admit_init(struct admit *a, const struct admit_conf *conf, int size)
+{
+	int n = 16;
+
+	while (n < size && n < (1 << 20))
+	{
+		n <<= 1;
+	}
+	memset(a, 0, sizeof(*a));
+	a->conf = *conf;
+	a->clients = calloc(n, sizeof(*a->clients));
+	if (a->clients == NULL)
+	{
+		return -1;
+	}
+	a->size = n;
+	return 0;
+}
+
+void admit_configure(struct admit *a, const struct admit_conf *conf)
+{
+	a->conf = *conf;
+}
+
+/*	Client Table				*/
+static unsigned int admit_hash(const uint8_t *addr)
+{
+	//FNV-1a over the address
+	unsigned int h = 2166136261u;
+
+	for (int i = 0; i < 16; i++)
+	{
+		h = (h ^ addr[i]) * 16777619u;
+	}
+	return h;
+}
+
+struct admit_client* admit_client(struct admit *a, const uint8_t *addr, long long now)
+{
+	unsigned int h = admit_hash(addr);
+	struct admit_client *c = NULL;
+	struct admit_client *victim = NULL;
+
+	for (int i = 0; i < ADMIT_PROBES; i++)
+	{
+		c = &a->clients[(h + i) & (a->size - 1)];
+		if (c->used && memcmp(c->addr, addr, 16) == 0)
+		{
+			return c;
+		}
+		if (!c->used)
+		{
+			victim = c;
+			break;
+		}
+		if (c->conns == 0 && (victim == NULL || c->seen < victim->seen))
+		{
+			victim = c;
+		}
+	}
+	if (victim == NULL)
+	{
+		return NULL;
+	}
+
+	memset(victim, 0, sizeof(*victim));
+	memcpy(victim->addr, addr, 16);
+	victim->used = 1;
+	victim->tokens = (long long)(a->conf.burst > 0 ? a->conf.burst : 1) * 1000;
+	victim->seen = now;
+	return victim;
+}
+
+/*	Token Bucket And Fair Share		*/
+int admit_check(struct admit *a, struct admit_client *c, int needs_slot, long long now)
+{
+	long long depth = (long long)(a->conf.burst > 0 ? a->conf.burst : 1) * 1000;
+	int share = 0;
+
+	if (a->conf.rate > 0)
+	{
+		//rate checks per second is rate thousandths per ms
+		if (now > c->seen)
+		{
+			c->tokens += (now - c->seen) * a->conf.rate;
+		}
+		if (c->tokens > depth)
+		{
+			c->tokens = depth;
+		}
+	}
+	if (now > c->seen)
+	{
+		c->seen = now;
+	}
+
+	if (a->conf.rate > 0 && c->tokens < 1000)
+	{
+		c->rate_drops++;
+		return ADMIT_RATE;
+	}
+	if (needs_slot && a->conf.max_conns > 0)
+	{
+		//Max-min fair: each client holding connections gets an equal
+		//part of the slots, a newcomer always gets at least one
+		share = a->conf.max_conns / (a->active + (c->conns == 0));
+		if (a->conns >= a->conf.max_conns || c->conns >= (share > 0 ? share : 1))
+		{
+			c->busy_drops++;
+			return ADMIT_BUSY;
+		}
+	}
+	if (a->conf.rate > 0)
+	{
+		c->tokens -= 1000;
+	}
+	c->answered++;
+	return ADMIT_OK;
+}
+
+void admit_open(struct admit *a, struct admit_client *c)
+{
+	if (c->conns++ == 0)
+	{
+		a->active++;
+	}
+	a->conns++;
+}
+
+void admit_close(struct admit *a, struct admit_client *c)
+{
+	if (--c->conns == 0)
+	{
+		a->active--;
+	}
+	a->conns--;
+}
@@ -0,0 +1,79 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ADMIT_H_
+#define _ADMIT_H_
+
+#include <stdint.h>
+
+/*	Admission Decisions			*/
+#define ADMIT_OK		0
+#define ADMIT_RATE		1	//client is over its token bucket
+#define ADMIT_BUSY		2	//no connection slot, or not its fair share
+
+struct admit_conf
+{
+	int rate;			//checks per second per client, 0 disables
+	int burst;			//bucket depth in checks
+	int max_conns;			//connections held open at once, 0 disables
+};
+
+//One per source address, kept in a fixed open-addressed table
+struct admit_client
+{
+	uint8_t addr[16];		//IPv4 as a v4-mapped IPv6 address
+	int used;
+	int conns;			//connections it holds open
+	long long tokens;		//thousandths of a check
+	long long seen;			//ms of the last check
+	uint64_t answered;
+	uint64_t rate_drops;
+	uint64_t busy_drops;
+	uint64_t reported;		//drops already logged
+};
+
+struct admit
+{
+	struct admit_conf conf;
+	struct admit_client *clients;
+	int size;			//power of two
+	int conns;
+	int active;			//clients holding at least one connection
+};
+
+/*	Allocate a table for about size clients. Returns -1 on failure */
+int admit_init(struct admit *a, const struct admit_conf *conf, int size);
+
+void admit_configure(struct admit *a, const struct admit_conf *conf);
+
+/*	Find or take the entry for addr. When the table is full the entry
+	seen least recently without open connections is reused; NULL if
+	there is none	*/
+struct admit_client* admit_client(struct admit *a, const uint8_t *addr, long long now);
+
+/*	Charge one check to c at now (ms on any monotonic clock). With
+	needs_slot the check wants to hold a connection open as well.
+	Returns ADMIT_*; drops are counted on the client	*/
+int admit_check(struct admit *a, struct admit_client *c, int needs_slot, long long now);
+
+/*	Connection slots, taken after ADMIT_OK for checks that need one */
+void admit_open(struct admit *a, struct admit_client *c);
+void admit_close(struct admit *a, struct admit_client *c);
+
+#endif
@@ -0,0 +1,123 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "breaker.h"
+
+/*	Setup					*/
+void breaker_init(struct breaker *b, const struct breaker_conf *conf, unsigned int seed)
+{
+	memset(b, 0, sizeof(*b));
+	b->conf = *conf;
+	b->state = BREAKER_CLOSED;
+	b->rng = seed ? seed : 1;
+}
+
+void breaker_configure(struct breaker *b, const struct breaker_conf *conf)
+{
+	b->conf = *conf;
+}
+
+/*	Backoff					*/
+//xorshift32; only has to keep a fleet of HAwks from retrying in step
+static unsigned int breaker_random(struct breaker *b)
+{
+	b->rng ^= b->rng << 13;
+	b->rng ^= b->rng >> 17;
+	b->rng ^= b->rng << 5;
+	return b->rng;
+}
+
+static void breaker_trip(struct breaker *b, long long now)
+{
+	long long delay = b->backoff;
+	int jitter = b->conf.jitter;
+
+	if (jitter > 100)
+	{
+		jitter = 100;
+	}
+	if (jitter > 0)
+	{
+		//Only ever shorten, so backoff_max stays a maximum
+		delay -= delay * jitter / 100 * (breaker_random(b) % 1000) / 1000;
+	}
+	b->state = BREAKER_OPEN;
+	b->retry_at = now + delay;
+}
+
+/*	Probe Gate				*/
+int breaker_allow(struct breaker *b, long long now, int *events)
+{
+	*events = 0;
+	if (b->conf.failures <= 0)
+	{
+		//Disabled, possibly by a reload while open
+		b->state = BREAKER_CLOSED;
+		return 1;
+	}
+	if (b->state == BREAKER_OPEN)
+	{
+		if (now < b->retry_at)
+		{
+			return 0;
+		}
+		b->state = BREAKER_HALF_OPEN;
+		*events |= BREAKER_EV_HALF_OPEN;
+	}
+	return 1;
+}
+
+int breaker_result(struct breaker *b, int ok, long long now)
+{
+	if (b->conf.failures <= 0)
+	{
+		return 0;
+	}
+	if (ok)
+	{
+		b->failures = 0;
+		b->backoff = 0;
+		if (b->state != BREAKER_CLOSED)
+		{
+			b->state = BREAKER_CLOSED;
+			return BREAKER_EV_CLOSE;
+		}
+		return 0;
+	}
+
+	if (b->state == BREAKER_HALF_OPEN)
+	{
+		//Trial failed: back off further
+		b->backoff *= 2;
+		if (b->backoff > b->conf.backoff_max)
+		{
+			b->backoff = b->conf.backoff_max;
+		}
+		breaker_trip(b, now);
+		return BREAKER_EV_OPEN;
+	}
+	if (b->state == BREAKER_CLOSED && ++b->failures >= b->conf.failures)
+	{
+		b->backoff = b->conf.backoff_min;
+		breaker_trip(b, now);
+		return BREAKER_EV_OPEN;
+	}
+	return 0;
+}
@@ -0,0 +1,64 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _BREAKER_H_
+#define _BREAKER_H_
+
+/*	Circuit States				*/
+#define BREAKER_CLOSED		0	//probing normally
+#define BREAKER_OPEN		1	//MySQL is left alone until retry_at
+#define BREAKER_HALF_OPEN	2	//one trial probe is allowed
+
+/*	Events Returned By breaker_allow/breaker_result	*/
+#define BREAKER_EV_OPEN		0x01
+#define BREAKER_EV_HALF_OPEN	0x02
+#define BREAKER_EV_CLOSE	0x04
+
+struct breaker_conf
+{
+	int failures;			//consecutive failures that open it, 0 disables
+	long long backoff_min;		//ms before the first trial probe
+	long long backoff_max;		//ms, cap for the doubling backoff
+	int jitter;			//percent taken off each backoff at random
+};
+
+struct breaker
+{
+	struct breaker_conf conf;
+	int state;
+	int failures;			//consecutive, while closed
+	long long backoff;		//current backoff before jitter
+	long long retry_at;		//when the next trial probe is due
+	unsigned int rng;
+};
+
+/*	Start closed. seed drives the jitter	*/
+void breaker_init(struct breaker *b, const struct breaker_conf *conf, unsigned int seed);
+
+/*	Swap thresholds on reload without losing the circuit state */
+void breaker_configure(struct breaker *b, const struct breaker_conf *conf);
+
+/*	Whether a probe may run at now (ms on any monotonic clock). An open
+	circuit that is due turns half-open; events gets BREAKER_EV_* */
+int breaker_allow(struct breaker *b, long long now, int *events);
+
+/*	Feed the outcome of a probe that was allowed. Returns BREAKER_EV_* */
+int breaker_result(struct breaker *b, int ok, long long now);
+
+#endif
@@ -0,0 +1,483 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "expr.h"
+
+/*	Opcodes					*/
+//Operands follow the opcode inline: one byte for PUSH8/CONST/VAR, a
+//little-endian 16 bit forward offset for the short-circuit jumps.
+enum expr_op
+{
+	OP_PUSH8,
+	OP_CONST,
+	OP_VAR,
+	OP_NOT,
+	OP_NEG,
+	OP_BOOL,
+	OP_ADD,
+	OP_SUB,
+	OP_MUL,
+	OP_DIV,
+	OP_MOD,
+	OP_EQ,
+	OP_NE,
+	OP_LT,
+	OP_LE,
+	OP_GT,
+	OP_GE,
+	OP_ORJ,		//if top is true: top = 1 and jump, else pop
+	OP_ANDJ		//if top is false: top = 0 and jump, else pop
+};
+
+/*	Compiler State				*/
+struct parser
+{
+	const char *src;
+	const char *p;
+	const char *const *names;
+	int nnames;
+	struct expr *e;
+	int sp;
+	char *err;
+	size_t errlen;
+	int failed;
+};
+
+static void parse_or(struct parser *ps);
+
+static void fail(struct parser *ps, const char *what)
+{
+	if (!ps->failed)
+	{
+		snprintf(ps->err, ps->errlen, "%s at column %d", what, (int)(ps->p - ps->src) + 1);
+		ps->failed = 1;
+	}
+}
+
+static void skip_space(struct parser *ps)
+{
+	while (isspace((unsigned char)*ps->p))
+	{
+		ps->p++;
+	}
+}
+
+//Consume tok if it is next, taking care that "<" does not eat "<="
+static int accept_tok(struct parser *ps, const char *tok)
+{
+	size_t n = strlen(tok);
+
+	skip_space(ps);
+	if (strncmp(ps->p, tok, n) != 0)
+	{
+		return 0;
+	}
+	if (n == 1 && strchr("<>!=", tok[0]) && ps->p[1] == '=')
+	{
+		return 0;
+	}
+	if (n == 1 && (tok[0] == '|' || tok[0] == '&') && ps->p[1] == tok[0])
+	{
+		return 0;
+	}
+	ps->p += n;
+	return 1;
+}
+
+/*	Emission				*/
+static void emit(struct parser *ps, int op, int stack)
+{
+	if (ps->e->len >= EXPR_MAX_CODE)
+	{
+		fail(ps, "expression too long");
+		return;
+	}
+	ps->e->code[ps->e->len++] = (uint8_t)op;
+	ps->sp += stack;
+	if (ps->sp > ps->e->depth)
+	{
+		ps->e->depth = ps->sp;
+	}
+	if (ps->e->depth > EXPR_MAX_STACK)
+	{
+		fail(ps, "expression nested too deeply");
+	}
+}
+
+static void emit_byte(struct parser *ps, int byte)
+{
+	emit(ps, byte, 0);
+}
+
+static void emit_number(struct parser *ps, int64_t v)
+{
+	int i = 0;
+
+	if (v >= 0 && v <= 255)
+	{
+		emit(ps, OP_PUSH8, 1);
+		emit_byte(ps, (int)v);
+		return;
+	}
+	for (i = 0; i < ps->e->nconst && ps->e->consts[i] != v; i++);
+	if (i == ps->e->nconst)
+	{
+		if (i == EXPR_MAX_CONST)
+		{
+			fail(ps, "too many constants");
+			return;
+		}
+		ps->e->consts[ps->e->nconst++] = v;
+	}
+	emit(ps, OP_CONST, 1);
+	emit_byte(ps, i);
+}
+
+//Returns the offset of the jump operand so it can be patched
+static int emit_jump(struct parser *ps, int op)
+{
+	emit(ps, op, -1);
+	emit_byte(ps, 0);
+	emit_byte(ps, 0);
+	return ps->e->len - 2;
+}
+
+static void patch_jump(struct parser *ps, int at)
+{
+	int distance = ps->e->len - (at + 2);
+
+	if (ps->failed)
+	{
+		return;
+	}
+	ps->e->code[at] = distance & 0xff;
+	ps->e->code[at + 1] = (distance >> 8) & 0xff;
+}
+
+/*	Grammar					*/
+//	or      := and ( "||" and )*
+//	and     := cmp ( "&&" cmp )*
+//	cmp     := sum ( ("=="|"!="|"<"|"<="|">"|">=") sum )?
+//	sum     := term ( ("+"|"-") term )*
+//	term    := unary ( ("*"|"/"|"%") unary )*
+//	unary   := ("!"|"-") unary | primary
+//	primary := number | name | "true" | "false" | "(" or ")"
+
+static void parse_primary(struct parser *ps)
+{
+	const char *start = NULL;
+	size_t n = 0;
+	int i = 0;
+
+	skip_space(ps);
+	if (accept_tok(ps, "("))
+	{
+		parse_or(ps);
+		if (!accept_tok(ps, ")"))
+		{
+			fail(ps, "expected ')'");
+		}
+		return;
+	}
+	if (isdigit((unsigned char)*ps->p))
+	{
+		emit_number(ps, strtoll(ps->p, (char **)&ps->p, 10));
+		return;
+	}
+	if (!isalpha((unsigned char)*ps->p) && *ps->p != '_')
+	{
+		fail(ps, *ps->p ? "unexpected character" : "unexpected end of expression");
+		return;
+	}
+
+	start = ps->p;
+	while (isalnum((unsigned char)*ps->p) || *ps->p == '_')
+	{
+		ps->p++;
+	}
+	n = ps->p - start;
+
+	if (n == 4 && strncmp(start, "true", n) == 0)
+	{
+		emit_number(ps, 1);
+		return;
+	}
+	if (n == 5 && strncmp(start, "false", n) == 0)
+	{
+		emit_number(ps, 0);
+		return;
+	}
+	for (i = 0; i < ps->nnames; i++)
+	{
+		if (strlen(ps->names[i]) == n && strncmp(start, ps->names[i], n) == 0)
+		{
+			emit(ps, OP_VAR, 1);
+			emit_byte(ps, i);
+			return;
+		}
+	}
+	ps->p = start;
+	fail(ps, "unknown variable");
+}
+
+static void parse_unary(struct parser *ps)
+{
+	if (accept_tok(ps, "!"))
+	{
+		parse_unary(ps);
+		emit(ps, OP_NOT, 0);
+	}
+	else if (accept_tok(ps, "-"))
+	{
+		parse_unary(ps);
+		emit(ps, OP_NEG, 0);
+	}
+	else
+	{
+		parse_primary(ps);
+	}
+}
+
+static void parse_term(struct parser *ps)
+{
+	int op = 0;
+
+	parse_unary(ps);
+	while (!ps->failed)
+	{
+		if (accept_tok(ps, "*"))
+			op = OP_MUL;
+		else if (accept_tok(ps, "/"))
+			op = OP_DIV;
+		else if (accept_tok(ps, "%"))
+			op = OP_MOD;
+		else
+			break;
+		parse_unary(ps);
+		emit(ps, op, -1);
+	}
+}
+
+static void parse_sum(struct parser *ps)
+{
+	int op = 0;
+
+	parse_term(ps);
+	while (!ps->failed)
+	{
+		if (accept_tok(ps, "+"))
+			op = OP_ADD;
+		else if (accept_tok(ps, "-"))
+			op = OP_SUB;
+		else
+			break;
+		parse_term(ps);
+		emit(ps, op, -1);
+	}
+}
+
+static void parse_cmp(struct parser *ps)
+{
+	int op = -1;
+
+	parse_sum(ps);
+	if (accept_tok(ps, "=="))
+		op = OP_EQ;
+	else if (accept_tok(ps, "!="))
+		op = OP_NE;
+	else if (accept_tok(ps, "<="))
+		op = OP_LE;
+	else if (accept_tok(ps, ">="))
+		op = OP_GE;
+	else if (accept_tok(ps, "<"))
+		op = OP_LT;
+	else if (accept_tok(ps, ">"))
+		op = OP_GT;
+	if (op != -1)
+	{
+		parse_sum(ps);
+		emit(ps, op, -1);
+	}
+}
+
+static void parse_and(struct parser *ps)
+{
+	int at = 0;
+
+	parse_cmp(ps);
+	while (!ps->failed && accept_tok(ps, "&&"))
+	{
+		at = emit_jump(ps, OP_ANDJ);
+		parse_cmp(ps);
+		emit(ps, OP_BOOL, 0);
+		patch_jump(ps, at);
+	}
+}
+
+static void parse_or(struct parser *ps)
+{
+	int at = 0;
+
+	parse_and(ps);
+	while (!ps->failed && accept_tok(ps, "||"))
+	{
+		at = emit_jump(ps, OP_ORJ);
+		parse_and(ps);
+		emit(ps, OP_BOOL, 0);
+		patch_jump(ps, at);
+	}
+}
+
+/*	Compile					*/
+int expr_compile(struct expr *e, const char *src, const char *const *names, int nnames, char *err, size_t errlen)
+{
+	struct parser ps;
+
+	memset(e, 0, sizeof(*e));
+	memset(&ps, 0, sizeof(ps));
+	ps.src = ps.p = src;
+	ps.names = names;
+	ps.nnames = nnames;
+	ps.e = e;
+	ps.err = err;
+	ps.errlen = errlen;
+
+	parse_or(&ps);
+	skip_space(&ps);
+	if (!ps.failed && *ps.p != '\0')
+	{
+		fail(&ps, "unexpected input");
+	}
+	return ps.failed ? -1 : 0;
+}
+
+/*	Evaluate				*/
+int64_t expr_eval(const struct expr *e, const int64_t *vars)
+{
+	int64_t stack[EXPR_MAX_STACK];
+	int64_t *top = stack - 1;
+	const uint8_t *pc = e->code;
+	const uint8_t *end = e->code + e->len;
+
+	while (pc < end)
+	{
+		switch (*pc++)
+		{
+			case OP_PUSH8:
+				*++top = *pc++;
+				break;
+			case OP_CONST:
+				*++top = e->consts[*pc++];
+				break;
+			case OP_VAR:
+				*++top = vars[*pc++];
+				break;
+			case OP_NOT:
+				*top = !*top;
+				break;
+			//Arithmetic wraps in two's complement instead of overflowing,
+			//which C leaves undefined
+			case OP_NEG:
+				*top = (int64_t)(0 - (uint64_t)*top);
+				break;
+			case OP_BOOL:
+				*top = *top != 0;
+				break;
+			case OP_ADD:
+				top--;
+				top[0] = (int64_t)((uint64_t)top[0] + (uint64_t)top[1]);
+				break;
+			case OP_SUB:
+				top--;
+				top[0] = (int64_t)((uint64_t)top[0] - (uint64_t)top[1]);
+				break;
+			case OP_MUL:
+				top--;
+				top[0] = (int64_t)((uint64_t)top[0] * (uint64_t)top[1]);
+				break;
+			//Division by zero yields 0 and INT64_MIN / -1 wraps, rather
+			//than trapping the daemon
+			case OP_DIV:
+				top--;
+				if (top[1] == -1)
+					top[0] = (int64_t)(0 - (uint64_t)top[0]);
+				else
+					top[0] = top[1] ? top[0] / top[1] : 0;
+				break;
+			case OP_MOD:
+				top--;
+				top[0] = top[1] && top[1] != -1 ? top[0] % top[1] : 0;
+				break;
+			case OP_EQ:
+				top--;
+				top[0] = top[0] == top[1];
+				break;
+			case OP_NE:
+				top--;
+				top[0] = top[0] != top[1];
+				break;
+			case OP_LT:
+				top--;
+				top[0] = top[0] < top[1];
+				break;
+			case OP_LE:
+				top--;
+				top[0] = top[0] <= top[1];
+				break;
+			case OP_GT:
+				top--;
+				top[0] = top[0] > top[1];
+				break;
+			case OP_GE:
+				top--;
+				top[0] = top[0] >= top[1];
+				break;
+			case OP_ORJ:
+				if (*top)
+				{
+					*top = 1;
+					pc += pc[0] | (pc[1] << 8);
+				}
+				else
+				{
+					top--;
+				}
+				pc += 2;
+				break;
+			case OP_ANDJ:
+				if (!*top)
+				{
+					pc += pc[0] | (pc[1] << 8);
+				}
+				else
+				{
+					top--;
+				}
+				pc += 2;
+				break;
+			default:
+				return 0;
+		}
+	}
+	return top >= stack ? *top : 0;
+}
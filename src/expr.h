@@ -0,0 +1,52 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _EXPR_H_
+#define _EXPR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*	Health Expressions			*/
+//C-like integer expressions over indexed variables, e.g.
+//	state == 4 || (state == 2 && !desync)
+//Compiled once into bytecode for a small stack machine; evaluation works
+//on a fixed stack and never allocates.
+
+#define EXPR_MAX_CODE		256
+#define EXPR_MAX_CONST		32
+#define EXPR_MAX_STACK		32
+
+struct expr
+{
+	uint8_t code[EXPR_MAX_CODE];
+	int64_t consts[EXPR_MAX_CONST];
+	int len;
+	int nconst;
+	int depth;			//deepest stack the program reaches
+};
+
+/*	Compile src, resolving identifiers against names[0..nnames).
+	Returns 0, or -1 with a message in err	*/
+int expr_compile(struct expr *e, const char *src, const char *const *names, int nnames, char *err, size_t errlen);
+
+/*	Run a compiled program against vars	*/
+int64_t expr_eval(const struct expr *e, const int64_t *vars);
+
+#endif
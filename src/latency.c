@@ -0,0 +1,130 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include "latency.h"
+
+const char *const latency_names[LATENCY_PHASES] =
+{
+	"request_read",
+	"answer",
+	"response_write",
+	"probe_connect",
+	"probe_query",
+	"probe_result",
+	"probe_total",
+	"check_round"
+};
+
+struct latency_hist
+{
+	uint64_t bucket[LATENCY_BUCKETS];
+	uint64_t sum_ns;
+};
+
+static struct latency_hist hists[LATENCY_PHASES];
+static int enabled = 0;
+
+void latency_enable(int on)
+{
+	__atomic_store_n(&enabled, on != 0, __ATOMIC_RELAXED);
+}
+
+int latency_enabled(void)
+{
+	return __atomic_load_n(&enabled, __ATOMIC_RELAXED);
+}
+
+/*	Recording				*/
+void latency_record(enum latency_phase phase, long long ns)
+{
+	struct latency_hist *h = &hists[phase];
+	uint64_t us = 0;
+	int b = 0;
+
+	if (!__atomic_load_n(&enabled, __ATOMIC_RELAXED))
+	{
+		return;
+	}
+	if (ns < 0)
+	{
+		ns = 0;
+	}
+	//Bucket b holds samples up to 2^b us
+	us = (uint64_t)ns / 1000;
+	if (us > 1)
+	{
+		b = 64 - __builtin_clzll(us - 1);
+	}
+	if (b >= LATENCY_BUCKETS)
+	{
+		b = LATENCY_BUCKETS - 1;
+	}
+	__atomic_fetch_add(&h->bucket[b], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->sum_ns, (uint64_t)ns, __ATOMIC_RELAXED);
+}
+
+/*	Rendering				*/
+//Counters are read one at a time, so a scrape racing a sample can be
+//off by that sample; the cumulative buckets stay monotonic regardless
+size_t latency_render(char *out, size_t len)
+{
+	size_t used = 0;
+	uint64_t total = 0;
+	int n = 0;
+
+	if (len == 0)
+	{
+		return 0;
+	}
+	out[0] = '\0';
+	if (!latency_enabled())
+	{
+		return 0;
+	}
+	n = snprintf(out, len, "# TYPE hawk_phase_seconds histogram\n");
+	for (int p = 0; p < LATENCY_PHASES && n >= 0 && used + n < len; p++)
+	{
+		used += n;
+		total = 0;
+		for (int b = 0; b < LATENCY_BUCKETS - 1; b++)
+		{
+			total += __atomic_load_n(&hists[p].bucket[b], __ATOMIC_RELAXED);
+			n = snprintf(out + used, len - used, "hawk_phase_seconds_bucket{phase=\"%s\",le=\"%g\"} %llu\n",
+				latency_names[p], (double)(1ULL << b) / 1e6, (unsigned long long)total);
+			if (n < 0 || used + n >= len)
+			{
+				return used;
+			}
+			used += n;
+		}
+		total += __atomic_load_n(&hists[p].bucket[LATENCY_BUCKETS - 1], __ATOMIC_RELAXED);
+		n = snprintf(out + used, len - used, "hawk_phase_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %llu\n"
+			"hawk_phase_seconds_sum{phase=\"%s\"} %.9f\n"
+			"hawk_phase_seconds_count{phase=\"%s\"} %llu\n",
+			latency_names[p], (unsigned long long)total,
+			latency_names[p], (double)__atomic_load_n(&hists[p].sum_ns, __ATOMIC_RELAXED) / 1e9,
+			latency_names[p], (unsigned long long)total);
+	}
+	if (n >= 0 && used + n < len)
+	{
+		used += n;
+	}
+	return used;
+}
@@ -0,0 +1,57 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*	Phases					*/
+enum latency_phase
+{
+	LAT_REQUEST_READ,		//accept to complete request head
+	LAT_ANSWER,			//request head to answer written
+	LAT_RESPONSE_WRITE,		//the write itself
+	LAT_PROBE_CONNECT,		//MySQL connect and handshake
+	LAT_PROBE_QUERY,		//status query round trip
+	LAT_PROBE_RESULT,		//fetching and parsing the rows
+	LAT_PROBE_TOTAL,
+	LAT_CHECK_ROUND,		//wsrep probe and check stages together
+	LATENCY_PHASES
+};
+
+//Log2 buckets from 1 us; the last one catches everything above 2^22 us
+#define LATENCY_BUCKETS		24
+
+extern const char *const latency_names[LATENCY_PHASES];
+
+/*	Start or stop recording. Off by default, and recording is then a
+	single load and branch	*/
+void latency_enable(int on);
+int latency_enabled(void);
+
+/*	Add one sample of ns nanoseconds. Safe from any thread	*/
+void latency_record(enum latency_phase phase, long long ns);
+
+/*	Append the histograms in Prometheus text format. Returns the number
+	of bytes written, never more than len - 1	*/
+size_t latency_render(char *out, size_t len);
+
+#endif
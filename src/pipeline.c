@@ -0,0 +1,287 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/statvfs.h>
+#include <sys/sysinfo.h>
+#include "status.h"
+#include "pipeline.h"
+
+const char *const stage_names[PIPELINE_STAGES] =
+{
+	"read_only",
+	"disk",
+	"sql",
+	"load"
+};
+
+//Status variable each stage publishes, same order
+static const int stage_vars[PIPELINE_STAGES] =
+{
+	VAR_READ_ONLY,
+	VAR_DISK_FREE,
+	VAR_SQL,
+	VAR_LOAD
+};
+
+static long long pipeline_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*	Setup					*/
+void pipeline_init(struct pipeline *p, void (*enter)(void))
+{
+	pthread_condattr_t attr;
+
+	memset(p, 0, sizeof(*p));
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&p->wake, &attr);
+	pthread_cond_init(&p->done, &attr);
+	pthread_condattr_destroy(&attr);
+	p->enter = enter;
+	for (int i = 0; i < PIPELINE_STAGES; i++)
+	{
+		p->stage[i].owner = p;
+	}
+}
+
+void pipeline_configure(struct pipeline *p, enum stage_id id, const struct stage_conf *conf, stage_fn run, void *ctx)
+{
+	struct stage *s = &p->stage[id];
+
+	pthread_mutex_lock(&p->lock);
+	s->conf = *conf;
+	s->run = run;
+	s->ctx = ctx;
+	s->done_at = 0;
+	pthread_mutex_unlock(&p->lock);
+}
+
+/*	Stage Threads				*/
+//Only leaves with the process; a stage stuck in a system call holds
+//nothing but its own thread
+static void* stage_main(void *arg)
+{
+	struct stage *s = arg;
+	struct pipeline *p = s->owner;
+	struct stage_conf conf;
+	struct stage_result res;
+	stage_fn run = NULL;
+	void *ctx = NULL;
+
+	if (p->enter)
+	{
+		p->enter();
+	}
+	pthread_mutex_lock(&p->lock);
+	while (1)
+	{
+		while (!s->want)
+		{
+			pthread_cond_wait(&p->wake, &p->lock);
+		}
+		s->want = 0;
+		conf = s->conf;
+		run = s->run;
+		ctx = s->ctx;
+		pthread_mutex_unlock(&p->lock);
+
+		memset(&res, 0, sizeof(res));
+		res.value = -1;
+		res.verdict = run(ctx, &conf, &res);
+
+		pthread_mutex_lock(&p->lock);
+		s->result = res;
+		s->done_at = pipeline_now();
+		s->busy = 0;
+		pthread_cond_broadcast(&p->done);
+	}
+	return NULL;
+}
+
+/*	Rounds					*/
+int pipeline_begin(struct pipeline *p, int mysql_ok)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	long long now = pipeline_now();
+	int rc = 0;
+	int woke = 0;
+
+	pthread_mutex_lock(&p->lock);
+	for (int i = 0; i < PIPELINE_STAGES; i++)
+	{
+		struct stage *s = &p->stage[i];
+
+		s->skip = !s->conf.enabled || (s->conf.mysql && !mysql_ok);
+		if (s->skip || s->busy || (s->done_at && now - s->done_at < s->conf.ttl))
+		{
+			continue;
+		}
+		if (!s->started)
+		{
+			pthread_attr_init(&attr);
+			pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+			if (pthread_create(&thread, &attr, stage_main, s) != 0)
+			{
+				pthread_attr_destroy(&attr);
+				s->skip = 1;
+				rc = -1;
+				continue;
+			}
+			pthread_attr_destroy(&attr);
+			s->started = 1;
+		}
+		//The timeout runs from here, not from when the thread gets going
+		s->want = 1;
+		s->busy = 1;
+		s->began = now;
+		woke = 1;
+	}
+	if (woke)
+	{
+		pthread_cond_broadcast(&p->wake);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return rc;
+}
+
+int pipeline_end(struct pipeline *p, struct stage_result *out, int64_t *vars)
+{
+	struct timespec until;
+	long long next = 0;
+	int weight = 100;
+
+	pthread_mutex_lock(&p->lock);
+	while (1)
+	{
+		next = 0;
+		for (int i = 0; i < PIPELINE_STAGES; i++)
+		{
+			struct stage *s = &p->stage[i];
+
+			if (!s->skip && s->busy && (!next || s->began + s->conf.timeout < next))
+			{
+				next = s->began + s->conf.timeout;
+			}
+		}
+		if (!next || pipeline_now() >= next)
+		{
+			break;
+		}
+		until.tv_sec = next / 1000;
+		until.tv_nsec = (next % 1000) * 1000000;
+		pthread_cond_timedwait(&p->done, &p->lock, &until);
+	}
+
+	for (int i = 0; i < PIPELINE_STAGES; i++)
+	{
+		struct stage *s = &p->stage[i];
+
+		memset(&out[i], 0, sizeof(out[i]));
+		out[i].value = -1;
+		if (!s->conf.enabled)
+		{
+			out[i].verdict = STAGE_OFF;
+		}
+		else if (!s->skip && s->busy && pipeline_now() >= s->began + s->conf.timeout)
+		{
+			out[i].verdict = STAGE_TIMEOUT;
+			snprintf(out[i].detail, sizeof(out[i].detail), "no result within %d ms", s->conf.timeout);
+		}
+		else if (s->done_at)
+		{
+			//Skipped stages keep reporting what they last found
+			out[i] = s->result;
+		}
+		else
+		{
+			out[i].verdict = STAGE_OFF;
+		}
+		vars[stage_vars[i]] = out[i].value;
+		if (out[i].verdict == STAGE_FAIL || out[i].verdict == STAGE_TIMEOUT)
+		{
+			if (s->conf.on_fail == STAGE_DOWN)
+			{
+				weight = 0;
+			}
+			else if (s->conf.on_fail < weight)
+			{
+				weight = s->conf.on_fail;
+			}
+		}
+	}
+	pthread_mutex_unlock(&p->lock);
+	return weight;
+}
+
+/*	Local Stages				*/
+int stage_disk(void *ctx, const struct stage_conf *conf, struct stage_result *res)
+{
+	struct statvfs vfs;
+
+	(void)ctx;
+	if (statvfs(conf->arg, &vfs) != 0 || vfs.f_blocks == 0)
+	{
+		snprintf(res->detail, sizeof(res->detail), "could not stat %.100s: %m", conf->arg);
+		return STAGE_FAIL;
+	}
+	//Space the server can use; the root reserve is not its to take
+	res->value = (int64_t)(vfs.f_bavail * 100 / vfs.f_blocks);
+	if (res->value < conf->limit)
+	{
+		snprintf(res->detail, sizeof(res->detail), "%lld%% free on %.100s, below %lld%%", (long long)res->value, conf->arg, conf->limit);
+		return STAGE_FAIL;
+	}
+	return STAGE_PASS;
+}
+
+int stage_load(void *ctx, const struct stage_conf *conf, struct stage_result *res)
+{
+	FILE *f = fopen("/proc/loadavg", "r");
+	double load = 0;
+	int cpus = get_nprocs();
+
+	(void)ctx;
+	if (!f || fscanf(f, "%lf", &load) != 1)
+	{
+		snprintf(res->detail, sizeof(res->detail), "could not read /proc/loadavg");
+		if (f)
+		{
+			fclose(f);
+		}
+		return STAGE_FAIL;
+	}
+	fclose(f);
+	res->value = (int64_t)(load * 100 / (cpus > 0 ? cpus : 1));
+	if (res->value > conf->limit)
+	{
+		snprintf(res->detail, sizeof(res->detail), "load %.2f per CPU, above %.2f", res->value / 100.0, conf->limit / 100.0);
+		return STAGE_FAIL;
+	}
+	return STAGE_PASS;
+}
@@ -0,0 +1,117 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+/*	Check Stages				*/
+//Checks run next to the wsrep probe. Each has a thread of its own, so a
+//round takes as long as its slowest stage rather than all of them
+enum stage_id
+{
+	STAGE_READ_ONLY,		//read_only or super_read_only set
+	STAGE_DISK,			//free space on the datadir
+	STAGE_SQL,			//custom query with an expected value
+	STAGE_LOAD,			//1 minute load average per CPU
+	PIPELINE_STAGES
+};
+
+extern const char *const stage_names[PIPELINE_STAGES];
+
+/*	Verdicts				*/
+#define STAGE_OFF		0
+#define STAGE_PASS		1
+#define STAGE_FAIL		2	//found a problem, or could not look
+#define STAGE_TIMEOUT		3	//no result within its timeout
+
+//on_fail value that takes the node down instead of capping its weight
+#define STAGE_DOWN		-1
+
+struct stage_conf
+{
+	int enabled;
+	int mysql;			//talks to MySQL; skipped while the circuit is open
+	int timeout;			//ms a round waits for it
+	int ttl;			//ms a result is reused for, 0 for every round
+	int on_fail;			//weight percent to cap at, or STAGE_DOWN
+	long long limit;		//disk: min free percent, load: max per CPU x 100
+	char arg[512];			//disk: path, sql: query
+	char expect[128];		//sql: first column of the first row
+};
+
+struct stage_result
+{
+	int verdict;
+	int64_t value;			//published as a status variable, -1 if unknown
+	char detail[160];		//why it failed, for the log
+};
+
+//Runs one stage. Fills res and returns its verdict
+typedef int (*stage_fn)(void *ctx, const struct stage_conf *conf, struct stage_result *res);
+
+struct stage
+{
+	struct pipeline *owner;
+	struct stage_conf conf;
+	stage_fn run;
+	void *ctx;
+	int started;			//thread created
+	int want;			//thread should run the stage
+	int busy;			//asked for and not finished
+	int skip;			//not asked for this round
+	long long began;		//monotonic ms the current run was asked for
+	long long done_at;		//monotonic ms the last result came in, 0 for none
+	struct stage_result result;
+};
+
+struct pipeline
+{
+	pthread_mutex_t lock;
+	pthread_cond_t wake;		//stage threads wait for work
+	pthread_cond_t done;		//a round waits for its stages
+	void (*enter)(void);		//run by each stage thread on start
+	struct stage stage[PIPELINE_STAGES];
+};
+
+/*	Set up with every stage off. enter may be NULL	*/
+void pipeline_init(struct pipeline *p, void (*enter)(void));
+
+/*	Set what runs a stage and how. Cached results are dropped, so the
+	next round runs it afresh. Safe while a round is in progress	*/
+void pipeline_configure(struct pipeline *p, enum stage_id id, const struct stage_conf *conf, stage_fn run, void *ctx);
+
+/*	Start a round: every enabled stage without a cached result younger
+	than its ttl is set running. Stages that talk to MySQL are left out
+	unless mysql_ok. Returns -1 if a stage thread could not be created */
+int pipeline_begin(struct pipeline *p, int mysql_ok);
+
+/*	Wait for the stages of the round, each until its own timeout, and
+	copy every result into out and its value into vars (indexed by
+	status_var). Returns the weight cap set by failing stages: 100 when
+	all pass, 0 when one that takes the node down failed	*/
+int pipeline_end(struct pipeline *p, struct stage_result *out, int64_t *vars);
+
+/*	Stages run by the module itself	*/
+int stage_disk(void *ctx, const struct stage_conf *conf, struct stage_result *res);
+int stage_load(void *ctx, const struct stage_conf *conf, struct stage_result *res);
+
+#endif
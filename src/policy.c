@@ -0,0 +1,165 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+#include "policy.h"
+#include "status.h"
+
+/*	Setup					*/
+//With suppress set and reuse left at 0 the penalty, which only decays
+//towards 0, would never fall below reuse and the node would be held
+//down for good. Release it at a quarter of suppress instead
+static void policy_set(struct policy *p, const struct policy_conf *conf)
+{
+	p->conf = *conf;
+	if (p->conf.suppress > 0 && p->conf.reuse <= 0)
+	{
+		p->conf.reuse = p->conf.suppress / 4 > 0 ? p->conf.suppress / 4 : 1;
+	}
+}
+
+void policy_init(struct policy *p, const struct policy_conf *conf, int known, int up)
+{
+	memset(p, 0, sizeof(*p));
+	policy_set(p, conf);
+	p->known = known;
+	p->up = up;
+	p->raw = -1;
+}
+
+void policy_configure(struct policy *p, const struct policy_conf *conf)
+{
+	policy_set(p, conf);
+}
+
+/*	Exponential Decay			*/
+double policy_penalty(struct policy *p, long long now)
+{
+	if (p->conf.half_life <= 0)
+	{
+		p->penalty = 0;
+	}
+	else if (now > p->decayed_at && p->penalty > 0)
+	{
+		p->penalty *= exp2(-(double)(now - p->decayed_at) / p->conf.half_life);
+	}
+	p->decayed_at = now;
+	return p->penalty;
+}
+
+/*	Probe Result -> Output			*/
+int policy_step(struct policy *p, int healthy, int raw, long long now)
+{
+	int events = 0;
+
+	if (raw < 0 || raw >= POLICY_STATES)
+	{
+		raw = 0;
+	}
+
+	//Flap damping: every change of the raw state costs that state's penalty
+	policy_penalty(p, now);
+	if (p->conf.half_life > 0 && p->raw != -1 && raw != p->raw)
+	{
+		p->penalty += p->conf.penalty[raw];
+		if (p->penalty > p->conf.max_penalty && p->conf.max_penalty > 0)
+		{
+			p->penalty = p->conf.max_penalty;
+		}
+	}
+	p->raw = raw;
+
+	if (!p->suppressed && p->conf.suppress > 0 && p->penalty >= p->conf.suppress)
+	{
+		p->suppressed = 1;
+		events |= POLICY_EV_SUPPRESS;
+	}
+	else if (p->suppressed && p->penalty < p->conf.reuse)
+	{
+		p->suppressed = 0;
+		events |= POLICY_EV_REUSE;
+	}
+
+	//Hysteresis
+	if (healthy == p->healthy && p->streak > 0)
+	{
+		p->streak++;
+	}
+	else
+	{
+		p->healthy = healthy;
+		p->streak = 1;
+	}
+
+	if (!p->known)
+	{
+		p->known = 1;
+		p->up = healthy && !p->suppressed;
+		events |= p->up ? POLICY_EV_UP : POLICY_EV_DOWN;
+	}
+	else if (p->up && (p->suppressed || (!healthy && p->streak >= p->conf.fall)))
+	{
+		p->up = 0;
+		events |= POLICY_EV_DOWN;
+	}
+	else if (!p->up && !p->suppressed && healthy && p->streak >= p->conf.rise)
+	{
+		p->up = 1;
+		events |= POLICY_EV_UP;
+	}
+	return events;
+}
+
+/*	Donor Handling				*/
+int donor_weight(const struct donor_conf *c, const int64_t *var, const char **why)
+{
+	int64_t state = var[VAR_STATE];
+
+	*why = NULL;
+	if (!c->enabled || !var[VAR_PRIMARY] || (state != 2 && state != 4))
+	{
+		return -1;
+	}
+
+	//Nobody could take over: a cluster of one, or a donor whose only
+	//peer is the joiner it serves an SST to
+	if (c->last_node && (var[VAR_CLUSTER_SIZE] == 1 || (state == 2 && var[VAR_CLUSTER_SIZE] == 2 && var[VAR_DESYNCED] != 1)))
+	{
+		*why = "last synced node";
+		return 100;
+	}
+	if (state != 2)
+	{
+		return -1;
+	}
+	if (var[VAR_DESYNCED] == 1)
+	{
+		*why = "desynced by hand";
+		return c->desynced;
+	}
+	//Unknown counts as blocking
+	if (var[VAR_ONLINE_SST] == 1)
+	{
+		*why = "non-blocking SST";
+		return c->weight;
+	}
+	*why = "blocking SST";
+	return 0;
+}
@@ -0,0 +1,86 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _POLICY_H_
+#define _POLICY_H_
+
+#include <stdint.h>
+
+/*	Raw States				*/
+//wsrep_local_state values; anything else, including a failed probe, is 0
+#define POLICY_STATES		5
+
+/*	Events Returned By policy_step		*/
+#define POLICY_EV_UP		0x01
+#define POLICY_EV_DOWN		0x02
+#define POLICY_EV_SUPPRESS	0x04
+#define POLICY_EV_REUSE		0x08
+
+struct policy_conf
+{
+	int rise;			//consecutive healthy probes to come up
+	int fall;			//consecutive unhealthy probes to go down
+	long long half_life;		//ms, 0 disables flap damping
+	int suppress;			//penalty at which the node is held down
+	int reuse;			//penalty below which it is released, suppress / 4 if 0
+	int max_penalty;
+	int penalty[POLICY_STATES];	//added when the raw state changes to it
+};
+
+struct policy
+{
+	struct policy_conf conf;
+	int known;			//an output has been decided
+	int up;
+	int suppressed;
+	int healthy;			//last input
+	int streak;			//consecutive probes with that input
+	int raw;			//last raw state, -1 before the first probe
+	double penalty;
+	long long decayed_at;
+};
+
+/*	Start from an unknown output, or from a restored one when known is set */
+void policy_init(struct policy *p, const struct policy_conf *conf, int known, int up);
+
+/*	Swap thresholds on reload without losing streaks or penalty */
+void policy_configure(struct policy *p, const struct policy_conf *conf);
+
+/*	Feed one probe result observed at now (ms on any monotonic clock).
+	Returns a mask of POLICY_EV_* and leaves the output in p->up	*/
+int policy_step(struct policy *p, int healthy, int raw, long long now);
+
+/*	Penalty decayed to now			*/
+double policy_penalty(struct policy *p, long long now);
+
+/*	Donor Handling				*/
+//Which Donor/Desynced (state 2) nodes keep serving, and at what weight
+struct donor_conf
+{
+	int enabled;
+	int weight;			//percent while a non-blocking SST runs, 0 for down
+	int desynced;			//percent while desynced by hand, 0 for down
+	int last_node;			//never take out the last synced node
+};
+
+/*	Weight for a node the donor settings decide on, from status
+	variables; -1 leaves it to the health rule. why names the case	*/
+int donor_weight(const struct donor_conf *c, const int64_t *var, const char **why);
+
+#endif
@@ -0,0 +1,245 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "runtime.h"
+
+/*	Setup					*/
+int runtime_parse(struct runtime_sock *rs, const char *spec)
+{
+	const char *colon = NULL;
+
+	memset(rs, 0, sizeof(*rs));
+	rs->fd = -1;
+	while (*spec == ' ' || *spec == '\t')
+	{
+		spec++;
+	}
+	snprintf(rs->spec, sizeof(rs->spec), "%s", spec);
+	if (strncmp(spec, "unix:", 5) == 0 || spec[0] == '/')
+	{
+		spec += (spec[0] == '/') ? 0 : 5;
+		rs->is_unix = 1;
+		if (strlen(spec) == 0 || strlen(spec) >= sizeof(rs->path))
+		{
+			return -1;
+		}
+		snprintf(rs->path, sizeof(rs->path), "%s", spec);
+		return 0;
+	}
+
+	spec += (strncmp(spec, "tcp:", 4) == 0) ? 4 : 0;
+	colon = strrchr(spec, ':');
+	if (colon == NULL || colon == spec || (size_t)(colon - spec) >= sizeof(rs->host) || atoi(colon + 1) <= 0)
+	{
+		return -1;
+	}
+	memcpy(rs->host, spec, colon - spec);
+	rs->port = atoi(colon + 1);
+	return 0;
+}
+
+static long long runtime_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*	I/O With A Deadline			*/
+static int runtime_wait(int fd, short events, long long deadline)
+{
+	struct pollfd pfd = {fd, events, 0};
+	long long left = deadline - runtime_ms();
+
+	if (left <= 0 || poll(&pfd, 1, (int)left) != 1)
+	{
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	return 0;
+}
+
+static int runtime_write(int fd, const char *data, size_t len, long long deadline)
+{
+	ssize_t sent = 0;
+
+	while (len > 0)
+	{
+		if (runtime_wait(fd, POLLOUT, deadline) != 0)
+		{
+			return -1;
+		}
+		sent = send(fd, data, len, MSG_NOSIGNAL);
+		if (sent < 0 && errno != EAGAIN && errno != EINTR)
+		{
+			return -1;
+		}
+		if (sent > 0)
+		{
+			data += sent;
+			len -= sent;
+		}
+	}
+	return 0;
+}
+
+//Reads until the "> " prompt; whatever came before it is the answer
+static int runtime_prompt(int fd, char *out, size_t outlen, long long deadline)
+{
+	char buf[1024];
+	size_t len = 0;
+	ssize_t got = 0;
+
+	while (len < 2 || buf[len - 2] != '>' || buf[len - 1] != ' ')
+	{
+		if (len == sizeof(buf))
+		{
+			//Long answers only matter for the error text; keep the tail
+			memmove(buf, buf + sizeof(buf) / 2, sizeof(buf) / 2);
+			len = sizeof(buf) / 2;
+		}
+		if (runtime_wait(fd, POLLIN, deadline) != 0)
+		{
+			return -1;
+		}
+		got = recv(fd, buf + len, sizeof(buf) - len, 0);
+		if (got == 0)
+		{
+			errno = ECONNRESET;
+			return -1;
+		}
+		if (got < 0 && errno != EAGAIN && errno != EINTR)
+		{
+			return -1;
+		}
+		len += (got > 0) ? got : 0;
+	}
+
+	//Trim the prompt and surrounding blank lines
+	len -= 2;
+	while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == ' '))
+	{
+		len--;
+	}
+	if (out && outlen > 0)
+	{
+		snprintf(out, outlen, "%.*s", (int)len, buf);
+	}
+	return (int)len;
+}
+
+static int runtime_connect(struct runtime_sock *rs, long long deadline)
+{
+	struct sockaddr_un sun;
+	struct addrinfo hints;
+	struct addrinfo *res = NULL;
+	char port[16];
+	int err = 0;
+	socklen_t errlen = sizeof(err);
+
+	if (rs->is_unix)
+	{
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		memcpy(sun.sun_path, rs->path, strlen(rs->path));
+		rs->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (rs->fd < 0 || connect(rs->fd, (struct sockaddr *)&sun, sizeof(sun)) != 0)
+		{
+			runtime_close(rs);
+			return -1;
+		}
+	}
+	else
+	{
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_socktype = SOCK_STREAM;
+		snprintf(port, sizeof(port), "%d", rs->port);
+		if (getaddrinfo(rs->host, port, &hints, &res) != 0)
+		{
+			errno = EHOSTUNREACH;
+			return -1;
+		}
+		rs->fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (rs->fd < 0 || (connect(rs->fd, res->ai_addr, res->ai_addrlen) != 0 && errno != EINPROGRESS))
+		{
+			freeaddrinfo(res);
+			runtime_close(rs);
+			return -1;
+		}
+		freeaddrinfo(res);
+		setsockopt(rs->fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+		if (runtime_wait(rs->fd, POLLOUT, deadline) != 0 ||
+			getsockopt(rs->fd, SOL_SOCKET, SO_ERROR, &err, &errlen) != 0 || err != 0)
+		{
+			errno = err ? err : errno;
+			runtime_close(rs);
+			return -1;
+		}
+	}
+
+	//Prompt mode keeps the session open across commands
+	if (runtime_write(rs->fd, "prompt\n", 7, deadline) != 0 || runtime_prompt(rs->fd, NULL, 0, deadline) < 0)
+	{
+		runtime_close(rs);
+		return -1;
+	}
+	return 0;
+}
+
+/*	Push					*/
+int runtime_send(struct runtime_sock *rs, const char *cmds, int timeout_ms, char *err, size_t errlen)
+{
+	long long deadline = runtime_ms() + timeout_ms;
+	int answered = 0;
+
+	if (rs->fd < 0 && runtime_connect(rs, deadline) != 0)
+	{
+		snprintf(err, errlen, "%s", strerror(errno));
+		return -1;
+	}
+	if (runtime_write(rs->fd, cmds, strlen(cmds), deadline) != 0 || runtime_write(rs->fd, "\n", 1, deadline) != 0 ||
+		(answered = runtime_prompt(rs->fd, err, errlen, deadline)) < 0)
+	{
+		snprintf(err, errlen, "%s", strerror(errno));
+		runtime_close(rs);
+		return -1;
+	}
+	return answered > 0 ? 1 : 0;
+}
+
+void runtime_close(struct runtime_sock *rs)
+{
+	if (rs->fd >= 0)
+	{
+		close(rs->fd);
+	}
+	rs->fd = -1;
+}
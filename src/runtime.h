@@ -0,0 +1,51 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RUNTIME_H_
+#define _RUNTIME_H_
+
+#include <stddef.h>
+
+/*	HAProxy Runtime API Client		*/
+//One stats socket, kept open in prompt mode between pushes
+struct runtime_sock
+{
+	char spec[128];			//as configured, for logging
+	int is_unix;
+	char path[108];			//unix socket path
+	char host[64];			//or TCP host and port
+	int port;
+	int fd;				//-1 while disconnected
+	unsigned long long pushed;	//generation last pushed successfully
+	int failures;			//consecutive failed pushes
+};
+
+/*	Parse "unix:/path", "/path", "tcp:host:port" or "host:port".
+	Returns -1 when spec is none of those	*/
+int runtime_parse(struct runtime_sock *rs, const char *spec);
+
+/*	Send a batch of ';'-separated commands and wait for the prompt,
+	connecting first when needed. Returns 0 when HAProxy took them
+	silently, 1 when it answered with an error (copied to err) and -1
+	on a connection problem, in which case the socket is closed	*/
+int runtime_send(struct runtime_sock *rs, const char *cmds, int timeout_ms, char *err, size_t errlen);
+
+void runtime_close(struct runtime_sock *rs);
+
+#endif
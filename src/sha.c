@@ -0,0 +1,235 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "sha.h"
+
+#define ROL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+#define ROR(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+static uint32_t load_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void store_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+//Both hashes pad the same way: 0x80, zeros, then the bit length
+static void pad(uint8_t *block, size_t *fill, uint64_t total, void (*compress)(void *, const uint8_t *), void *ctx)
+{
+	uint64_t bits = total * 8;
+
+	block[(*fill)++] = 0x80;
+	if (*fill > 56)
+	{
+		memset(block + *fill, 0, 64 - *fill);
+		compress(ctx, block);
+		*fill = 0;
+	}
+	memset(block + *fill, 0, 56 - *fill);
+	for (int i = 0; i < 8; i++)
+	{
+		block[56 + i] = bits >> (56 - 8 * i);
+	}
+	compress(ctx, block);
+	*fill = 0;
+}
+
+/*	SHA-1					*/
+static void sha1_compress(void *ctx, const uint8_t *block)
+{
+	struct sha1 *c = ctx;
+	uint32_t w[80];
+	uint32_t a = c->h[0], b = c->h[1], d = c->h[3], e = c->h[4], cc = c->h[2];
+	uint32_t f = 0;
+	uint32_t k = 0;
+	uint32_t t = 0;
+
+	for (int i = 0; i < 16; i++)
+	{
+		w[i] = load_be32(block + 4 * i);
+	}
+	for (int i = 16; i < 80; i++)
+	{
+		w[i] = ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+	}
+	for (int i = 0; i < 80; i++)
+	{
+		if (i < 20)
+		{
+			f = (b & cc) | (~b & d);
+			k = 0x5a827999;
+		}
+		else if (i < 40)
+		{
+			f = b ^ cc ^ d;
+			k = 0x6ed9eba1;
+		}
+		else if (i < 60)
+		{
+			f = (b & cc) | (b & d) | (cc & d);
+			k = 0x8f1bbcdc;
+		}
+		else
+		{
+			f = b ^ cc ^ d;
+			k = 0xca62c1d6;
+		}
+		t = ROL(a, 5) + f + e + k + w[i];
+		e = d;
+		d = cc;
+		cc = ROL(b, 30);
+		b = a;
+		a = t;
+	}
+	c->h[0] += a;
+	c->h[1] += b;
+	c->h[2] += cc;
+	c->h[3] += d;
+	c->h[4] += e;
+}
+
+void sha1_init(struct sha1 *c)
+{
+	static const uint32_t iv[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+
+	memcpy(c->h, iv, sizeof(iv));
+	c->total = 0;
+	c->fill = 0;
+}
+
+void sha1_update(struct sha1 *c, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t take = 0;
+
+	c->total += len;
+	while (len > 0)
+	{
+		take = 64 - c->fill < len ? 64 - c->fill : len;
+		memcpy(c->block + c->fill, p, take);
+		c->fill += take;
+		p += take;
+		len -= take;
+		if (c->fill == 64)
+		{
+			sha1_compress(c, c->block);
+			c->fill = 0;
+		}
+	}
+}
+
+void sha1_final(struct sha1 *c, uint8_t out[SHA1_LEN])
+{
+	pad(c->block, &c->fill, c->total, sha1_compress, c);
+	for (int i = 0; i < 5; i++)
+	{
+		store_be32(out + 4 * i, c->h[i]);
+	}
+}
+
+/*	SHA-256					*/
+static const uint32_t k256[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void sha256_compress(void *ctx, const uint8_t *block)
+{
+	struct sha256 *c = ctx;
+	uint32_t w[64];
+	uint32_t v[8];
+	uint32_t t1 = 0;
+	uint32_t t2 = 0;
+
+	for (int i = 0; i < 16; i++)
+	{
+		w[i] = load_be32(block + 4 * i);
+	}
+	for (int i = 16; i < 64; i++)
+	{
+		w[i] = w[i - 16] + (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3))
+			+ w[i - 7] + (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+	}
+	memcpy(v, c->h, sizeof(v));
+	for (int i = 0; i < 64; i++)
+	{
+		t1 = v[7] + (ROR(v[4], 6) ^ ROR(v[4], 11) ^ ROR(v[4], 25)) + ((v[4] & v[5]) ^ (~v[4] & v[6])) + k256[i] + w[i];
+		t2 = (ROR(v[0], 2) ^ ROR(v[0], 13) ^ ROR(v[0], 22)) + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+		memmove(v + 1, v, 7 * sizeof(v[0]));
+		v[4] += t1;
+		v[0] = t1 + t2;
+	}
+	for (int i = 0; i < 8; i++)
+	{
+		c->h[i] += v[i];
+	}
+}
+
+void sha256_init(struct sha256 *c)
+{
+	static const uint32_t iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+	memcpy(c->h, iv, sizeof(iv));
+	c->total = 0;
+	c->fill = 0;
+}
+
+void sha256_update(struct sha256 *c, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t take = 0;
+
+	c->total += len;
+	while (len > 0)
+	{
+		take = 64 - c->fill < len ? 64 - c->fill : len;
+		memcpy(c->block + c->fill, p, take);
+		c->fill += take;
+		p += take;
+		len -= take;
+		if (c->fill == 64)
+		{
+			sha256_compress(c, c->block);
+			c->fill = 0;
+		}
+	}
+}
+
+void sha256_final(struct sha256 *c, uint8_t out[SHA256_LEN])
+{
+	pad(c->block, &c->fill, c->total, sha256_compress, c);
+	for (int i = 0; i < 8; i++)
+	{
+		store_be32(out + 4 * i, c->h[i]);
+	}
+}
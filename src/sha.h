@@ -0,0 +1,56 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SHA_H_
+#define _SHA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*	SHA-1 and SHA-256			*/
+//Just enough hashing for MySQL's password scrambles, so the built-in
+//client needs no crypto library. Contexts live on the caller's stack.
+#define SHA1_LEN	20
+#define SHA256_LEN	32
+
+struct sha1
+{
+	uint32_t h[5];
+	uint64_t total;
+	uint8_t block[64];
+	size_t fill;
+};
+
+struct sha256
+{
+	uint32_t h[8];
+	uint64_t total;
+	uint8_t block[64];
+	size_t fill;
+};
+
+void sha1_init(struct sha1 *c);
+void sha1_update(struct sha1 *c, const void *data, size_t len);
+void sha1_final(struct sha1 *c, uint8_t out[SHA1_LEN]);
+
+void sha256_init(struct sha256 *c);
+void sha256_update(struct sha256 *c, const void *data, size_t len);
+void sha256_final(struct sha256 *c, uint8_t out[SHA256_LEN]);
+
+#endif
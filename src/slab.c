@@ -0,0 +1,93 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "slab.h"
+
+#define GEN_MASK	((1u << (SLAB_HANDLE_BITS - 32)) - 1)
+
+int slab_init(struct slab *s, size_t size, int capacity)
+{
+	memset(s, 0, sizeof(*s));
+	if (capacity <= 0)
+	{
+		return -1;
+	}
+	s->size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	//calloc memory can be untouched zero pages; write every byte
+	s->mem = malloc(s->size * capacity);
+	s->gen = malloc(sizeof(*s->gen) * capacity);
+	if (s->mem == NULL || s->gen == NULL)
+	{
+		free(s->mem);
+		free(s->gen);
+		return -1;
+	}
+	memset(s->mem, 0, s->size * capacity);
+	memset(s->gen, 0, sizeof(*s->gen) * capacity);
+	s->capacity = capacity;
+	for (int i = capacity - 1; i >= 0; i--)
+	{
+		*(void **)(s->mem + s->size * i) = s->free;
+		s->free = s->mem + s->size * i;
+	}
+	return 0;
+}
+
+void* slab_get(struct slab *s, uint64_t *handle)
+{
+	char *obj = s->free;
+	uint32_t index = 0;
+
+	if (obj == NULL)
+	{
+		return NULL;
+	}
+	s->free = *(void **)obj;
+	memset(obj, 0, s->size);
+	index = (obj - s->mem) / s->size;
+	*handle = ((uint64_t)s->gen[index] << 32) | index;
+	if (++s->used > s->peak)
+	{
+		s->peak = s->used;
+	}
+	return obj;
+}
+
+void slab_put(struct slab *s, void *obj)
+{
+	uint32_t index = ((char *)obj - s->mem) / s->size;
+
+	s->gen[index] = (s->gen[index] + 1) & GEN_MASK;
+	*(void **)obj = s->free;
+	s->free = obj;
+	s->used--;
+}
+
+void* slab_lookup(struct slab *s, uint64_t handle)
+{
+	uint32_t index = handle & 0xffffffff;
+
+	if (index >= (uint32_t)s->capacity || s->gen[index] != ((handle >> 32) & GEN_MASK))
+	{
+		return NULL;
+	}
+	return s->mem + s->size * index;
+}
@@ -0,0 +1,62 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*	Object Slab				*/
+//A fixed number of same-sized objects carved out of one block at
+//startup. Free objects are chained through their first word, so taking
+//and returning one is O(1) and never touches the heap.
+//
+//Every slot has a generation that moves on each time its object is
+//returned. A handle is the slot index plus that generation, so a handle
+//kept past the object's release (an epoll event still queued for a
+//closed connection) no longer resolves instead of reaching whatever
+//took the slot next.
+#define SLAB_HANDLE_BITS	56	//callers may use the bits above
+
+struct slab
+{
+	char *mem;
+	uint32_t *gen;			//per slot, 24 bits used
+	size_t size;			//object size, rounded up to a pointer
+	int capacity;
+	int used;
+	int peak;
+	void *free;			//first free object
+};
+
+/*	Allocate and touch capacity objects of size bytes, so they are
+	resident from the start. Returns -1 on failure	*/
+int slab_init(struct slab *s, size_t size, int capacity);
+
+/*	A zeroed object and its handle, or NULL when all are in use */
+void* slab_get(struct slab *s, uint64_t *handle);
+
+void slab_put(struct slab *s, void *obj);
+
+/*	The object a handle was issued for, or NULL if it has been
+	returned since	*/
+void* slab_lookup(struct slab *s, uint64_t handle);
+
+#endif
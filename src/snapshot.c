@@ -0,0 +1,79 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stddef.h>
+#include "snapshot.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()	__builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpu_relax()	__asm__ __volatile__("yield")
+#else
+#define cpu_relax()	do { } while (0)
+#endif
+
+#define SNAPSHOT_WORDS	(sizeof(struct hawk_snapshot) / sizeof(uint64_t))
+
+_Static_assert(sizeof(struct hawk_snapshot) % sizeof(uint64_t) == 0, "snapshot must be whole words");
+_Static_assert(sizeof(struct hawk_snapshot_cell) % HAWK_CACHELINE == 0, "snapshot cell must fill whole lines");
+
+/*	Seqlock Writer				*/
+//seq is odd while the payload is being rewritten. Payload words are
+//copied with relaxed atomics so readers racing the writer are well defined.
+void snapshot_publish(struct hawk_snapshot_cell *cell, const struct hawk_snapshot *snap)
+{
+	uint64_t *dst = (uint64_t *)&cell->data;
+	const uint64_t *src = (const uint64_t *)snap;
+	uint64_t seq = __atomic_load_n(&cell->seq, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&cell->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	for (size_t i = 0; i < SNAPSHOT_WORDS; i++)
+	{
+		__atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&cell->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*	Seqlock Reader				*/
+void snapshot_read(const struct hawk_snapshot_cell *cell, struct hawk_snapshot *out)
+{
+	const uint64_t *src = (const uint64_t *)&cell->data;
+	uint64_t *dst = (uint64_t *)out;
+	uint64_t before = 0;
+	uint64_t after = 0;
+
+	do
+	{
+		before = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		if (before & 1)
+		{
+			cpu_relax();
+			after = before + 1;
+			continue;
+		}
+		for (size_t i = 0; i < SNAPSHOT_WORDS; i++)
+		{
+			dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&cell->seq, __ATOMIC_RELAXED);
+	}
+	while (before != after);
+}
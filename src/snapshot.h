@@ -0,0 +1,61 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stdint.h>
+#include "status.h"
+
+#define HAWK_CACHELINE		64
+
+/*	Published Status			*/
+//Everything a request handler needs to answer a check. Fixed size and
+//made of 8 byte words so it can be copied word by word under the seqlock.
+struct hawk_snapshot
+{
+	int32_t node;
+	int32_t weight;
+	int32_t fresh;			//set by a probe of this process
+	int32_t ok;			//last probe completed
+	int32_t breaker;		//BREAKER_* circuit state
+	int32_t reserved;
+	int64_t probed_at;		//monotonic ms
+	int64_t grace_until;		//restored state is valid until then
+	uint64_t generation;		//number of publishes
+	int64_t var[STATUS_VARS];
+	char state[16];			//raw wsrep_local_state
+};
+
+//Sequence and payload share the first cache line; the cell never shares
+//a line with anything else
+struct hawk_snapshot_cell
+{
+	uint64_t seq;
+	struct hawk_snapshot data;
+} __attribute__((aligned(HAWK_CACHELINE)));
+
+/*	Single writer. Concurrent writers must be serialized by the caller */
+void snapshot_publish(struct hawk_snapshot_cell *cell, const struct hawk_snapshot *snap);
+
+/*	Lock-free, allocation-free read of a consistent copy. Retries while
+	a publish is in progress	*/
+void snapshot_read(const struct hawk_snapshot_cell *cell, struct hawk_snapshot *out);
+
+#endif
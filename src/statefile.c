@@ -0,0 +1,104 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "statefile.h"
+
+/*	Open State File				*/
+struct hawk_statefile* statefile_open(const char *path)
+{
+	struct hawk_statefile *sf = NULL;
+	struct stat st;
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	//A short or foreign file is reset to an empty record
+	if (fstat(fd, &st) != 0 || (st.st_size != sizeof(*sf) && ftruncate(fd, sizeof(*sf)) != 0))
+	{
+		close(fd);
+		return NULL;
+	}
+
+	sf = mmap(NULL, sizeof(*sf), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (sf == MAP_FAILED)
+	{
+		return NULL;
+	}
+
+	if (sf->magic != STATEFILE_MAGIC || sf->version != STATEFILE_VERSION)
+	{
+		memset(sf, 0, sizeof(*sf));
+		sf->version = STATEFILE_VERSION;
+		sf->magic = STATEFILE_MAGIC;
+	}
+	return sf;
+}
+
+/*	Validate Loaded Record			*/
+int statefile_valid(const struct hawk_statefile *sf, time_t now, int max_age)
+{
+	if (sf->seq == 0 || (sf->seq & 1))
+	{
+		return 0;
+	}
+	return sf->confirmed_at <= now && now - sf->confirmed_at <= max_age;
+}
+
+/*	Update In Place				*/
+void statefile_update(struct hawk_statefile *sf, int node, int weight, const char *status, time_t now)
+{
+	int changed = sf->node != node || sf->weight != weight || sf->seq == 0;
+
+	sf->seq++;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	if (changed)
+	{
+		sf->node = node;
+		sf->weight = weight;
+		sf->changed_at = now;
+		snprintf(sf->status, sizeof(sf->status), "%s", status);
+	}
+	sf->confirmed_at = now;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	sf->seq++;
+
+	//Only transitions are worth forcing out; the page cache does the rest
+	if (changed)
+	{
+		msync(sf, sizeof(*sf), MS_ASYNC);
+	}
+}
+
+void statefile_close(struct hawk_statefile *sf)
+{
+	if (sf)
+	{
+		munmap(sf, sizeof(*sf));
+	}
+}
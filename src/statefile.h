@@ -0,0 +1,59 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STATEFILE_H_
+#define _STATEFILE_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#define STATEFILE_MAGIC		0x4b574148	/* "HAWK" */
+#define STATEFILE_VERSION	1
+
+/*	On-disk Layout				*/
+//Mapped shared and written in place. seq is odd while an update is in
+//progress, so a crash mid-update leaves a record that is ignored on load.
+struct hawk_statefile
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;
+	int32_t node;
+	int32_t weight;
+	int32_t reserved;
+	int64_t changed_at;	//wall clock seconds of the last transition
+	int64_t confirmed_at;	//wall clock seconds of the last probe
+	char status[16];	//raw wsrep_local_state
+};
+
+/*	Open and map the state file, creating it when missing
+	Returns NULL with errno set on failure	*/
+struct hawk_statefile* statefile_open(const char *path);
+
+/*	Non-zero when the record is complete and was confirmed within
+	max_age seconds of now			*/
+int statefile_valid(const struct hawk_statefile *sf, time_t now, int max_age);
+
+/*	Record a probe result. Fields other than confirmed_at are only
+	rewritten when the node state or weight changed	*/
+void statefile_update(struct hawk_statefile *sf, int node, int weight, const char *status, time_t now);
+
+void statefile_close(struct hawk_statefile *sf);
+
+#endif
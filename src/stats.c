@@ -0,0 +1,180 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "stats.h"
+#include "../lib/hawkshm/src/hawkshm.h"
+
+_Static_assert(HAWK_STATS <= HAWKSHM_MAX_COUNTERS, "too many counters for the shm segment");
+_Static_assert(STATUS_VARS <= HAWKSHM_MAX_VARS, "too many status variables for the shm segment");
+_Static_assert(sizeof(struct hawkshm_status) % sizeof(uint64_t) == 0, "shm status must be whole words");
+
+const char *const stat_names[HAWK_STATS] =
+{
+	"requests",
+	"early_answers",
+	"probes",
+	"probe_failures",
+	"transitions",
+	"suppressions",
+	"stale_answers",
+	"unknown_answers",
+	"probes_skipped",
+	"breaker_opens",
+	"breaker_trials",
+	"breaker_closes",
+	"rate_limited",
+	"busy_rejects",
+	"slab_full",
+	"request_timeouts",
+	"partial_writes",
+	"write_timeouts",
+	"subscriptions",
+	"subscribers_dropped",
+	"events",
+	"pushes",
+	"push_failures",
+	"check_failures",
+	"check_timeouts",
+	"ring_nobufs",
+	"ring_overflows"
+};
+
+static uint64_t local_counters[HAWKSHM_MAX_COUNTERS];
+static uint64_t *counters = local_counters;
+static struct hawkshm_segment *segment = NULL;
+static char segment_name[64];
+
+/*	Shared Memory Segment			*/
+int stats_shm_open(const char *name, const char *const *var_names, int nvars, uid_t owner)
+{
+	struct hawkshm_segment *seg = NULL;
+	int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+
+	if (fd < 0)
+	{
+		return -1;
+	}
+	//Created as root, but unlinked and recreated by the daemon user
+	if (geteuid() == 0 && fchown(fd, owner, (gid_t)-1) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	if (ftruncate(fd, sizeof(*seg)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	seg = mmap(NULL, sizeof(*seg), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (seg == MAP_FAILED)
+	{
+		return -1;
+	}
+
+	//Readers ignore the segment until the magic is back
+	__atomic_store_n(&seg->magic, 0, __ATOMIC_RELEASE);
+	memset(seg, 0, sizeof(*seg));
+	seg->version = HAWKSHM_VERSION;
+	seg->size = sizeof(*seg);
+	seg->pid = getpid();
+	seg->nvars = nvars;
+	seg->ncounters = HAWK_STATS;
+	for (int i = 0; i < nvars; i++)
+	{
+		snprintf(seg->var_names[i], HAWKSHM_NAME_LEN, "%s", var_names[i]);
+	}
+	for (int i = 0; i < HAWK_STATS; i++)
+	{
+		snprintf(seg->counter_names[i], HAWKSHM_NAME_LEN, "%s", stat_names[i]);
+		seg->counter[i] = counters[i];
+	}
+	__atomic_store_n(&seg->magic, HAWKSHM_MAGIC, __ATOMIC_RELEASE);
+
+	snprintf(segment_name, sizeof(segment_name), "%s", name);
+	segment = seg;
+	counters = seg->counter;
+	return 0;
+}
+
+void stats_shm_close(void)
+{
+	if (segment == NULL)
+	{
+		return;
+	}
+	memcpy(local_counters, segment->counter, sizeof(local_counters));
+	counters = local_counters;
+	__atomic_store_n(&segment->pid, 0, __ATOMIC_RELEASE);
+	munmap(segment, sizeof(*segment));
+	shm_unlink(segment_name);
+	segment = NULL;
+}
+
+/*	Publish Status				*/
+void stats_publish(const struct hawk_snapshot *snap)
+{
+	struct hawkshm_status st;
+	uint64_t *dst = NULL;
+	const uint64_t *src = (const uint64_t *)&st;
+	uint64_t seq = 0;
+
+	if (segment == NULL)
+	{
+		return;
+	}
+
+	memset(&st, 0, sizeof(st));
+	st.node = snap->node;
+	st.weight = snap->weight;
+	st.fresh = snap->fresh;
+	st.ok = snap->ok;
+	st.probed_at = snap->probed_at;
+	st.generation = snap->generation;
+	memcpy(st.var, snap->var, sizeof(snap->var));
+	memcpy(st.state, snap->state, sizeof(st.state));
+
+	dst = (uint64_t *)&segment->status;
+	seq = __atomic_load_n(&segment->seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&segment->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	for (size_t i = 0; i < sizeof(st) / sizeof(uint64_t); i++)
+	{
+		__atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&segment->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*	Counters				*/
+void stats_inc(enum hawk_stat stat)
+{
+	__atomic_fetch_add(&counters[stat], 1, __ATOMIC_RELAXED);
+}
+
+uint64_t stats_get(enum hawk_stat stat)
+{
+	return __atomic_load_n(&counters[stat], __ATOMIC_RELAXED);
+}
@@ -0,0 +1,78 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "snapshot.h"
+
+/*	Counters				*/
+enum hawk_stat
+{
+	STAT_REQUESTS,			//health checks answered
+	STAT_EARLY_ANSWERS,		//answered warming or from restored state
+	STAT_PROBES,
+	STAT_PROBE_FAILURES,
+	STAT_TRANSITIONS,		//policy output changed
+	STAT_SUPPRESSIONS,		//flap damping kicked in
+	STAT_STALE_ANSWERS,		//last status served past the deadline
+	STAT_UNKNOWN_ANSWERS,		//status too old to serve
+	STAT_PROBES_SKIPPED,		//answered by an open circuit
+	STAT_BREAKER_OPENS,
+	STAT_BREAKER_TRIALS,		//half-open trial probes
+	STAT_BREAKER_CLOSES,
+	STAT_RATE_LIMITED,		//over a client's token bucket
+	STAT_BUSY_REJECTS,		//no connection slot for the client
+	STAT_SLAB_FULL,			//no connection slot at all
+	STAT_REQUEST_TIMEOUTS,		//request not sent in time
+	STAT_PARTIAL_WRITES,		//answers that had to wait for room
+	STAT_WRITE_TIMEOUTS,		//answer not taken in time
+	STAT_SUBSCRIPTIONS,		//state change streams opened
+	STAT_SUBSCRIBERS_DROPPED,	//too slow to take an event
+	STAT_EVENTS,			//state changes streamed
+	STAT_PUSHES,			//state pushed to an HAProxy socket
+	STAT_PUSH_FAILURES,
+	STAT_CHECK_FAILURES,		//pipeline stage rounds that failed
+	STAT_CHECK_TIMEOUTS,		//stage gave no result in time
+	STAT_RING_NOBUFS,		//io_uring receives re-queued for a buffer
+	STAT_RING_OVERFLOWS,		//io_uring CQ overflows moved back
+	HAWK_STATS
+};
+
+extern const char *const stat_names[HAWK_STATS];
+
+/*	Move counters into a shared memory segment and start publishing
+	status there. The segment is given to owner, the user the daemon
+	runs as once root is dropped. Returns -1 with errno set on failure,
+	in which case counters stay process local	*/
+int stats_shm_open(const char *name, const char *const *var_names, int nvars, uid_t owner);
+
+/*	Mark the segment as abandoned and unlink it	*/
+void stats_shm_close(void);
+
+/*	Copy a published snapshot into the segment, if there is one.
+	Single writer, like snapshot_publish	*/
+void stats_publish(const struct hawk_snapshot *snap);
+
+void stats_inc(enum hawk_stat stat);
+uint64_t stats_get(enum hawk_stat stat);
+
+#endif
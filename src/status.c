@@ -0,0 +1,117 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "status.h"
+
+const char *const status_var_names[STATUS_VARS] =
+{
+	"state",
+	"recv_queue",
+	"send_queue",
+	"cluster_size",
+	"primary",
+	"ready",
+	"connected",
+	"desync",
+	"flow_paused",
+	"lag",
+	"io_running",
+	"sql_running",
+	"online_sst",
+	"desynced",
+	"read_only",
+	"disk_free",
+	"sql",
+	"load"
+};
+
+//Server side name of each variable, same order
+static const char *const status_var_sources[STATUS_VARS] =
+{
+	"wsrep_local_state",
+	"wsrep_local_recv_queue",
+	"wsrep_local_send_queue",
+	"wsrep_cluster_size",
+	"wsrep_cluster_status",
+	"wsrep_ready",
+	"wsrep_connected",
+	"wsrep_desync_count",
+	"wsrep_flow_control_paused",
+	NULL,				//set by the replication probe
+	NULL,
+	NULL,
+	NULL,				//read from server variables
+	NULL,
+	NULL,				//set by the check pipeline
+	NULL,
+	NULL,
+	NULL
+};
+
+void status_clear(struct hawk_status *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->var[VAR_LAG] = -1;
+	st->var[VAR_ONLINE_SST] = -1;
+	st->var[VAR_DESYNCED] = -1;
+	snprintf(st->state, sizeof(st->state), "%s", "0");
+}
+
+/*	Value Conversion			*/
+int status_set(struct hawk_status *st, const char *name, const char *value)
+{
+	int i = 0;
+
+	for (i = 0; i < STATUS_VARS; i++)
+	{
+		if (status_var_sources[i] && strcasecmp(name, status_var_sources[i]) == 0)
+		{
+			break;
+		}
+	}
+	if (i == STATUS_VARS || value == NULL)
+	{
+		return 0;
+	}
+
+	switch (i)
+	{
+		case VAR_PRIMARY:
+			st->var[i] = strcasecmp(value, "Primary") == 0;
+			break;
+		case VAR_READY:
+		case VAR_CONNECTED:
+			st->var[i] = strcasecmp(value, "ON") == 0;
+			break;
+		case VAR_FLOW_PAUSED:
+			st->var[i] = (int64_t)(strtod(value, NULL) * 1000);
+			break;
+		case VAR_STATE:
+			snprintf(st->state, sizeof(st->state), "%s", value);
+			/* fall through */
+		default:
+			st->var[i] = strtoll(value, NULL, 10);
+			break;
+	}
+	return 1;
+}
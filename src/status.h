@@ -0,0 +1,67 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STATUS_H_
+#define _STATUS_H_
+
+#include <stdint.h>
+
+/*	Indexed Status Variables		*/
+//Health expressions refer to these by name and are compiled to indexes
+enum status_var
+{
+	VAR_STATE,		//wsrep_local_state
+	VAR_RECV_QUEUE,		//wsrep_local_recv_queue
+	VAR_SEND_QUEUE,		//wsrep_local_send_queue
+	VAR_CLUSTER_SIZE,	//wsrep_cluster_size
+	VAR_PRIMARY,		//wsrep_cluster_status is Primary
+	VAR_READY,		//wsrep_ready is ON
+	VAR_CONNECTED,		//wsrep_connected is ON
+	VAR_DESYNC,		//wsrep_desync_count
+	VAR_FLOW_PAUSED,	//wsrep_flow_control_paused, per mille
+	VAR_LAG,		//replication mode from here on: lag in ms, -1 if unknown
+	VAR_IO_RUNNING,		//replica I/O thread running
+	VAR_SQL_RUNNING,	//replica SQL thread running
+	VAR_ONLINE_SST,		//donor only, -1 otherwise: wsrep_sst_method does not block it
+	VAR_DESYNCED,		//donor only, -1 otherwise: wsrep_desync is ON
+	VAR_READ_ONLY,		//check stages from here on, -1 when not known
+	VAR_DISK_FREE,		//percent free on the datadir
+	VAR_SQL,		//custom query returned the expected value
+	VAR_LOAD,		//load average per CPU x 100
+	STATUS_VARS
+};
+
+extern const char *const status_var_names[STATUS_VARS];
+
+/*	One Probe Result			*/
+struct hawk_status
+{
+	int ok;				//query completed
+	int64_t var[STATUS_VARS];
+	char state[16];			//raw wsrep_local_state for logs
+};
+
+/*	Reset to the values of a failed probe	*/
+void status_clear(struct hawk_status *st);
+
+/*	Store one Variable_name/Value row from SHOW GLOBAL STATUS.
+	Returns 0 if the row is not one of ours	*/
+int status_set(struct hawk_status *st, const char *name, const char *value);
+
+#endif
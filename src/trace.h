@@ -0,0 +1,46 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*	Static Tracepoints			*/
+//USDT probes under the "hawk" provider, visible to bpftrace, perf and
+//SystemTap when <sys/sdt.h> is installed at build time. Each one is a
+//nop instruction plus an ELF note until a tracer attaches. Without the
+//header, or with -DHAWK_NO_USDT, they compile away along with their
+//arguments.
+#if !defined(HAWK_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HAWK_USDT 1
+#endif
+#endif
+
+#ifdef HAWK_USDT
+#define HAWK_TRACE1(name, a)		DTRACE_PROBE1(hawk, name, a)
+#define HAWK_TRACE2(name, a, b)		DTRACE_PROBE2(hawk, name, a, b)
+#define HAWK_TRACE3(name, a, b, c)	DTRACE_PROBE3(hawk, name, a, b, c)
+#else
+#define HAWK_TRACE1(name, a)		do {} while (0)
+#define HAWK_TRACE2(name, a, b)		do {} while (0)
+#define HAWK_TRACE3(name, a, b, c)	do {} while (0)
+#endif
+
+#endif
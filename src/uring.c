@@ -0,0 +1,336 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+/*	System Calls				*/
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned op, void *arg, unsigned n)
+{
+	return (int)syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+/*	Setup					*/
+int uring_init(struct uring *r, unsigned entries, unsigned cq_entries)
+{
+	struct io_uring_params p;
+	char *sq = NULL;
+	char *cq = NULL;
+
+	memset(r, 0, sizeof(*r));
+	memset(&p, 0, sizeof(p));
+	if (cq_entries > 0)
+	{
+		//Clamped to the kernel's limit rather than refused
+		p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+		p.cq_entries = cq_entries;
+	}
+	r->fd = -1;
+	r->fd = sys_setup(entries, &p);
+	if (r->fd < 0)
+	{
+		r->fd = -1;
+		return -1;
+	}
+
+	r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) && r->cq_ring_size > r->sq_ring_size)
+	{
+		r->sq_ring_size = r->cq_ring_size;
+	}
+	sq = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+	{
+		goto fail;
+	}
+	r->sq_ring = sq;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		cq = sq;
+	}
+	else
+	{
+		cq = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+		{
+			goto fail;
+		}
+		r->cq_ring = cq;
+	}
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+	{
+		r->sqes = NULL;
+		goto fail;
+	}
+
+	r->sq_head = (unsigned *)(sq + p.sq_off.head);
+	r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	r->sq_flags = (unsigned *)(sq + p.sq_off.flags);
+	r->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *)(sq + p.sq_off.array);
+	r->sq_entries = p.sq_entries;
+	r->sq_local = *r->sq_tail;
+	r->cq_head = (unsigned *)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	r->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+	r->cq_entries = p.cq_entries;
+	r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	//The index array maps straight through; set once
+	for (unsigned i = 0; i < p.sq_entries; i++)
+	{
+		r->sq_array[i] = i;
+	}
+	return 0;
+
+fail:
+	uring_close(r);
+	return -1;
+}
+
+void uring_close(struct uring *r)
+{
+	if (r->br)
+	{
+		munmap(r->br, r->br_size);
+		free(r->bufs);
+	}
+	if (r->sqes)
+	{
+		munmap(r->sqes, r->sqes_size);
+	}
+	if (r->cq_ring)
+	{
+		munmap(r->cq_ring, r->cq_ring_size);
+	}
+	if (r->sq_ring)
+	{
+		munmap(r->sq_ring, r->sq_ring_size);
+	}
+	if (r->fd >= 0)
+	{
+		close(r->fd);
+	}
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+}
+
+int uring_supported(struct uring *r, const int *ops, int n)
+{
+	size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = calloc(1, size);
+	int ok = 1;
+
+	if (probe == NULL || sys_register(r->fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+	{
+		free(probe);
+		return 0;
+	}
+	for (int i = 0; i < n && ok; i++)
+	{
+		ok = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+	}
+	free(probe);
+	return ok;
+}
+
+/*	Submission				*/
+struct io_uring_sqe* uring_sqe(struct uring *r)
+{
+	struct io_uring_sqe *sqe = NULL;
+	unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+
+	if (r->sq_local - head >= r->sq_entries)
+	{
+		return NULL;
+	}
+	sqe = &r->sqes[r->sq_local & r->sq_mask];
+	r->sq_local++;
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+int uring_pending(struct uring *r)
+{
+	return r->sq_local - *r->sq_tail;
+}
+
+unsigned uring_room(struct uring *r)
+{
+	return r->sq_entries - (r->sq_local - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE));
+}
+
+int uring_submit(struct uring *r, unsigned wait)
+{
+	unsigned submit = r->sq_local - *r->sq_tail;
+	int ret = 0;
+
+	__atomic_store_n(r->sq_tail, r->sq_local, __ATOMIC_RELEASE);
+	if (submit == 0 && wait == 0)
+	{
+		return 0;
+	}
+	do
+	{
+		ret = sys_enter(r->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+	}
+	while (ret < 0 && errno == EINTR);
+	return ret;
+}
+
+/*	Completion				*/
+struct io_uring_cqe* uring_cqe(struct uring *r)
+{
+	unsigned head = *r->cq_head;
+
+	if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+	{
+		return NULL;
+	}
+	return &r->cqes[head & r->cq_mask];
+}
+
+void uring_seen(struct uring *r)
+{
+	__atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int uring_flush(struct uring *r)
+{
+	int ret = 0;
+
+	if (!(__atomic_load_n(r->sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW))
+	{
+		return 0;
+	}
+	do
+	{
+		ret = sys_enter(r->fd, 0, 0, IORING_ENTER_GETEVENTS);
+	}
+	while (ret < 0 && errno == EINTR);
+	return 1;
+}
+
+/*	Registered Resources			*/
+int uring_files(struct uring *r, unsigned count)
+{
+	struct io_uring_rsrc_register reg;
+	struct io_uring_file_index_range range;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.nr = count;
+	reg.flags = IORING_RSRC_REGISTER_SPARSE;
+	if (sys_register(r->fd, IORING_REGISTER_FILES2, &reg, sizeof(reg)) < 0)
+	{
+		return -1;
+	}
+	//Accepts with IORING_FILE_INDEX_ALLOC pick from the whole table
+	memset(&range, 0, sizeof(range));
+	range.len = count;
+	return sys_register(r->fd, IORING_REGISTER_FILE_ALLOC_RANGE, &range, 0) < 0 ? -1 : 0;
+}
+
+int uring_file_close(struct uring *r, unsigned slot)
+{
+	struct io_uring_files_update up;
+	int32_t fd = -1;
+
+	memset(&up, 0, sizeof(up));
+	up.offset = slot;
+	up.fds = (uint64_t)(uintptr_t)&fd;
+	return sys_register(r->fd, IORING_REGISTER_FILES_UPDATE, &up, 1) < 0 ? -1 : 0;
+}
+
+int uring_buffers(struct uring *r, unsigned count, unsigned size, uint16_t bgid)
+{
+	struct io_uring_buf_reg reg;
+	void *ring = NULL;
+
+	if (count == 0 || (count & (count - 1)) != 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	r->br_size = count * sizeof(struct io_uring_buf);
+	ring = mmap(NULL, r->br_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (ring == MAP_FAILED)
+	{
+		return -1;
+	}
+	r->bufs = malloc((size_t)count * size);
+	if (r->bufs == NULL)
+	{
+		munmap(ring, r->br_size);
+		return -1;
+	}
+	memset(r->bufs, 0, (size_t)count * size);
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)ring;
+	reg.ring_entries = count;
+	reg.bgid = bgid;
+	if (sys_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+	{
+		munmap(ring, r->br_size);
+		free(r->bufs);
+		r->bufs = NULL;
+		return -1;
+	}
+	r->br = ring;
+	r->nbufs = count;
+	r->buf_size = size;
+	r->bgid = bgid;
+	for (unsigned i = 0; i < count; i++)
+	{
+		uring_recycle(r, i);
+	}
+	return 0;
+}
+
+char* uring_buffer(struct uring *r, unsigned bid)
+{
+	return r->bufs + (size_t)bid * r->buf_size;
+}
+
+void uring_recycle(struct uring *r, unsigned bid)
+{
+	uint16_t tail = r->br->tail;
+	struct io_uring_buf *buf = &r->br->bufs[tail & (r->nbufs - 1)];
+
+	buf->addr = (uint64_t)(uintptr_t)uring_buffer(r, bid);
+	buf->len = r->buf_size;
+	buf->bid = bid;
+	__atomic_store_n(&r->br->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
@@ -0,0 +1,113 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _URING_H_
+#define _URING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+/*	io_uring Without liburing		*/
+//A submission/completion ring driven through the raw system calls, for
+//one thread. Only what the HTTP listener needs: fixed files, a
+//provided buffer ring and opcode probing.
+
+//Newer than some kernel headers
+#ifndef IORING_OP_FIXED_FD_INSTALL
+#define IORING_OP_FIXED_FD_INSTALL	54
+#endif
+
+struct uring
+{
+	int fd;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_flags;
+	unsigned sq_mask;
+	unsigned *sq_array;
+	unsigned sq_entries;
+	unsigned sq_local;		//tail including SQEs not yet published
+	struct io_uring_sqe *sqes;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	unsigned cq_entries;
+	struct io_uring_cqe *cqes;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;			//same mapping as sq_ring with a single mmap
+	size_t cq_ring_size;
+	size_t sqes_size;
+	//Provided buffer ring
+	struct io_uring_buf_ring *br;
+	size_t br_size;
+	char *bufs;
+	unsigned nbufs;
+	unsigned buf_size;
+	uint16_t bgid;
+};
+
+/*	Create a ring with room for entries submissions and, if non-zero,
+	cq_entries completions (twice entries otherwise). Returns -1 with
+	errno set when the kernel has no io_uring or it is disabled */
+int uring_init(struct uring *r, unsigned entries, unsigned cq_entries);
+
+void uring_close(struct uring *r);
+
+/*	Whether the kernel knows every one of the n opcodes	*/
+int uring_supported(struct uring *r, const int *ops, int n);
+
+/*	A cleared SQE to fill in, or NULL when the queue is full	*/
+struct io_uring_sqe* uring_sqe(struct uring *r);
+
+/*	Hand queued SQEs to the kernel, waiting for wait completions.
+	Returns the number submitted or -1	*/
+int uring_submit(struct uring *r, unsigned wait);
+
+/*	SQEs taken but not yet submitted, and free entries left	*/
+int uring_pending(struct uring *r);
+unsigned uring_room(struct uring *r);
+
+/*	Next completion, or NULL; uring_seen() consumes it	*/
+struct io_uring_cqe* uring_cqe(struct uring *r);
+void uring_seen(struct uring *r);
+
+/*	Completions the kernel could not fit in a full CQ wait on a list
+	that only a GETEVENTS enter moves back, and the ring fd does not
+	become readable for them. Moves them if there are any; returns 1
+	when it did	*/
+int uring_flush(struct uring *r);
+
+/*	An empty fixed file table of count slots for direct descriptors */
+int uring_files(struct uring *r, unsigned count);
+
+/*	Close a direct descriptor at once, without an SQE	*/
+int uring_file_close(struct uring *r, unsigned slot);
+
+/*	count buffers of size bytes in buffer group bgid. count must be a
+	power of two	*/
+int uring_buffers(struct uring *r, unsigned count, unsigned size, uint16_t bgid);
+
+char* uring_buffer(struct uring *r, unsigned bid);
+
+/*	Give a buffer the kernel filled back to the ring	*/
+void uring_recycle(struct uring *r, unsigned bid);
+
+#endif
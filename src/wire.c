@@ -0,0 +1,731 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "sha.h"
+#include "wire.h"
+
+//Capability flags
+#define CLIENT_LONG_PASSWORD		0x00000001
+#define CLIENT_PROTOCOL_41		0x00000200
+#define CLIENT_TRANSACTIONS		0x00002000
+#define CLIENT_SECURE_CONNECTION	0x00008000
+#define CLIENT_PLUGIN_AUTH		0x00080000
+
+#define COM_QUIT	0x01
+#define COM_QUERY	0x03
+
+#define NONCE_LEN	20
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int fail(struct wire *w, unsigned code, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(w->error, sizeof(w->error), fmt, ap);
+	va_end(ap);
+	w->err_no = code;
+	return -1;
+}
+
+/*	Socket I/O				*/
+//Waits for events on the socket until the deadline
+static int wait_for(struct wire *w, short events, long long deadline)
+{
+	struct pollfd pfd = {w->fd, events, 0};
+	long long left = 0;
+	int n = 0;
+
+	do
+	{
+		left = deadline - now_ms();
+		if (left <= 0)
+		{
+			return fail(w, 0, "Timed out talking to the server");
+		}
+		n = poll(&pfd, 1, (int)left);
+	}
+	while (n < 0 && errno == EINTR);
+	if (n < 0)
+	{
+		return fail(w, 0, "poll: %s", strerror(errno));
+	}
+	return 0;
+}
+
+static int send_all(struct wire *w, const uint8_t *data, size_t len, long long deadline)
+{
+	ssize_t n = 0;
+
+	while (len > 0)
+	{
+		n = send(w->fd, data, len, MSG_NOSIGNAL);
+		if (n > 0)
+		{
+			data += n;
+			len -= n;
+			continue;
+		}
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n < 0 && errno == EAGAIN)
+		{
+			if (wait_for(w, POLLOUT, deadline) != 0)
+			{
+				return -1;
+			}
+			continue;
+		}
+		return fail(w, 0, "Lost connection to the server while writing: %s", strerror(errno));
+	}
+	return 0;
+}
+
+//Sends w->out[4, 4 + len) as the next packet of the exchange
+static int send_packet(struct wire *w, size_t len, long long deadline)
+{
+	w->out[0] = len & 0xff;
+	w->out[1] = (len >> 8) & 0xff;
+	w->out[2] = (len >> 16) & 0xff;
+	w->out[3] = w->seq++;
+	return send_all(w, w->out, len + 4, deadline);
+}
+
+//Makes w->pkt the next packet, reading more of the stream if needed
+static int read_packet(struct wire *w, long long deadline)
+{
+	size_t have = 0;
+	size_t need = 4;
+	ssize_t n = 0;
+
+	while (1)
+	{
+		have = w->end - w->start;
+		if (have >= 4)
+		{
+			need = 4 + (w->buf[w->start] | (w->buf[w->start + 1] << 8) | ((size_t)w->buf[w->start + 2] << 16));
+			if (need > sizeof(w->buf))
+			{
+				return fail(w, 0, "Server packet of %zu bytes is too large", need - 4);
+			}
+			if (have >= need)
+			{
+				break;
+			}
+		}
+		//Make room at the end for the rest of the packet
+		if (w->start > 0 && w->start + need > sizeof(w->buf))
+		{
+			memmove(w->buf, w->buf + w->start, have);
+			w->start = 0;
+			w->end = have;
+		}
+		n = recv(w->fd, w->buf + w->end, sizeof(w->buf) - w->end, 0);
+		if (n > 0)
+		{
+			w->end += n;
+			continue;
+		}
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n < 0 && errno == EAGAIN)
+		{
+			if (wait_for(w, POLLIN, deadline) != 0)
+			{
+				return -1;
+			}
+			continue;
+		}
+		return fail(w, 0, "Lost connection to the server while reading%s%s", n == 0 ? "" : ": ", n == 0 ? "" : strerror(errno));
+	}
+	w->seq = w->buf[w->start + 3] + 1;
+	w->pkt = w->buf + w->start + 4;
+	w->pkt_len = need - 4;
+	w->start += need;
+	if (w->start == w->end)
+	{
+		w->start = w->end = 0;
+	}
+	return 0;
+}
+
+//An ERR packet: code, optional #SQLSTATE, message
+static int server_error(struct wire *w)
+{
+	size_t at = 3;
+
+	if (w->pkt_len < 3)
+	{
+		return fail(w, 0, "Malformed error packet");
+	}
+	if (w->pkt_len > 3 && w->pkt[3] == '#')
+	{
+		at = w->pkt_len >= 9 ? 9 : w->pkt_len;
+	}
+	return fail(w, w->pkt[1] | (w->pkt[2] << 8), "%.*s", (int)(w->pkt_len - at), (const char *)w->pkt + at);
+}
+
+//Length-encoded integer at *at; 0xfb (NULL) is returned as -1
+static long long lenenc(const uint8_t *p, size_t len, size_t *at)
+{
+	long long v = 0;
+	int bytes = 0;
+
+	if (*at >= len)
+	{
+		return -2;
+	}
+	switch (p[*at])
+	{
+		case 0xfb:
+			(*at)++;
+			return -1;
+		case 0xfc:
+			bytes = 2;
+			break;
+		case 0xfd:
+			bytes = 3;
+			break;
+		case 0xfe:
+			bytes = 8;
+			break;
+		case 0xff:
+			return -2;
+		default:
+			return p[(*at)++];
+	}
+	if (*at + 1 + bytes > len)
+	{
+		return -2;
+	}
+	for (int i = 0; i < bytes; i++)
+	{
+		v |= (long long)p[*at + 1 + i] << (8 * i);
+	}
+	*at += 1 + bytes;
+	return v;
+}
+
+/*	Authentication				*/
+//Scramble for plugin into out; returns its length, or -1 if the plugin
+//is not one we speak
+static int scramble(const char *plugin, const uint8_t *nonce, const char *pass, uint8_t *out)
+{
+	struct sha1 s1;
+	struct sha256 s256;
+	uint8_t stage1[SHA256_LEN];
+	uint8_t stage2[SHA256_LEN];
+	uint8_t mix[SHA256_LEN];
+	size_t plen = strlen(pass);
+
+	if (strcmp(plugin, "mysql_native_password") == 0)
+	{
+		if (plen == 0)
+		{
+			return 0;
+		}
+		//SHA1(pass) XOR SHA1(nonce, SHA1(SHA1(pass)))
+		sha1_init(&s1);
+		sha1_update(&s1, pass, plen);
+		sha1_final(&s1, stage1);
+		sha1_init(&s1);
+		sha1_update(&s1, stage1, SHA1_LEN);
+		sha1_final(&s1, stage2);
+		sha1_init(&s1);
+		sha1_update(&s1, nonce, NONCE_LEN);
+		sha1_update(&s1, stage2, SHA1_LEN);
+		sha1_final(&s1, mix);
+		for (int i = 0; i < SHA1_LEN; i++)
+		{
+			out[i] = stage1[i] ^ mix[i];
+		}
+		return SHA1_LEN;
+	}
+	if (strcmp(plugin, "caching_sha2_password") == 0)
+	{
+		if (plen == 0)
+		{
+			return 0;
+		}
+		//SHA256(pass) XOR SHA256(SHA256(SHA256(pass)), nonce)
+		sha256_init(&s256);
+		sha256_update(&s256, pass, plen);
+		sha256_final(&s256, stage1);
+		sha256_init(&s256);
+		sha256_update(&s256, stage1, SHA256_LEN);
+		sha256_final(&s256, stage2);
+		sha256_init(&s256);
+		sha256_update(&s256, stage2, SHA256_LEN);
+		sha256_update(&s256, nonce, NONCE_LEN);
+		sha256_final(&s256, mix);
+		for (int i = 0; i < SHA256_LEN; i++)
+		{
+			out[i] = stage1[i] ^ mix[i];
+		}
+		return SHA256_LEN;
+	}
+	return -1;
+}
+
+//Copies the NUL-terminated string at *at of the packet into out
+static int take_str(const uint8_t *p, size_t len, size_t *at, char *out, size_t size)
+{
+	const uint8_t *nul = *at < len ? memchr(p + *at, 0, len - *at) : NULL;
+	size_t n = nul ? (size_t)(nul - (p + *at)) : len - *at;
+
+	if (n >= size)
+	{
+		return -1;
+	}
+	memcpy(out, p + *at, n);
+	out[n] = '\0';
+	*at += n + (nul != NULL);
+	return 0;
+}
+
+//Answers the server until it accepts or refuses the login
+static int auth_exchange(struct wire *w, char *plugin, size_t plugin_size, uint8_t *nonce, const char *pass, long long deadline)
+{
+	size_t at = 0;
+	size_t plen = strlen(pass);
+	int n = 0;
+
+	while (1)
+	{
+		if (read_packet(w, deadline) != 0)
+		{
+			return -1;
+		}
+		switch (w->pkt_len ? w->pkt[0] : 0xff)
+		{
+			case 0x00:
+				return 0;
+			case 0xff:
+				return server_error(w);
+			case 0xfe:
+				//Switch to the plugin named, with a fresh nonce
+				at = 1;
+				if (take_str(w->pkt, w->pkt_len, &at, plugin, plugin_size) != 0 || w->pkt_len - at < NONCE_LEN)
+				{
+					return fail(w, 0, "Malformed auth switch request");
+				}
+				memcpy(nonce, w->pkt + at, NONCE_LEN);
+				n = scramble(plugin, nonce, pass, w->out + 4);
+				if (n < 0)
+				{
+					return fail(w, 0, "Server asked for unsupported auth plugin %s", plugin);
+				}
+				if (send_packet(w, n, deadline) != 0)
+				{
+					return -1;
+				}
+				break;
+			case 0x01:
+				//caching_sha2_password: 3 is a cache hit, 4 wants the
+				//password itself
+				if (w->pkt_len < 2 || strcmp(plugin, "caching_sha2_password") != 0)
+				{
+					return fail(w, 0, "Unexpected auth data from the server");
+				}
+				if (w->pkt[1] == 3)
+				{
+					break;
+				}
+				if (w->pkt[1] != 4)
+				{
+					return fail(w, 0, "Unexpected caching_sha2_password state %d", w->pkt[1]);
+				}
+				if (!w->local)
+				{
+					return fail(w, 0, "caching_sha2_password needs a full login, which the built-in client only does over a Unix socket");
+				}
+				if (plen + 1 > sizeof(w->out) - 4)
+				{
+					return fail(w, 0, "Password too long");
+				}
+				memcpy(w->out + 4, pass, plen + 1);
+				if (send_packet(w, plen + 1, deadline) != 0)
+				{
+					return -1;
+				}
+				break;
+			default:
+				return fail(w, 0, "Unexpected packet 0x%02x during login", w->pkt[0]);
+		}
+	}
+}
+
+/*	Connection				*/
+int wire_target(struct wire_target *t, const char *host, int port, const char *path, char *err, size_t len)
+{
+	struct sockaddr_un *un = (struct sockaddr_un *)&t->addr;
+	struct sockaddr_in *in4 = (struct sockaddr_in *)&t->addr;
+	struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&t->addr;
+	struct addrinfo hints;
+	struct addrinfo *res = NULL;
+	char service[16];
+	int rc = 0;
+
+	memset(t, 0, sizeof(*t));
+	if (path && path[0])
+	{
+		if (strlen(path) >= sizeof(un->sun_path))
+		{
+			snprintf(err, len, "Socket path %s is too long", path);
+			return -1;
+		}
+		un->sun_family = AF_UNIX;
+		strcpy(un->sun_path, path);
+		t->len = sizeof(*un);
+		t->local = 1;
+		return 0;
+	}
+	if (inet_pton(AF_INET, host, &in4->sin_addr) == 1)
+	{
+		in4->sin_family = AF_INET;
+		in4->sin_port = htons(port);
+		t->len = sizeof(*in4);
+		return 0;
+	}
+	if (inet_pton(AF_INET6, host, &in6->sin6_addr) == 1)
+	{
+		in6->sin6_family = AF_INET6;
+		in6->sin6_port = htons(port);
+		t->len = sizeof(*in6);
+		return 0;
+	}
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(service, sizeof(service), "%d", port);
+	if ((rc = getaddrinfo(host, service, &hints, &res)) != 0)
+	{
+		snprintf(err, len, "Unknown MySQL server host '%s' (%s)", host, gai_strerror(rc));
+		return -1;
+	}
+	memcpy(&t->addr, res->ai_addr, res->ai_addrlen);
+	t->len = res->ai_addrlen;
+	freeaddrinfo(res);
+	return 0;
+}
+
+int wire_connect(struct wire *w, const struct wire_target *t, const char *user, const char *pass, long long deadline)
+{
+	uint8_t nonce[NONCE_LEN];
+	char plugin[64] = "mysql_native_password";
+	uint32_t caps = 0;
+	size_t at = 0;
+	size_t ulen = strlen(user);
+	uint8_t *o = w->out + 4;
+	int err = 0;
+	socklen_t errlen = sizeof(err);
+	int one = 1;
+	int n = 0;
+
+	w->fd = -1;
+	w->local = t->local;
+	w->start = w->end = 0;
+	w->err_no = 0;
+	w->error[0] = '\0';
+	w->fd = socket(t->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (w->fd < 0)
+	{
+		return fail(w, 0, "socket: %s", strerror(errno));
+	}
+	if (!t->local)
+	{
+		setsockopt(w->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+	if (connect(w->fd, (const struct sockaddr *)&t->addr, t->len) != 0)
+	{
+		if (errno != EINPROGRESS)
+		{
+			return fail(w, 0, "Can't connect to MySQL server: %s", strerror(errno));
+		}
+		if (wait_for(w, POLLOUT, deadline) != 0)
+		{
+			return -1;
+		}
+		getsockopt(w->fd, SOL_SOCKET, SO_ERROR, &err, &errlen);
+		if (err != 0)
+		{
+			return fail(w, 0, "Can't connect to MySQL server: %s", strerror(err));
+		}
+	}
+
+	//Initial handshake
+	if (read_packet(w, deadline) != 0)
+	{
+		return -1;
+	}
+	if (w->pkt_len > 0 && w->pkt[0] == 0xff)
+	{
+		return server_error(w);
+	}
+	if (w->pkt_len < 1 || w->pkt[0] != 10)
+	{
+		return fail(w, 0, "Unsupported handshake protocol %d", w->pkt_len ? w->pkt[0] : -1);
+	}
+	at = 1;
+	at += strnlen((const char *)w->pkt + at, w->pkt_len - at) + 1;	//server version
+	at += 4;							//connection id
+	if (at + 8 + 1 + 2 + 1 + 2 + 2 + 1 + 10 + 12 > w->pkt_len)
+	{
+		return fail(w, 0, "Handshake too short");
+	}
+	memcpy(nonce, w->pkt + at, 8);
+	at += 8 + 1;
+	caps = w->pkt[at] | (w->pkt[at + 1] << 8);
+	at += 2 + 1 + 2;						//charset, status
+	caps |= (uint32_t)(w->pkt[at] | (w->pkt[at + 1] << 8)) << 16;
+	n = w->pkt[at + 2];						//auth data length
+	at += 2 + 1 + 10;						//reserved
+	if (!(caps & CLIENT_PROTOCOL_41) || !(caps & CLIENT_SECURE_CONNECTION))
+	{
+		return fail(w, 0, "Server does not speak protocol 4.1 authentication");
+	}
+	memcpy(nonce + 8, w->pkt + at, 12);
+	at += n - 8 > 13 ? n - 8 : 13;
+	if ((caps & CLIENT_PLUGIN_AUTH) && at < w->pkt_len)
+	{
+		if (take_str(w->pkt, w->pkt_len, &at, plugin, sizeof(plugin)) != 0)
+		{
+			return fail(w, 0, "Malformed auth plugin name");
+		}
+	}
+
+	//Handshake response 41
+	caps = CLIENT_LONG_PASSWORD | CLIENT_PROTOCOL_41 | CLIENT_TRANSACTIONS | CLIENT_SECURE_CONNECTION | CLIENT_PLUGIN_AUTH;
+	if (ulen > 255)
+	{
+		return fail(w, 0, "User name too long");
+	}
+	at = 0;
+	o[at++] = caps;
+	o[at++] = caps >> 8;
+	o[at++] = caps >> 16;
+	o[at++] = caps >> 24;
+	memcpy(o + at, "\0\0\0\1", 4);					//max packet 16M
+	at += 4;
+	o[at++] = 33;							//utf8_general_ci
+	memset(o + at, 0, 23);
+	at += 23;
+	memcpy(o + at, user, ulen + 1);
+	at += ulen + 1;
+	n = scramble(plugin, nonce, pass, o + at + 1);
+	if (n < 0)
+	{
+		//Answer as native and let the server switch us
+		snprintf(plugin, sizeof(plugin), "mysql_native_password");
+		n = scramble(plugin, nonce, pass, o + at + 1);
+	}
+	o[at] = n;
+	at += 1 + n;
+	memcpy(o + at, plugin, strlen(plugin) + 1);
+	at += strlen(plugin) + 1;
+	if (send_packet(w, at, deadline) != 0)
+	{
+		return -1;
+	}
+	return auth_exchange(w, plugin, sizeof(plugin), nonce, pass, deadline);
+}
+
+/*	Queries					*/
+//Column name of a ColumnDefinition41 packet: the fifth string, after
+//catalog, schema, table and org_table
+static int column_name(const uint8_t *p, size_t len, const char **name, size_t *name_len)
+{
+	size_t at = 0;
+	long long n = 0;
+
+	for (int i = 0; i < 5; i++)
+	{
+		n = lenenc(p, len, &at);
+		if (n < 0 || at + n > len)
+		{
+			return -1;
+		}
+		*name = (const char *)p + at;
+		*name_len = n;
+		at += n;
+	}
+	return 0;
+}
+
+int wire_query(struct wire *w, const char *sql, long long deadline)
+{
+	return wire_query_columns(w, sql, NULL, 0, NULL, deadline);
+}
+
+int wire_query_columns(struct wire *w, const char *sql, const char *const *names, int n, int *index, long long deadline)
+{
+	size_t len = strlen(sql);
+	size_t at = 0;
+	long long columns = 0;
+	const char *name = NULL;
+	size_t name_len = 0;
+
+	if (len + 1 > sizeof(w->out) - 4)
+	{
+		return fail(w, 0, "Query too long");
+	}
+	w->seq = 0;
+	w->columns = 0;
+	w->out[4] = COM_QUERY;
+	memcpy(w->out + 5, sql, len);
+	if (send_packet(w, len + 1, deadline) != 0 || read_packet(w, deadline) != 0)
+	{
+		return -1;
+	}
+	if (w->pkt_len == 0)
+	{
+		return fail(w, 0, "Empty query response");
+	}
+	if (w->pkt[0] == 0xff)
+	{
+		return server_error(w);
+	}
+	if (w->pkt[0] == 0x00)
+	{
+		return 0;
+	}
+	columns = lenenc(w->pkt, w->pkt_len, &at);
+	if (columns <= 0)
+	{
+		return fail(w, 0, "Malformed resultset header");
+	}
+	for (int i = 0; i < n; i++)
+	{
+		index[i] = -1;
+	}
+	//Column definitions are only read for the names asked for. They
+	//end with an EOF packet
+	for (long long i = 0; i <= columns; i++)
+	{
+		if (read_packet(w, deadline) != 0)
+		{
+			return -1;
+		}
+		if (w->pkt_len > 0 && w->pkt[0] == 0xff)
+		{
+			return server_error(w);
+		}
+		if (i == columns || n == 0)
+		{
+			continue;
+		}
+		if (column_name(w->pkt, w->pkt_len, &name, &name_len) != 0)
+		{
+			return fail(w, 0, "Malformed column definition");
+		}
+		for (int j = 0; j < n; j++)
+		{
+			if (strlen(names[j]) == name_len && strncasecmp(names[j], name, name_len) == 0)
+			{
+				index[j] = i;
+			}
+		}
+	}
+	if (w->pkt_len == 0 || w->pkt[0] != 0xfe)
+	{
+		return fail(w, 0, "Malformed column definitions");
+	}
+	w->columns = columns;
+	return columns;
+}
+
+int wire_row(struct wire *w, struct wire_field *fields, int max, long long deadline)
+{
+	long long len = 0;
+	size_t at = 0;
+
+	if (w->columns == 0)
+	{
+		return 0;
+	}
+	if (read_packet(w, deadline) != 0)
+	{
+		return -1;
+	}
+	if (w->pkt_len > 0 && w->pkt[0] == 0xff)
+	{
+		w->columns = 0;
+		return server_error(w);
+	}
+	if (w->pkt_len > 0 && w->pkt_len < 9 && w->pkt[0] == 0xfe)
+	{
+		w->columns = 0;
+		return 0;
+	}
+	for (unsigned i = 0; i < w->columns; i++)
+	{
+		len = lenenc(w->pkt, w->pkt_len, &at);
+		if (len < -1 || at + (len > 0 ? len : 0) > w->pkt_len)
+		{
+			return fail(w, 0, "Malformed row");
+		}
+		if ((int)i < max)
+		{
+			fields[i].data = len < 0 ? NULL : (const char *)w->pkt + at;
+			fields[i].len = len < 0 ? 0 : len;
+		}
+		at += len > 0 ? len : 0;
+	}
+	return 1;
+}
+
+void wire_close(struct wire *w)
+{
+	if (w->fd < 0)
+	{
+		return;
+	}
+	//Lets the server log a clean disconnect; not worth waiting for
+	w->seq = 0;
+	w->out[4] = COM_QUIT;
+	w->out[0] = 1;
+	w->out[1] = w->out[2] = 0;
+	w->out[3] = 0;
+	send(w->fd, w->out, 5, MSG_NOSIGNAL | MSG_DONTWAIT);
+	close(w->fd);
+	w->fd = -1;
+}
@@ -0,0 +1,93 @@
+/*  HAwk - MySQL/MariaDB monitoring for HAproxy load balancing
+    Copyright (C) 2014  
+    
+    Author: Dylan F Marquis (dylanfmarquis@dylanfmarquis.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _WIRE_H_
+#define _WIRE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*	Built-in MySQL Client			*/
+//The part of the MySQL client/server protocol a probe needs, without
+//libmysqlclient: handshake v10, mysql_native_password and
+//caching_sha2_password logins (a full caching_sha2 login needs a Unix
+//socket, the password going over it in the clear), COM_QUERY and text
+//resultsets. The socket is non-blocking and every wait ends at the
+//caller's deadline, in CLOCK_MONOTONIC milliseconds, however slowly the
+//server trickles its answer. All state, buffers included, lives in
+//struct wire, so a probe allocates nothing.
+#define WIRE_BUF	16384		//largest packet a probe can take
+
+struct wire_target
+{
+	struct sockaddr_storage addr;
+	socklen_t len;
+	int local;			//Unix socket
+};
+
+//One column of a row; data is NULL for SQL NULL and is not terminated
+struct wire_field
+{
+	const char *data;
+	size_t len;
+};
+
+struct wire
+{
+	int fd;
+	int local;
+	uint8_t seq;
+	unsigned columns;		//of the current resultset
+	size_t start;			//unread input is buf[start, end)
+	size_t end;
+	const uint8_t *pkt;		//last packet read, in buf
+	size_t pkt_len;
+	unsigned err_no;		//server error code, 0 for client errors
+	char error[192];
+	uint8_t buf[WIRE_BUF];
+	uint8_t out[1024];
+};
+
+/*	A numeric IPv4/IPv6 address and port, or a socket path if path is
+	set. Host names are resolved with getaddrinfo, which allocates.
+	Returns -1 with the reason in err	*/
+int wire_target(struct wire_target *t, const char *host, int port, const char *path, char *err, size_t len);
+
+/*	Connect and log in. Returns -1 with w->error set	*/
+int wire_connect(struct wire *w, const struct wire_target *t, const char *user, const char *pass, long long deadline);
+
+/*	Send a query and read up to its first row. Returns the number of
+	columns, 0 for a statement without rows, or -1	*/
+int wire_query(struct wire *w, const char *sql, long long deadline);
+
+/*	The same, also finding columns by name: index[i] is the position
+	of names[i] in each row, or -1 if the resultset has no such column */
+int wire_query_columns(struct wire *w, const char *sql, const char *const *names, int n, int *index, long long deadline);
+
+/*	Next row into fields, at most max of them. Returns 1 for a row, 0
+	at the end of the resultset and -1 on errors. The fields point into
+	w and are valid until the next call	*/
+int wire_row(struct wire *w, struct wire_field *fields, int max, long long deadline);
+
+/*	Say goodbye and close; safe to call on a wire that never connected */
+void wire_close(struct wire *w);
+
+#endif